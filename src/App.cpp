@@ -1,5 +1,8 @@
 #include "App.h"
 
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
 #include <exception>
 #include <iostream>
 
@@ -14,18 +17,60 @@
 #include <imgui/backends/imgui_impl_opengl3.h>
 
 #include "image_viewer/ImageViewerLDR.h"
+#include "image_viewer/ImageViewerPreview.h"
 #include "image_viewer/ImageViewerSpectralEXR.h"
 
 #include <nfd.h>
 
+#include "Trace.h"
+
 
 App::App(int argc, char *argv[])
     // : _imageViewer(new ImageViewerLDR("image_w.png"))
     : _imageViewer(nullptr)
+    , _framebufferSRGB(false)
     , _leftMouseButtonPressed(false)
     , _requestOpen(false)
     , _layoutInitialized(false)
+    , _redrawFrames(REDRAW_FRAMES)
+    , _alwaysRedraw(false)
+    , _showFrameTimings(false)
+    , _profiling(false)
+    , _pcaCompression(false)
+    , _pcaComponents(8)
+    , _cacheDerivedData(false)
+    , _cacheSidecar(false)
+    , _loadGeneration(0)
 {
+    // ------------------------------------------------------------------------
+    // Command line
+    // ------------------------------------------------------------------------
+
+    std::string imagePath;
+    std::string tracePath;
+
+    if (const char *env = std::getenv("TIRESIAS_TRACE")) {
+        tracePath = env;
+    }
+
+    for (int i = 1; i < argc; i++) {
+        const std::string arg = argv[i];
+
+        if (arg == "--trace" && i + 1 < argc) {
+            tracePath = argv[++i];
+        } else {
+            imagePath = arg;
+        }
+    }
+
+    if (!tracePath.empty()) {
+#ifdef TIRESIAS_TRACING
+        Trace::start(tracePath);
+#else
+        std::cerr << "Tracing is not available, build with TIRESIAS_TRACING" << std::endl;
+#endif
+    }
+
     // ------------------------------------------------------------------------
     // GLFW initialization
     // ------------------------------------------------------------------------
@@ -36,18 +81,27 @@ App::App(int argc, char *argv[])
 
     glfwSetErrorCallback(glfw_error_cb);
 
-    glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 3);
-    glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 3);
-    glfwWindowHint(GLFW_OPENGL_PROFILE, GLFW_OPENGL_CORE_PROFILE);
-    glfwWindowHint(GLFW_OPENGL_FORWARD_COMPAT, GL_TRUE);
+    // OpenGL 4.3 enables the compute shader path, 3.3 is the minimum
+    const int glVersions[2][2] = {{4, 3}, {3, 3}};
 
-    _window = glfwCreateWindow(1280, 720, "Tiresias", NULL, NULL);
-    glfwSetWindowUserPointer(_window, this);
+    _window = NULL;
+
+    for (size_t i = 0; i < 2 && !_window; i++) {
+        glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, glVersions[i][0]);
+        glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, glVersions[i][1]);
+        glfwWindowHint(GLFW_OPENGL_PROFILE, GLFW_OPENGL_CORE_PROFILE);
+        glfwWindowHint(GLFW_OPENGL_FORWARD_COMPAT, GL_TRUE);
+        glfwWindowHint(GLFW_SRGB_CAPABLE, GL_TRUE);
+
+        _window = glfwCreateWindow(1280, 720, "Tiresias", NULL, NULL);
+    }
 
     if (!_window) {
         throw std::runtime_error("Could not create a window");
     }
 
+    glfwSetWindowUserPointer(_window, this);
+
     glfwMakeContextCurrent(_window);
     glfwSwapInterval(1);   // Enable vsync
 
@@ -118,14 +172,25 @@ App::App(int argc, char *argv[])
     ImGui_ImplOpenGL3_Init(glsl_version);
 
     // Check if an image was provided as an argument
-    if (argc > 1) {
-        open(argv[1]);
+    if (!imagePath.empty()) {
+        open(imagePath);
     }
 }
 
 
 App::~App()
 {
+    // Loaders post events to the window
+    for (std::future<void> &loader : _loaders) {
+        loader.wait();
+    }
+
+    // Viewers release their GL objects while the context is alive
+    _loadedViewer.reset();
+    _discardedViewers.clear();
+    _drawnImageViewer.reset();
+    _imageViewer.reset();
+
     ImGui_ImplOpenGL3_Shutdown();
     ImGui_ImplGlfw_Shutdown();
     ImGui::DestroyContext();
@@ -133,13 +198,48 @@ App::~App()
     glfwDestroyWindow(_window);
     glfwDestroyCursor(_cursorHand);
     glfwTerminate();
+
+    try {
+        Trace::stop();
+    } catch (const std::exception &e) {
+        std::cerr << e.what() << std::endl;
+    }
 }
 
 
 void App::exec()
 {
     while (!glfwWindowShouldClose(_window)) {
-        glfwPollEvents();
+        bool busy = _alwaysRedraw || _redrawFrames > 0;
+
+        _imageViewerMutex.lock();
+        if (_imageViewer) {
+            busy = busy || _imageViewer->needsRedraw();
+        }
+        _imageViewerMutex.unlock();
+
+        if (busy) {
+            glfwPollEvents();
+        } else {
+            // Sleep until an input, an empty event posted by requestRedraw()
+            // or the timeout which still refreshes the GUI once
+            const double start = glfwGetTime();
+            glfwWaitEventsTimeout(IDLE_TIMEOUT);
+
+            if (glfwGetTime() - start < IDLE_TIMEOUT) {
+                _redrawFrames = REDRAW_FRAMES;
+            }
+        }
+
+        if (_redrawFrames > 0) {
+            _redrawFrames--;
+        }
+
+        _profiling = _showFrameTimings;
+
+        if (_profiling) {
+            _profiler.beginFrame();
+        }
 
         // glViewport(0, 0, _width, _height);
         glClear(GL_COLOR_BUFFER_BIT);
@@ -152,8 +252,17 @@ void App::exec()
         gui();
 
         ImGui::Render();
+
+        if (_profiling) {
+            _profiler.begin(FrameProfiler::STAGE_IMGUI);
+        }
+
         ImGui_ImplOpenGL3_RenderDrawData(ImGui::GetDrawData());
 
+        if (_profiling) {
+            _profiler.end(FrameProfiler::STAGE_IMGUI);
+        }
+
         // Update and Render additional Platform Windows
         // (Platform functions may change the current OpenGL context, so we save/restore it to make it easier to paste this code elsewhere.
         //  For this specific demo app we could also call glfwMakeContextCurrent(window) directly)
@@ -164,6 +273,10 @@ void App::exec()
             glfwMakeContextCurrent(backup_current_context);
         }
 
+        if (_profiling) {
+            _profiler.endFrame();
+        }
+
         glfwSwapBuffers(_window);
     }
 }
@@ -171,6 +284,20 @@ void App::exec()
 
 void App::open(const std::string &path)
 {
+    TRACE_SCOPE("App::open", "load");
+
+    // Pending loads are superseded
+    const uint64_t generation = ++_loadGeneration;
+
+    // Released at the end of the scope, on the main thread
+    std::shared_ptr<ImageViewer> superseded;
+
+    {
+        std::lock_guard<std::mutex> lock(_loadMutex);
+        superseded.swap(_loadedViewer);
+        _loadingPath.clear();
+    }
+
     _imageViewerMutex.lock();
 
     std::string ext = path.substr(path.find_last_of("."));
@@ -180,12 +307,54 @@ void App::open(const std::string &path)
 
     // TODO: cleaner exception handling and support for RGB EXRs
     if (ext == ".exr" || ext == ".EXR") {
-        try {
-            new_image = std::shared_ptr<ImageViewerSpectralEXR>(new ImageViewerSpectralEXR(path));
-        } catch (const SEXR::SpectralImage::Errors& e) {
-            std::cout << "Error while opening \"" << path << "\": It is not a spectral image" << std::endl;
-            new_image = nullptr;
+        const DerivedDataCache cache(
+            _cacheSidecar ? DerivedDataCache::LOCATION_SIDECAR : DerivedDataCache::LOCATION_USER);
+
+        std::shared_ptr<DerivedDataCache::Entry> entry(new DerivedDataCache::Entry);
+
+        bool useCache = _cacheDerivedData;
+        bool cached   = false;
+
+        if (useCache) {
+            try {
+                entry->key = DerivedDataCache::key(path);
+                cached     = cache.load(entry->key, *entry);
+            } catch (const std::exception &e) {
+                std::cout << "[ERROR] " << path << ": " << e.what() << std::endl;
+                useCache = false;
+            }
         }
+
+        if (cached) {
+            new_image = std::shared_ptr<ImageViewerPreview>(new ImageViewerPreview(*entry));
+        }
+
+        {
+            std::lock_guard<std::mutex> lock(_loadMutex);
+            _loadingPath = path;
+        }
+
+        // Finished loaders are released
+        _loaders.erase(
+            std::remove_if(
+                _loaders.begin(),
+                _loaders.end(),
+                [](const std::future<void> &loader) {
+                    return loader.wait_for(std::chrono::seconds(0)) == std::future_status::ready;
+                }),
+            _loaders.end());
+
+        _loaders.push_back(std::async(
+            std::launch::async,
+            &App::loadSpectralImage,
+            this,
+            path,
+            generation,
+            _pcaCompression ? _pcaComponents : 0,
+            cache,
+            cached,
+            useCache && !cached,
+            entry));
     } else if (ext == ".png" || ext == ".PNG") {
         new_image = std::shared_ptr<ImageViewerLDR>(new ImageViewerLDR(path));
     } else {
@@ -198,11 +367,106 @@ void App::open(const std::string &path)
     }
 
     _imageViewerMutex.unlock();
+
+    requestRedraw();
+}
+
+
+void App::loadSpectralImage(
+    const std::string                       &path,
+    uint64_t                                 generation,
+    int                                      pcaComponents,
+    const DerivedDataCache                  &cache,
+    bool                                     cached,
+    bool                                     storeEntry,
+    std::shared_ptr<DerivedDataCache::Entry> entry)
+{
+    std::shared_ptr<ImageViewerSpectralEXR> spectral_image;
+
+    try {
+        TRACE_SCOPE("EXR read & decode", "io");
+
+        spectral_image = std::shared_ptr<ImageViewerSpectralEXR>(new ImageViewerSpectralEXR(path));
+        spectral_image->setPCAComponents(pcaComponents);
+    } catch (const SEXR::SpectralImage::Errors& e) {
+        std::cout << "Error while opening \"" << path << "\": It is not a spectral image" << std::endl;
+    } catch (const std::exception &e) {
+        std::cout << "Error while opening \"" << path << "\": " << e.what() << std::endl;
+    }
+
+    if (spectral_image && cached) {
+        spectral_image->setBandStatistics(entry->statistics);
+    } else if (spectral_image && storeEntry) {
+        // Done here rather than on upload, off the main thread
+        try {
+            spectral_image->makeCacheEntry(*entry);
+            cache.store(*entry);
+        } catch (const std::exception &e) {
+            std::cout << "[ERROR] " << cache.entryPath(entry->key) << ": " << e.what() << std::endl;
+        }
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(_loadMutex);
+
+        if (generation == _loadGeneration) {
+            _loadedViewer = spectral_image;
+            _loadingPath.clear();
+        } else if (spectral_image) {
+            _discardedViewers.push_back(spectral_image);
+        }
+
+        // The last reference, if any, is released on the main thread
+        spectral_image.reset();
+    }
+
+    requestRedraw();
+}
+
+
+void App::adoptLoadedImage()
+{
+    std::shared_ptr<ImageViewer>              loaded;
+    std::vector<std::shared_ptr<ImageViewer>> discarded;
+
+    {
+        std::lock_guard<std::mutex> lock(_loadMutex);
+        loaded.swap(_loadedViewer);
+        discarded.swap(_discardedViewers);
+    }
+
+    // Destroyed here, with the context current
+    discarded.clear();
+
+    if (loaded) {
+        TRACE_SCOPE("App::adoptLoadedImage", "load");
+
+        _imageViewerMutex.lock();
+
+        loaded->initGL();
+
+        // The cached preview of the same image keeps its view
+        if (dynamic_cast<ImageViewerPreview *>(_imageViewer.get())) {
+            loaded->copyView(*_imageViewer);
+        }
+
+        _imageViewer = loaded;
+        _imageViewerMutex.unlock();
+    }
+}
+
+
+void App::requestRedraw()
+{
+    _redrawFrames = REDRAW_FRAMES;
+    glfwPostEmptyEvent();
 }
 
 
 void App::initGL()
 {
+    TRACE_SCOPE("App::initGL", "load");
+
     // Init GLEW
     glewExperimental = GL_TRUE;
     GLenum err_glew  = glewInit();
@@ -216,6 +480,19 @@ void App::initGL()
     glClampColor(GL_CLAMP_VERTEX_COLOR, GL_FALSE);
     glClampColor(GL_CLAMP_FRAGMENT_COLOR, GL_FALSE);
 
+    _profiler.initGL();
+
+    // The image is drawn straight to the default framebuffer, let the
+    // hardware do the sRGB encoding when possible
+    GLint encoding = GL_LINEAR;
+    glGetFramebufferAttachmentParameteriv(
+        GL_DRAW_FRAMEBUFFER,
+        GL_BACK_LEFT,
+        GL_FRAMEBUFFER_ATTACHMENT_COLOR_ENCODING,
+        &encoding);
+
+    _framebufferSRGB = (glGetError() == GL_NO_ERROR && encoding == GL_SRGB);
+
     _imageViewerMutex.lock();
     if (_imageViewer) {
         _imageViewer->initGL();
@@ -250,6 +527,17 @@ void App::menuBar()
             if (ImGui::MenuItem("Open", "Ctrl + O")) {
                 _requestOpen = true;
             }
+            if (ImGui::BeginMenu("Load options")) {
+                ImGui::MenuItem("PCA compression", NULL, &_pcaCompression);
+                if (_pcaCompression) {
+                    ImGui::SliderInt("Components", &_pcaComponents, 1, 32);
+                }
+                ImGui::MenuItem("Cache derived data", NULL, &_cacheDerivedData);
+                if (_cacheDerivedData) {
+                    ImGui::MenuItem("Sidecar files", NULL, &_cacheSidecar);
+                }
+                ImGui::EndMenu();
+            }
             if (ImGui::MenuItem("Exit", "Alt + F4")) {
                 glfwSetWindowShouldClose(_window, true);
             }
@@ -270,6 +558,18 @@ void App::menuBar()
         }
         _imageViewerMutex.unlock();
 
+        if (ImGui::BeginMenu("Performance")) {
+            ImGui::MenuItem("Always redraw", NULL, &_alwaysRedraw);
+            ImGui::MenuItem("Frame timings", NULL, &_showFrameTimings);
+            ImGui::EndMenu();
+        }
+
+        _loadMutex.lock();
+        if (!_loadingPath.empty()) {
+            ImGui::TextDisabled("Loading %s...", _loadingPath.c_str());
+        }
+        _loadMutex.unlock();
+
         ImGui::EndMainMenuBar();
     }
 }
@@ -294,6 +594,8 @@ void App::gui()
     ImGui::Begin("DockSpace", 0, flags);
     ImGui::PopStyleVar();
 
+    adoptLoadedImage();
+
     menuBar();
 
     ImGuiIO& io = ImGui::GetIO();
@@ -316,11 +618,31 @@ void App::gui()
         ImGui::Begin("Image");
         ImVec2 size = ImGui::GetContentRegionAvail();
         _imageViewer->resizeWindow(size.x, size.y);
+        if (_profiling) {
+            _profiler.begin(FrameProfiler::STAGE_SPECTRAL);
+        }
+
         _imageViewer->render();
 
+        if (_profiling) {
+            _profiler.end(FrameProfiler::STAGE_SPECTRAL);
+        }
+
         ImVec2 pos = ImGui::GetCursorScreenPos();
 
-        ImGui::Image((void *)(intptr_t)_imageViewer->getTexture(), size);
+        // The display pass runs when ImGui renders this window, without any
+        // intermediate texture
+        _drawnImageViewer = _imageViewer;
+        _imageRectMin     = pos;
+        _imageRectMax     = ImVec2(pos.x + size.x, pos.y + size.y);
+
+        ImDrawList *drawList = ImGui::GetWindowDrawList();
+        drawList->AddCallback(imgui_draw_image_cb, this);
+        drawList->AddCallback(ImDrawCallback_ResetRenderState, NULL);
+
+        _imageViewer->drawOverlay(drawList, glm::vec2(pos.x, pos.y));
+
+        ImGui::Dummy(size);
 
         if (ImGui::IsItemHovered()) {
             const float rel_pos_x = io.MousePos.x - pos.x;
@@ -344,6 +666,13 @@ void App::gui()
 
     _imageViewerMutex.unlock();
 
+    if (_showFrameTimings) {
+        ImGui::SetNextWindowBgAlpha(0.8f);
+        ImGui::Begin("Frame timings", &_showFrameTimings, ImGuiWindowFlags_AlwaysAutoResize);
+        _profiler.gui();
+        ImGui::End();
+    }
+
     // -------------------------------------------------------------------------
     // Finish
     // -------------------------------------------------------------------------
@@ -422,6 +751,48 @@ void App::resize(int width, int height)
 }
 
 
+void App::drawImage(const ImDrawCmd *cmd)
+{
+    if (!_drawnImageViewer) {
+        return;
+    }
+
+    // Screen coordinates to framebuffer coordinates, origin at the bottom
+    ImDrawData  *drawData = ImGui::GetDrawData();
+    const ImVec2 origin   = drawData->DisplayPos;
+    const ImVec2 scale    = drawData->FramebufferScale;
+    const float  fbHeight = drawData->DisplaySize.y * scale.y;
+
+    auto toFramebuffer = [&](const ImVec2 &min, const ImVec2 &max, GLint *rect) {
+        rect[0] = (GLint)((min.x - origin.x) * scale.x);
+        rect[1] = (GLint)(fbHeight - (max.y - origin.y) * scale.y);
+        rect[2] = (GLint)((max.x - min.x) * scale.x);
+        rect[3] = (GLint)((max.y - min.y) * scale.y);
+    };
+
+    GLint viewport[4], scissor[4];
+    toFramebuffer(_imageRectMin, _imageRectMax, viewport);
+    toFramebuffer(
+        ImVec2(cmd->ClipRect.x, cmd->ClipRect.y),
+        ImVec2(cmd->ClipRect.z, cmd->ClipRect.w),
+        scissor);
+
+    glViewport(viewport[0], viewport[1], viewport[2], viewport[3]);
+    glEnable(GL_SCISSOR_TEST);
+    glScissor(scissor[0], scissor[1], scissor[2], scissor[3]);
+
+    if (_profiling) {
+        _profiler.begin(FrameProfiler::STAGE_DISPLAY);
+    }
+
+    _drawnImageViewer->draw(_framebufferSRGB);
+
+    if (_profiling) {
+        _profiler.end(FrameProfiler::STAGE_DISPLAY);
+    }
+}
+
+
 void App::glfw_error_cb(int error, const char *description)
 {
     std::cerr << "[ERROR] GLFW error: "
@@ -472,3 +843,11 @@ void App::glfw_window_size_cb(GLFWwindow *window, int width, int height)
 
     p->resize(width, height);
 }
+
+
+void App::imgui_draw_image_cb(const ImDrawList *parent_list, const ImDrawCmd *cmd)
+{
+    App *p = (App *)cmd->UserCallbackData;
+
+    p->drawImage(cmd);
+}
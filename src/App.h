@@ -1,13 +1,19 @@
 #pragma once
 
+#include "FrameProfiler.h"
+#include "image_format/DerivedDataCache.h"
 #include "image_viewer/ImageViewer.h"
 
 #include <GLFW/glfw3.h>
 
 #include <imgui_internal.h>
 
+#include <atomic>
+#include <future>
 #include <mutex>
 #include <memory>
+#include <string>
+#include <vector>
 
 class App
 {
@@ -18,8 +24,19 @@ class App
 
     virtual void exec();
 
+    // Spectral images are decoded in the background, their cached preview
+    // if any is displayed meanwhile
     virtual void open(const std::string &path);
 
+    // Wakes the main loop up for a few frames, can be called from any thread
+    void requestRedraw();
+
+    // Frames drawn after an event so ImGui settles (hover, layout changes)
+    static const int REDRAW_FRAMES = 3;
+
+    // Maximum time the main loop sleeps without any event
+    static constexpr double IDLE_TIMEOUT = 0.5;
+
   protected:
     virtual void initGL();
 
@@ -34,6 +51,25 @@ class App
 
     virtual void resize(int width, int height);
 
+    // Runs on a loader thread: decodes the image, reuses or stores the
+    // derived data, then hands the viewer over unless another image was
+    // opened in the meantime
+    void loadSpectralImage(
+        const std::string                       &path,
+        uint64_t                                 generation,
+        int                                      pcaComponents,
+        const DerivedDataCache                  &cache,
+        bool                                     cached,
+        bool                                     storeEntry,
+        std::shared_ptr<DerivedDataCache::Entry> entry);
+
+    // Main thread, which owns the OpenGL context: initializes and displays
+    // the viewer handed over by a loader, destroys the discarded ones
+    void adoptLoadedImage();
+
+    // Display pass of the image viewer, called by ImGui while rendering
+    virtual void drawImage(const ImDrawCmd *cmd);
+
     // GLFW static callbacks
     static void glfw_error_cb(int error, const char *description);
     static void glfw_drop_cb(GLFWwindow *window, int count, const char **paths);
@@ -42,17 +78,52 @@ class App
     static void glfw_key_cb(GLFWwindow *window, int key, int scancode, int action, int mods);
     static void glfw_window_size_cb(GLFWwindow *window, int width, int height);
 
+    static void imgui_draw_image_cb(const ImDrawList *parent_list, const ImDrawCmd *cmd);
+
     GLFWwindow* _window;
     GLFWcursor* _cursorHand;
 
     std::shared_ptr<ImageViewer> _imageViewer;
     std::mutex   _imageViewerMutex;
 
+    // Viewer and screen area of the image in the current ImGui frame, the
+    // viewer is kept alive until drawn even if another image is opened
+    std::shared_ptr<ImageViewer> _drawnImageViewer;
+    ImVec2 _imageRectMin, _imageRectMax;
+
+    // Default framebuffer supports hardware sRGB encoding
+    bool _framebufferSRGB;
+
     bool _leftMouseButtonPressed;
     int _width, _height;
     bool _requestOpen;
     bool _layoutInitialized;
 
+    // Event driven main loop
+    std::atomic<int> _redrawFrames;
+    bool             _alwaysRedraw;
+
+    // Frame timings, only measured while displayed
+    FrameProfiler _profiler;
+    bool          _showFrameTimings;
+    bool          _profiling;
+
+    // Load options
+    bool _pcaCompression;
+    int  _pcaComponents;
+    bool _cacheDerivedData;
+    bool _cacheSidecar;
+
+    // Background loading, only the viewer of the latest open() is kept.
+    // Viewers own GL objects: superseded ones are handed back as well and
+    // destroyed by the main thread, which owns the context.
+    std::vector<std::future<void>>            _loaders;
+    std::atomic<uint64_t>                     _loadGeneration;
+    std::mutex                                _loadMutex;
+    std::shared_ptr<ImageViewer>              _loadedViewer;
+    std::vector<std::shared_ptr<ImageViewer>> _discardedViewers;
+    std::string                               _loadingPath;
+
     ImGuiID _dock_mainCentralId;
     ImGuiID _dock_leftId;
 
@@ -0,0 +1,77 @@
+#pragma once
+
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <mutex>
+#include <utility>
+
+
+// Multi producer, multi consumer FIFO with a fixed capacity: producers wait
+// while it is full, which bounds the work in flight between two stages of a
+// pipeline. Once closed, consumers drain the remaining items then pop()
+// returns false.
+template<typename T>
+class BoundedQueue
+{
+  public:
+    BoundedQueue(size_t capacity)
+        : _capacity(capacity > 0 ? capacity : 1)
+        , _closed(false)
+    {}
+
+    // Returns false, leaving item untouched, when the queue is closed
+    bool push(T &item)
+    {
+        std::unique_lock<std::mutex> lock(_mutex);
+
+        _notFull.wait(lock, [this] { return _closed || _items.size() < _capacity; });
+
+        if (_closed) {
+            return false;
+        }
+
+        _items.push_back(std::move(item));
+        _notEmpty.notify_one();
+
+        return true;
+    }
+
+    // Waits for an item, returns false once closed and empty
+    bool pop(T &item)
+    {
+        std::unique_lock<std::mutex> lock(_mutex);
+
+        _notEmpty.wait(lock, [this] { return _closed || !_items.empty(); });
+
+        if (_items.empty()) {
+            return false;
+        }
+
+        item = std::move(_items.front());
+        _items.pop_front();
+        _notFull.notify_one();
+
+        return true;
+    }
+
+    void close()
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+
+        _closed = true;
+        _notFull.notify_all();
+        _notEmpty.notify_all();
+    }
+
+    size_t capacity() const { return _capacity; }
+
+  private:
+    const size_t _capacity;
+    bool         _closed;
+
+    std::deque<T>           _items;
+    std::mutex              _mutex;
+    std::condition_variable _notFull;
+    std::condition_variable _notEmpty;
+};
@@ -0,0 +1,301 @@
+#include "FrameProfiler.h"
+
+#include <imgui/imgui.h>
+
+#include <nfd.h>
+
+#include <algorithm>
+#include <cctype>
+#include <cfloat>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <stdexcept>
+
+
+FrameProfiler::FrameProfiler(size_t historySize)
+    : _frames(QUERY_FRAMES)
+    , _current(0)
+    , _frameCount(0)
+    , _glInitialized(false)
+    , _samples(std::max(size_t(1), historySize))
+    , _nextSample(0)
+    , _nSamples(0)
+{
+    for (FrameQueries &f : _frames) {
+        f.pending = false;
+    }
+}
+
+
+FrameProfiler::~FrameProfiler()
+{
+    if (_glInitialized) {
+        for (FrameQueries &f : _frames) {
+            glDeleteQueries(2 * N_STAGES, &f.queries[0][0]);
+        }
+    }
+}
+
+
+void FrameProfiler::initGL()
+{
+    for (FrameQueries &f : _frames) {
+        glGenQueries(2 * N_STAGES, &f.queries[0][0]);
+    }
+
+    _glInitialized = true;
+}
+
+
+// ----------------------------------------------------------------------------
+// Measurements
+// ----------------------------------------------------------------------------
+
+void FrameProfiler::beginFrame()
+{
+    _current = _frameCount % QUERY_FRAMES;
+
+    FrameQueries &f = _frames[_current];
+
+    // Issued QUERY_FRAMES frames ago, usually available by now
+    if (f.pending) {
+        collect(f);
+    }
+
+    f.frame      = _frameCount;
+    f.pending    = false;
+    f.frameCpuMs = 0.;
+
+    for (size_t s = 0; s < N_STAGES; s++) {
+        f.used[s]  = false;
+        f.cpuMs[s] = 0.;
+    }
+
+    _frameStart = Clock::now();
+}
+
+
+void FrameProfiler::endFrame()
+{
+    FrameQueries &f = _frames[_current];
+
+    f.frameCpuMs = std::chrono::duration<double, std::milli>(Clock::now() - _frameStart).count();
+    f.pending    = true;
+
+    _frameCount++;
+}
+
+
+void FrameProfiler::begin(Stage stage)
+{
+    FrameQueries &f = _frames[_current];
+
+    if (_glInitialized) {
+        glQueryCounter(f.queries[stage][0], GL_TIMESTAMP);
+    }
+
+    f.used[stage]      = true;
+    _stageStart[stage] = Clock::now();
+}
+
+
+void FrameProfiler::end(Stage stage)
+{
+    FrameQueries &f = _frames[_current];
+
+    if (_glInitialized) {
+        glQueryCounter(f.queries[stage][1], GL_TIMESTAMP);
+    }
+
+    f.cpuMs[stage] += std::chrono::duration<double, std::milli>(Clock::now() - _stageStart[stage]).count();
+}
+
+
+void FrameProfiler::collect(FrameQueries &f)
+{
+    Sample sample;
+    sample.frame      = f.frame;
+    sample.frameCpuMs = f.frameCpuMs;
+
+    for (size_t s = 0; s < N_STAGES; s++) {
+        sample.cpuMs[s] = f.used[s] ? f.cpuMs[s] : 0.;
+        sample.gpuMs[s] = -1.;
+
+        if (!f.used[s] || !_glInitialized) {
+            continue;
+        }
+
+        // Never wait for a result, the sample is dropped instead
+        GLint available = GL_FALSE;
+        glGetQueryObjectiv(f.queries[s][1], GL_QUERY_RESULT_AVAILABLE, &available);
+
+        if (available) {
+            GLuint64 t0, t1;
+            glGetQueryObjectui64v(f.queries[s][0], GL_QUERY_RESULT, &t0);
+            glGetQueryObjectui64v(f.queries[s][1], GL_QUERY_RESULT, &t1);
+
+            sample.gpuMs[s] = double(t1 - t0) * 1e-6;
+        }
+    }
+
+    // The display pass is issued from within the ImGui rendering
+    if (f.used[STAGE_IMGUI] && f.used[STAGE_DISPLAY]) {
+        sample.cpuMs[STAGE_IMGUI] -= sample.cpuMs[STAGE_DISPLAY];
+
+        if (sample.gpuMs[STAGE_IMGUI] >= 0. && sample.gpuMs[STAGE_DISPLAY] >= 0.) {
+            sample.gpuMs[STAGE_IMGUI] -= sample.gpuMs[STAGE_DISPLAY];
+        }
+    }
+
+    _samples[_nextSample] = sample;
+    _nextSample           = (_nextSample + 1) % _samples.size();
+    _nSamples             = std::min(_nSamples + 1, _samples.size());
+
+    f.pending = false;
+}
+
+
+std::vector<FrameProfiler::Sample> FrameProfiler::history() const
+{
+    std::vector<Sample> samples(_nSamples);
+
+    const size_t first = (_nextSample + _samples.size() - _nSamples) % _samples.size();
+
+    for (size_t i = 0; i < _nSamples; i++) {
+        samples[i] = _samples[(first + i) % _samples.size()];
+    }
+
+    return samples;
+}
+
+
+const char *FrameProfiler::stageName(Stage stage)
+{
+    switch (stage) {
+        case STAGE_SPECTRAL:
+            return "Spectral";
+        case STAGE_DISPLAY:
+            return "Display";
+        case STAGE_IMGUI:
+            return "ImGui";
+        default:
+            return "";
+    }
+}
+
+
+// ----------------------------------------------------------------------------
+// GUI & export
+// ----------------------------------------------------------------------------
+
+void FrameProfiler::gui()
+{
+    const std::vector<Sample> samples = history();
+
+    if (samples.empty()) {
+        ImGui::Text("No sample yet");
+        return;
+    }
+
+    // Rolling window displayed, unmeasured GPU times are negative and left
+    // out of the averages
+    const size_t nPlotted = std::min(samples.size(), size_t(240));
+    const size_t first    = samples.size() - nPlotted;
+
+    std::vector<float> values(nPlotted);
+    char               overlay[64];
+
+    auto plot = [&](const char *label, const std::vector<float> &v) {
+        double sum = 0.;
+        size_t n   = 0;
+
+        for (float x : v) {
+            if (x >= 0.f) {
+                sum += x;
+                n++;
+            }
+        }
+
+        snprintf(overlay, sizeof(overlay), "avg. %.3f ms", n > 0 ? sum / n : 0.);
+        ImGui::PlotHistogram(label, v.data(), v.size(), 0, overlay, 0.f, FLT_MAX, ImVec2(0, 40));
+    };
+
+    for (size_t i = 0; i < nPlotted; i++) {
+        values[i] = samples[first + i].frameCpuMs;
+    }
+
+    plot("Frame CPU", values);
+
+    for (size_t s = 0; s < N_STAGES; s++) {
+        const std::string name = stageName((Stage)s);
+
+        for (size_t i = 0; i < nPlotted; i++) {
+            values[i] = samples[first + i].cpuMs[s];
+        }
+
+        plot((name + " CPU").c_str(), values);
+
+        for (size_t i = 0; i < nPlotted; i++) {
+            values[i] = (float)samples[first + i].gpuMs[s];
+        }
+
+        plot((name + " GPU").c_str(), values);
+    }
+
+    if (ImGui::Button("Export CSV")) {
+        nfdchar_t  *outPath = NULL;
+        nfdresult_t result  = NFD_SaveDialog("csv", NULL, &outPath);
+
+        if (result == NFD_OKAY) {
+            try {
+                exportCSV(outPath);
+                _exportError.clear();
+            } catch (const std::exception &e) {
+                _exportError = e.what();
+            }
+
+            free(outPath);
+        }
+    }
+
+    if (!_exportError.empty()) {
+        ImGui::TextColored(ImVec4(1.f, 0.3f, 0.3f, 1.f), "%s", _exportError.c_str());
+    }
+}
+
+
+void FrameProfiler::exportCSV(const std::string &path) const
+{
+    std::ofstream file(path);
+
+    if (!file) {
+        throw std::runtime_error("Could not open \"" + path + "\" for writing");
+    }
+
+    file << "frame,frame_cpu_ms";
+
+    for (size_t s = 0; s < N_STAGES; s++) {
+        std::string name = stageName((Stage)s);
+        std::transform(name.begin(), name.end(), name.begin(), ::tolower);
+
+        file << "," << name << "_cpu_ms," << name << "_gpu_ms";
+    }
+
+    file << "\n";
+
+    // Unmeasured GPU times are left empty
+    for (const Sample &sample : history()) {
+        file << sample.frame << "," << sample.frameCpuMs;
+
+        for (size_t s = 0; s < N_STAGES; s++) {
+            file << "," << sample.cpuMs[s] << ",";
+
+            if (sample.gpuMs[s] >= 0.) {
+                file << sample.gpuMs[s];
+            }
+        }
+
+        file << "\n";
+    }
+}
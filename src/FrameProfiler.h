@@ -0,0 +1,87 @@
+#pragma once
+
+#include <GL/glew.h>
+
+#include <chrono>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+
+// CPU and GPU timings of the stages of a frame. GPU times are measured with
+// timestamp queries: the display pass runs inside the ImGui rendering and
+// GL_TIME_ELAPSED queries cannot be nested. Queries are buffered over
+// QUERY_FRAMES frames so reading the results never stalls the pipeline.
+class FrameProfiler
+{
+  public:
+    enum Stage
+    {
+        STAGE_SPECTRAL,   // Offscreen passes of the viewer
+        STAGE_DISPLAY,    // Display pass of the viewer
+        STAGE_IMGUI,      // ImGui rendering, excluding the display pass
+        N_STAGES
+    };
+
+    struct Sample {
+        uint64_t frame;
+        double   frameCpuMs;
+        double   cpuMs[N_STAGES];
+        double   gpuMs[N_STAGES];   // Negative when not measured
+    };
+
+    FrameProfiler(size_t historySize = 1000);
+
+    ~FrameProfiler();
+
+    void initGL();
+
+    // Must bracket the CPU work of a frame, before swapping the buffers
+    void beginFrame();
+    void endFrame();
+
+    void begin(Stage stage);
+    void end(Stage stage);
+
+    // Samples of the last frames whose GPU results are available, oldest
+    // first
+    std::vector<Sample> history() const;
+
+    void gui();
+
+    // One line per frame, times in milliseconds
+    void exportCSV(const std::string &path) const;
+
+    static const char *stageName(Stage stage);
+
+    static const size_t QUERY_FRAMES = 2;
+
+  private:
+    typedef std::chrono::steady_clock Clock;
+
+    struct FrameQueries {
+        uint64_t frame;
+        bool     pending;
+        bool     used[N_STAGES];
+        double   cpuMs[N_STAGES];
+        double   frameCpuMs;
+        GLuint   queries[N_STAGES][2];   // Begin and end timestamps
+    };
+
+    void collect(FrameQueries &frame);
+
+    std::vector<FrameQueries> _frames;
+    size_t                    _current;
+    uint64_t                  _frameCount;
+    bool                      _glInitialized;
+
+    Clock::time_point _frameStart;
+    Clock::time_point _stageStart[N_STAGES];
+
+    // Ring buffer of the collected samples
+    std::vector<Sample> _samples;
+    size_t              _nextSample;
+    size_t              _nSamples;
+
+    std::string _exportError;
+};
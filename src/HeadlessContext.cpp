@@ -0,0 +1,141 @@
+#include "HeadlessContext.h"
+
+#include <GL/glew.h>
+
+#include <EGL/eglext.h>
+
+#include <cstring>
+#include <stdexcept>
+
+
+HeadlessContext::HeadlessContext()
+    : _display(EGL_NO_DISPLAY)
+    , _context(EGL_NO_CONTEXT)
+{
+    // ------------------------------------------------------------------------
+    // Display
+    // ------------------------------------------------------------------------
+
+    const char *clientExtensions = eglQueryString(EGL_NO_DISPLAY, EGL_EXTENSIONS);
+
+    // The surfaceless platform needs neither X11 nor a DRM device
+    if (clientExtensions != NULL
+        && std::strstr(clientExtensions, "EGL_MESA_platform_surfaceless") != NULL) {
+        PFNEGLGETPLATFORMDISPLAYEXTPROC getPlatformDisplay
+            = (PFNEGLGETPLATFORMDISPLAYEXTPROC)eglGetProcAddress("eglGetPlatformDisplayEXT");
+
+        if (getPlatformDisplay) {
+            _display = getPlatformDisplay(EGL_PLATFORM_SURFACELESS_MESA, EGL_DEFAULT_DISPLAY, NULL);
+        }
+    }
+
+    if (_display == EGL_NO_DISPLAY) {
+        _display = eglGetDisplay(EGL_DEFAULT_DISPLAY);
+    }
+
+    if (_display == EGL_NO_DISPLAY || !eglInitialize(_display, NULL, NULL)) {
+        throw std::runtime_error("Could not initialize an EGL display");
+    }
+
+    if (!eglBindAPI(EGL_OPENGL_API)) {
+        eglTerminate(_display);
+        throw std::runtime_error("EGL does not support desktop OpenGL");
+    }
+
+    // ------------------------------------------------------------------------
+    // Context
+    // ------------------------------------------------------------------------
+
+    // Only used for the context creation, nothing is drawn to a surface
+    const EGLint configAttribs[] = {
+        EGL_RENDERABLE_TYPE, EGL_OPENGL_BIT,
+        EGL_SURFACE_TYPE, EGL_PBUFFER_BIT,
+        EGL_RED_SIZE, 8,
+        EGL_GREEN_SIZE, 8,
+        EGL_BLUE_SIZE, 8,
+        EGL_NONE
+    };
+
+    EGLConfig config;
+    EGLint    nConfigs = 0;
+
+    if (!eglChooseConfig(_display, configAttribs, &config, 1, &nConfigs) || nConfigs == 0) {
+        eglTerminate(_display);
+        throw std::runtime_error("No EGL configuration supports OpenGL");
+    }
+
+    // Same versions as the windowed application
+    const int glVersions[2][2] = {{4, 3}, {3, 3}};
+
+    for (size_t i = 0; i < 2 && _context == EGL_NO_CONTEXT; i++) {
+        const EGLint contextAttribs[] = {
+            EGL_CONTEXT_MAJOR_VERSION, glVersions[i][0],
+            EGL_CONTEXT_MINOR_VERSION, glVersions[i][1],
+            EGL_CONTEXT_OPENGL_PROFILE_MASK, EGL_CONTEXT_OPENGL_CORE_PROFILE_BIT,
+            EGL_NONE
+        };
+
+        _context = eglCreateContext(_display, config, EGL_NO_CONTEXT, contextAttribs);
+    }
+
+    if (_context == EGL_NO_CONTEXT) {
+        eglTerminate(_display);
+        throw std::runtime_error("Could not create an OpenGL 3.3 context");
+    }
+
+    makeCurrent();
+
+    // ------------------------------------------------------------------------
+    // OpenGL functions
+    // ------------------------------------------------------------------------
+
+    // GLEW built for GLX reports the missing X display once the core
+    // functions are loaded, they are usable with the EGL context
+    glewExperimental = GL_TRUE;
+    GLenum err_glew  = glewInit();
+
+    if (err_glew != GLEW_OK
+#ifdef GLEW_ERROR_NO_GLX_DISPLAY
+        && err_glew != GLEW_ERROR_NO_GLX_DISPLAY
+#endif
+    ) {
+        throw std::runtime_error(std::string("Could not load OpenGL: ") + (const char *)glewGetErrorString(err_glew));
+    }
+
+    // glewInit may leave an error behind in core profiles
+    glGetError();
+
+    // We do not want any clamping, as in the windowed application
+    glClampColor(GL_CLAMP_READ_COLOR, GL_FALSE);
+    glClampColor(GL_CLAMP_VERTEX_COLOR, GL_FALSE);
+    glClampColor(GL_CLAMP_FRAGMENT_COLOR, GL_FALSE);
+}
+
+
+HeadlessContext::~HeadlessContext()
+{
+    eglMakeCurrent(_display, EGL_NO_SURFACE, EGL_NO_SURFACE, EGL_NO_CONTEXT);
+    eglDestroyContext(_display, _context);
+    eglTerminate(_display);
+}
+
+
+void HeadlessContext::makeCurrent()
+{
+    // Surfaceless: needs EGL_KHR_surfaceless_context, provided by Mesa
+    if (!eglMakeCurrent(_display, EGL_NO_SURFACE, EGL_NO_SURFACE, _context)) {
+        throw std::runtime_error("Could not make the EGL context current");
+    }
+}
+
+
+std::string HeadlessContext::renderer() const
+{
+    return (const char *)glGetString(GL_RENDERER);
+}
+
+
+std::string HeadlessContext::version() const
+{
+    return (const char *)glGetString(GL_VERSION);
+}
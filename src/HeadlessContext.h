@@ -0,0 +1,33 @@
+#pragma once
+
+#include <EGL/egl.h>
+
+#include <string>
+
+
+// OpenGL context without any window nor display server, created through EGL
+// on the Mesa surfaceless platform (llvmpipe on render nodes without a GPU)
+// or on the default EGL display otherwise. There is no default framebuffer:
+// rendering goes to FBOs, see HeadlessRenderer.
+class HeadlessContext
+{
+  public:
+    // Creates an OpenGL 4.3 core context, or 3.3 without compute shaders,
+    // makes it current and loads the OpenGL functions
+    HeadlessContext();
+
+    ~HeadlessContext();
+
+    HeadlessContext(const HeadlessContext &)            = delete;
+    HeadlessContext &operator=(const HeadlessContext &) = delete;
+
+    void makeCurrent();
+
+    // GL_RENDERER and GL_VERSION strings, e.g. to identify llvmpipe runs
+    std::string renderer() const;
+    std::string version() const;
+
+  private:
+    EGLDisplay _display;
+    EGLContext _context;
+};
@@ -0,0 +1,119 @@
+#include "HeadlessRenderer.h"
+
+#include <lodepng.h>
+
+#include <cstring>
+#include <stdexcept>
+
+#include "Trace.h"
+
+
+HeadlessRenderer::HeadlessRenderer(unsigned int width, unsigned int height)
+    : _width(width)
+    , _height(height)
+    , _fbo(0)
+    , _texture(0)
+{
+    if (width == 0 || height == 0) {
+        throw std::runtime_error("Invalid output size");
+    }
+
+    glGenTextures(1, &_texture);
+    glBindTexture(GL_TEXTURE_2D, _texture);
+
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+
+    // The display pass does the sRGB encoding itself on linear targets
+    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, _width, _height, 0, GL_RGBA, GL_UNSIGNED_BYTE, NULL);
+
+    glGenFramebuffers(1, &_fbo);
+    glBindFramebuffer(GL_FRAMEBUFFER, _fbo);
+    glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, _texture, 0);
+
+    const GLenum status = glCheckFramebufferStatus(GL_FRAMEBUFFER);
+
+    glBindFramebuffer(GL_FRAMEBUFFER, 0);
+    glBindTexture(GL_TEXTURE_2D, 0);
+
+    if (status != GL_FRAMEBUFFER_COMPLETE) {
+        glDeleteFramebuffers(1, &_fbo);
+        glDeleteTextures(1, &_texture);
+        throw std::runtime_error("Could not create the offscreen framebuffer");
+    }
+}
+
+
+HeadlessRenderer::~HeadlessRenderer()
+{
+    glDeleteFramebuffers(1, &_fbo);
+    glDeleteTextures(1, &_texture);
+}
+
+
+void HeadlessRenderer::render(ImageViewer &viewer)
+{
+    TRACE_SCOPE("HeadlessRenderer::render", "render");
+
+    viewer.resizeWindow(_width, _height);
+
+    // Progressive conversions are driven to completion, one step per
+    // frame in the windowed application. Readbacks are not waited for: some
+    // only complete with the GUI (see ImageViewer::needsRedraw)
+    do {
+        viewer.render();
+    } while (viewer.isConverting());
+
+    glBindFramebuffer(GL_FRAMEBUFFER, _fbo);
+    glViewport(0, 0, _width, _height);
+    glDisable(GL_SCISSOR_TEST);
+
+    glClearColor(0.f, 0.f, 0.f, 0.f);
+    glClear(GL_COLOR_BUFFER_BIT);
+
+    viewer.draw(false);
+
+    glBindFramebuffer(GL_FRAMEBUFFER, 0);
+}
+
+
+void HeadlessRenderer::readPixels(std::vector<unsigned char> &rgba) const
+{
+    TRACE_SCOPE("HeadlessRenderer::readPixels", "readback");
+
+    const size_t rowSize = 4 * (size_t)_width;
+
+    rgba.resize(rowSize * _height);
+
+    glBindFramebuffer(GL_READ_FRAMEBUFFER, _fbo);
+    glPixelStorei(GL_PACK_ALIGNMENT, 1);
+    glReadPixels(0, 0, _width, _height, GL_RGBA, GL_UNSIGNED_BYTE, rgba.data());
+    glBindFramebuffer(GL_READ_FRAMEBUFFER, 0);
+
+    // OpenGL rows start at the bottom
+    std::vector<unsigned char> row(rowSize);
+
+    for (size_t y = 0; y < _height / 2; y++) {
+        unsigned char *top    = &rgba[y * rowSize];
+        unsigned char *bottom = &rgba[(_height - 1 - y) * rowSize];
+
+        std::memcpy(row.data(), top, rowSize);
+        std::memcpy(top, bottom, rowSize);
+        std::memcpy(bottom, row.data(), rowSize);
+    }
+}
+
+
+void HeadlessRenderer::writePNG(const std::string &path) const
+{
+    std::vector<unsigned char> rgba;
+    readPixels(rgba);
+
+    TRACE_SCOPE("PNG encode & write", "io");
+
+    const unsigned error = lodepng::encode(path, rgba, _width, _height);
+
+    if (error) {
+        throw std::runtime_error(lodepng_error_text(error));
+    }
+}
@@ -0,0 +1,41 @@
+#pragma once
+
+#include "image_viewer/ImageViewer.h"
+
+#include <GL/glew.h>
+
+#include <string>
+#include <vector>
+
+
+// Renders an image viewer to an offscreen framebuffer of a fixed size, as
+// the application would display it in a window of that size. Needs a
+// current OpenGL context, typically a HeadlessContext.
+class HeadlessRenderer
+{
+  public:
+    HeadlessRenderer(unsigned int width, unsigned int height);
+
+    ~HeadlessRenderer();
+
+    HeadlessRenderer(const HeadlessRenderer &)            = delete;
+    HeadlessRenderer &operator=(const HeadlessRenderer &) = delete;
+
+    // Runs the offscreen passes until the conversion is complete, then the
+    // display pass. The viewer must be initialized (initGL).
+    void render(ImageViewer &viewer);
+
+    // Display referred RGBA, 8 bits per channel, top row first
+    void readPixels(std::vector<unsigned char> &rgba) const;
+
+    void writePNG(const std::string &path) const;
+
+    unsigned int width() const { return _width; }
+    unsigned int height() const { return _height; }
+
+  private:
+    unsigned int _width, _height;
+
+    GLuint _fbo;
+    GLuint _texture;
+};
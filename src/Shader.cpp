@@ -1,5 +1,7 @@
 #include "Shader.h"
 
+#include "Trace.h"
+
 #include <vector>
 #include <exception>
 #include <sstream>
@@ -9,7 +11,10 @@
 Shader::Shader(
     const std::string &pathVertexShader,
     const std::string &pathFragmentShader)
+    : _computeShader(0)
 {
+    TRACE_SCOPE("Shader::Shader", "shader");
+
     GLint status;
 
     std::vector<char> vert_src;
@@ -68,10 +73,66 @@ Shader::Shader(
     glLinkProgram(_shaderProgram);
 }
 
+
+Shader::Shader(const std::string &pathComputeShader)
+    : _vertexShader(0)
+    , _fragmentShader(0)
+{
+    TRACE_SCOPE("Shader::Shader (compute)", "shader");
+
+    GLint status;
+
+    std::vector<char> comp_src;
+
+    // Compute shader
+    loadShaderSrc(pathComputeShader, comp_src);
+
+    GLchar *compute_sources[1] = {comp_src.data()};
+
+    _computeShader = glCreateShader(GL_COMPUTE_SHADER);
+
+    glShaderSource(_computeShader, 1, compute_sources, NULL);
+    glCompileShader(_computeShader);
+    glGetShaderiv(_computeShader, GL_COMPILE_STATUS, &status);
+
+    if (status != GL_TRUE) {
+        char log_buffer[512] = {0};
+        glGetShaderInfoLog(_computeShader, 512, NULL, log_buffer);
+
+        std::stringstream ss;
+        ss << "GLSL compute shader " << pathComputeShader
+           << " compilation failed:" << std::endl
+           << log_buffer << std::endl;
+
+        throw std::runtime_error(ss.str());
+    }
+
+    // Link shader
+    _shaderProgram = glCreateProgram();
+    glAttachShader(_shaderProgram, _computeShader);
+
+    glLinkProgram(_shaderProgram);
+    glGetProgramiv(_shaderProgram, GL_LINK_STATUS, &status);
+
+    if (status != GL_TRUE) {
+        char log_buffer[512] = {0};
+        glGetProgramInfoLog(_shaderProgram, 512, NULL, log_buffer);
+
+        std::stringstream ss;
+        ss << "GLSL compute program " << pathComputeShader
+           << " link failed:" << std::endl
+           << log_buffer << std::endl;
+
+        throw std::runtime_error(ss.str());
+    }
+}
+
+
 Shader::~Shader()
 {
-    glDeleteShader(_shaderProgram);
+    glDeleteProgram(_shaderProgram);
 
-    glDeleteProgram(_vertexShader);
-    glDeleteProgram(_fragmentShader);
+    glDeleteShader(_vertexShader);
+    glDeleteShader(_fragmentShader);
+    glDeleteShader(_computeShader);
 }
@@ -13,6 +13,9 @@ class Shader
         const std::string &pathVertexShader,
         const std::string &pathFragmentShader);
 
+    // Compute shader program, requires OpenGL 4.3
+    Shader(const std::string &pathComputeShader);
+
     virtual ~Shader();
 
     GLuint get() const { return _shaderProgram; };
@@ -36,5 +39,6 @@ class Shader
 
   protected:
     GLuint _vertexShader, _fragmentShader;
+    GLuint _computeShader;
     GLuint _shaderProgram;
 };
\ No newline at end of file
@@ -0,0 +1,143 @@
+#include "Trace.h"
+
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <mutex>
+#include <stdexcept>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+
+std::atomic<bool> Trace::_enabled(false);
+
+namespace
+{
+struct Event {
+    const char              *name;
+    const char              *category;
+    Trace::Clock::time_point begin;
+    Trace::Clock::time_point end;
+    size_t                   thread;
+};
+
+struct TraceState {
+    std::mutex mutex;
+
+    std::string              path;
+    Trace::Clock::time_point origin;
+    std::vector<Event>       events;
+    bool                     full;
+
+    // Small and stable thread ids for the viewer
+    std::unordered_map<std::thread::id, size_t> threads;
+};
+
+TraceState &state()
+{
+    static TraceState s;
+    return s;
+}
+
+void writeEscaped(std::ostream &os, const char *str)
+{
+    for (const char *c = str; *c != '\0'; c++) {
+        if (*c == '"' || *c == '\\') {
+            os << '\\';
+        }
+
+        os << *c;
+    }
+}
+}   // namespace
+
+
+void Trace::start(const std::string &path)
+{
+    TraceState &s = state();
+
+    std::lock_guard<std::mutex> lock(s.mutex);
+
+    s.path   = path;
+    s.origin = Clock::now();
+    s.events.clear();
+    s.threads.clear();
+    s.full = false;
+
+    _enabled = true;
+}
+
+
+void Trace::stop()
+{
+    if (!_enabled.exchange(false)) {
+        return;
+    }
+
+    TraceState &s = state();
+
+    std::lock_guard<std::mutex> lock(s.mutex);
+
+    std::ofstream file(s.path);
+
+    if (!file) {
+        throw std::runtime_error("Could not open \"" + s.path + "\" for writing");
+    }
+
+    // Microseconds with nanosecond digits, whatever the session length
+    file << std::fixed << std::setprecision(3);
+
+    file << "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[";
+
+    for (size_t i = 0; i < s.events.size(); i++) {
+        const Event &e = s.events[i];
+
+        // Complete events, timestamps in microseconds
+        const double ts  = std::chrono::duration<double, std::micro>(e.begin - s.origin).count();
+        const double dur = std::chrono::duration<double, std::micro>(e.end - e.begin).count();
+
+        file << (i > 0 ? ",\n" : "\n") << "{\"name\":\"";
+        writeEscaped(file, e.name);
+        file << "\",\"cat\":\"";
+        writeEscaped(file, e.category);
+        file << "\",\"ph\":\"X\",\"ts\":" << ts
+             << ",\"dur\":" << dur
+             << ",\"pid\":1,\"tid\":" << e.thread << "}";
+    }
+
+    file << "\n]}\n";
+
+    s.events.clear();
+}
+
+
+void Trace::record(
+    const char       *name,
+    const char       *category,
+    Clock::time_point begin,
+    Clock::time_point end)
+{
+    TraceState &s = state();
+
+    std::lock_guard<std::mutex> lock(s.mutex);
+
+    if (!_enabled || s.full) {
+        return;
+    }
+
+    if (s.events.size() >= MAX_EVENTS) {
+        std::cerr << "Trace: " << MAX_EVENTS << " events recorded, the following ones are dropped" << std::endl;
+
+        s.full = true;
+        return;
+    }
+
+    auto it = s.threads.find(std::this_thread::get_id());
+
+    if (it == s.threads.end()) {
+        it = s.threads.emplace(std::this_thread::get_id(), s.threads.size()).first;
+    }
+
+    s.events.push_back({name, category, begin, end, it->second});
+}
@@ -0,0 +1,83 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <string>
+
+
+// Scoped timings written as Chrome trace events (chrome://tracing, Perfetto).
+// Recording is enabled at runtime with start(). Without TIRESIAS_TRACING,
+// TRACE_SCOPE expands to nothing and no instrumentation is compiled.
+//
+//   void load()
+//   {
+//       TRACE_SCOPE("Load", "io");
+//       ...
+//   }
+//
+// Names and categories must be string literals: only pointers are kept.
+class Trace
+{
+  public:
+    typedef std::chrono::steady_clock Clock;
+
+    // Starts recording, the events are written to path by stop()
+    static void start(const std::string &path);
+
+    // Writes the recorded events, throws on I/O errors
+    static void stop();
+
+    static bool isEnabled() { return _enabled.load(std::memory_order_relaxed); }
+
+    // Events kept in memory until stop(), about 40 bytes each. The following
+    // ones are dropped with a warning, the trace ending early.
+    static const size_t MAX_EVENTS = size_t(1) << 22;
+
+    static void record(
+        const char       *name,
+        const char       *category,
+        Clock::time_point begin,
+        Clock::time_point end);
+
+    class Scope
+    {
+      public:
+        Scope(const char *name, const char *category)
+            : _name(name)
+            , _category(category)
+            , _active(Trace::isEnabled())
+        {
+            if (_active) {
+                _begin = Clock::now();
+            }
+        }
+
+        ~Scope()
+        {
+            if (_active) {
+                Trace::record(_name, _category, _begin, Clock::now());
+            }
+        }
+
+        Scope(const Scope &)            = delete;
+        Scope &operator=(const Scope &) = delete;
+
+      private:
+        const char       *_name;
+        const char       *_category;
+        bool              _active;
+        Clock::time_point _begin;
+    };
+
+  private:
+    static std::atomic<bool> _enabled;
+};
+
+
+#ifdef TIRESIAS_TRACING
+#    define TRACE_CONCAT_(a, b)         a##b
+#    define TRACE_CONCAT(a, b)          TRACE_CONCAT_(a, b)
+#    define TRACE_SCOPE(name, category) Trace::Scope TRACE_CONCAT(traceScope_, __LINE__)(name, category)
+#else
+#    define TRACE_SCOPE(name, category)
+#endif
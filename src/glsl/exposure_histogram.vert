@@ -0,0 +1,41 @@
+#version 330 core
+
+// One point per sampled pixel of the region, scattered in the bin of its
+// log2 luminance. Pixels are sampled on a regular grid, as for the scopes,
+// so small highlights are not averaged away.
+
+// Linear RGB image
+uniform sampler2D image;
+
+// x, y, width, height in texels
+uniform ivec4 region;
+
+// Sampling step in texels and size of the sampled grid
+uniform int   stride;
+uniform ivec2 sampledSize;
+
+uniform vec2 log2Range;
+uniform int  nBins;
+
+flat out vec4 count;
+
+void main()
+{
+    ivec2 pxCoords = region.xy + ivec2(gl_VertexID % sampledSize.x, gl_VertexID / sampledSize.x) * stride;
+
+    vec3  rgb       = texelFetch(image, pxCoords, 0).rgb;
+    float luminance = dot(rgb, vec3(0.2126, 0.7152, 0.0722));
+
+    // Non positive and non finite values are left out, as for the average
+    if (!(luminance > 0.) || isinf(luminance)) {
+        gl_Position = vec4(2., 2., 0., 1.);
+        count       = vec4(0.);
+        return;
+    }
+
+    float t   = (log2(luminance) - log2Range.x) / (log2Range.y - log2Range.x);
+    float bin = clamp(floor(t * float(nBins)), 0., float(nBins - 1));
+
+    gl_Position = vec4(2. * (bin + 0.5) / float(nBins) - 1., 0., 0., 1.);
+    count       = vec4(1., 0., 0., 0.);
+}
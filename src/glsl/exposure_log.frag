@@ -0,0 +1,43 @@
+#version 330 core
+
+// Resamples the log2 luminance of a region of a linear RGB image to the
+// reduction texture. Red holds the sum of log2 of the valid taps and green
+// their number, both divided by the number of taps: once averaged down the
+// mip chain, red / green is the log-average of the region.
+
+layout(location = 0) out vec2 outValue;
+
+uniform sampler2D image;
+
+// x, y, width, height in texels
+uniform ivec4 region;
+uniform int   reductionSize;
+
+const int TAPS = 4;
+
+void main()
+{
+    ivec2 texel     = ivec2(gl_FragCoord.xy);
+    vec2  footprint = vec2(region.zw) / float(reductionSize);
+
+    float sum    = 0.;
+    float nValid = 0.;
+
+    for (int j = 0; j < TAPS; j++) {
+        for (int i = 0; i < TAPS; i++) {
+            vec2  pos      = vec2(region.xy) + (vec2(texel) + (vec2(i, j) + 0.5) / float(TAPS)) * footprint;
+            ivec2 pxCoords = clamp(ivec2(pos), region.xy, region.xy + region.zw - 1);
+
+            vec3  rgb       = texelFetch(image, pxCoords, 0).rgb;
+            float luminance = dot(rgb, vec3(0.2126, 0.7152, 0.0722));
+
+            // Non positive and non finite values are left out
+            if (luminance > 0. && !isinf(luminance)) {
+                sum += log2(luminance);
+                nValid += 1.;
+            }
+        }
+    }
+
+    outValue = vec2(sum, nValid) / float(TAPS * TAPS);
+}
\ No newline at end of file
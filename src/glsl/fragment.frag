@@ -10,6 +10,23 @@ uniform float exposure;
 uniform bool sRGBGamma;
 uniform vec3 gamma;
 
+// sRGB framebuffer: the encoding is done when writing the output
+uniform bool hardwareSRGB;
+
+// False color: the red channel is mapped through the colormap, a change of
+// range does not require a new conversion
+uniform bool falseColor;
+uniform sampler1D colormap;
+uniform vec2 falseColorRange;
+
+vec3 applyColormap(in float value)
+{
+    float t = clamp((value - falseColorRange.x) / (falseColorRange.y - falseColorRange.x), 0., 1.);
+    float n = float(textureSize(colormap, 0));
+
+    return texture(colormap, (t * (n - 1.) + 0.5) / n).rgb;
+}
+
 float to_sRGB_c(in float c) {
     if (abs(c) < 0.0031308) {
         return c*12.92;
@@ -26,10 +43,17 @@ void main()
 {
     outColor = texture(rgbImage, uv);
 
-    outColor.rgb *= pow(2.f, exposure);
+    // The colormap holds display colors: the exposure only scales radiance
+    if (falseColor) {
+        outColor.rgb = applyColormap(outColor.r);
+    } else {
+        outColor.rgb *= pow(2.f, exposure);
+    }
 
     if (sRGBGamma) {
-        outColor.rgb = to_sRGB(outColor.rgb);
+        if (!hardwareSRGB) {
+            outColor.rgb = to_sRGB(outColor.rgb);
+        }
     } else {
         outColor.rgb = pow(outColor.rgb, 1.f/gamma);
     }
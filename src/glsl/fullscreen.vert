@@ -0,0 +1,10 @@
+#version 330 core
+
+// Triangle covering the viewport, without any vertex attribute
+
+void main()
+{
+    vec2 corner = vec2(float((gl_VertexID << 1) & 2), float(gl_VertexID & 2));
+
+    gl_Position = vec4(2. * corner - 1., 0., 1.);
+}
\ No newline at end of file
@@ -0,0 +1,11 @@
+#version 330 core
+
+layout(location = 0) out vec4 outColor;
+
+flat in vec4 count;
+
+void main()
+{
+    // Accumulated by additive blending
+    outColor = count;
+}
\ No newline at end of file
@@ -0,0 +1,58 @@
+#version 330 core
+
+// One point per sample and per channel, no vertex attribute: the sample is
+// found from the vertex index and its value scattered in its bin
+
+// Linear RGB image
+uniform sampler2D image;
+
+// Waveform monitor (luminance per column) instead of the histograms
+uniform bool waveform;
+
+// Sampling step in texels and size of the sampled grid
+uniform int   stride;
+uniform ivec2 sampledSize;
+
+// log2 of the values covered by the bins
+uniform vec2 log2Range;
+uniform int  nBins;
+uniform int  nColumns;
+
+flat out vec4 count;
+
+void main()
+{
+    int nChannels = waveform ? 1 : 4;
+    int sampleIdx = gl_VertexID / nChannels;
+    int channel   = gl_VertexID % nChannels;
+
+    ivec2 pxCoords = ivec2(sampleIdx % sampledSize.x, sampleIdx / sampledSize.x) * stride;
+
+    vec3  rgb       = texelFetch(image, pxCoords, 0).rgb;
+    float luminance = dot(rgb, vec3(0.2126, 0.7152, 0.0722));
+    float value     = (waveform || channel == 3) ? luminance : rgb[channel];
+
+    // Ignored, out of the clip volume
+    if (!(value > 0.) || isinf(value)) {
+        gl_Position = vec4(2., 2., 0., 1.);
+        count       = vec4(0.);
+        return;
+    }
+
+    float t   = (log2(value) - log2Range.x) / (log2Range.y - log2Range.x);
+    float bin = clamp(floor(t * float(nBins)), 0., float(nBins - 1));
+
+    if (waveform) {
+        float column = floor(float(pxCoords.x) * float(nColumns) / float(textureSize(image, 0).x));
+
+        gl_Position = vec4(
+            2. * (column + 0.5) / float(nColumns) - 1.,
+            2. * (bin + 0.5) / float(nBins) - 1.,
+            0.,
+            1.);
+        count = vec4(1., 0., 0., 0.);
+    } else {
+        gl_Position = vec4(2. * (bin + 0.5) / float(nBins) - 1., 0., 0., 1.);
+        count       = vec4(equal(ivec4(channel), ivec4(0, 1, 2, 3)));
+    }
+}
\ No newline at end of file
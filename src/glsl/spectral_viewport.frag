@@ -0,0 +1,68 @@
+#version 330 core
+
+layout(location = 0) out vec4 outColor;
+
+// Image coordinates, transformed as in the display pass (vertex.vert)
+in vec2 uv;
+
+// Per band RGB weights, see SpectralConverter
+uniform sampler1D bandWeights;
+
+// Contribution of the mean spectrum when the image is stored as PCA
+// coefficients, the bands are then the components (see SpectralPCA)
+uniform vec3 weightsOffset;
+
+// Spectral Image
+uniform sampler3D spectralImage;
+
+// Bands with a non zero weight
+uniform uint bandBegin;
+uniform uint bandEnd;
+
+// Maximum number of image pixels integrated along each axis of the screen
+// pixel footprint, larger footprints are sampled with a stride
+uniform int footprintSamples;
+
+vec3 convert(in ivec2 pxCoords)
+{
+    vec3 pxColor = vec3(0);
+
+    for (int i = int(bandBegin); i < int(bandEnd); i++) {
+        float value  = texelFetch(spectralImage, ivec3(i, pxCoords), 0).r;
+        vec3  weight = texelFetch(bandWeights, i, 0).rgb;
+
+        pxColor += value * weight;
+    }
+
+    return pxColor;
+}
+
+void main()
+{
+    ivec2 imageSize = textureSize(spectralImage, 0).yz;
+
+    // Footprint of the screen pixel in the image, the view transformation
+    // has no rotation so it is axis aligned
+    vec2 center = uv * vec2(imageSize);
+    vec2 extent = abs(dFdx(center)) + abs(dFdy(center));
+
+    ivec2 lo = clamp(ivec2(floor(center - 0.5 * extent)), ivec2(0), imageSize - 1);
+    ivec2 hi = clamp(ivec2(ceil(center + 0.5 * extent)) - 1, lo, imageSize - 1);
+
+    ivec2 stride = max(ivec2(1), (hi - lo + footprintSamples) / footprintSamples);
+
+    // The conversion is linear: averaging colors averages the spectra
+    vec3  pxColor = vec3(0);
+    float count   = 0.;
+
+    for (int y = lo.y; y <= hi.y; y += stride.y) {
+        for (int x = lo.x; x <= hi.x; x += stride.x) {
+            pxColor += convert(ivec2(x, y));
+            count += 1.;
+        }
+    }
+
+    pxColor = weightsOffset + pxColor / count;
+
+    outColor = vec4(pxColor, 1.);
+}
\ No newline at end of file
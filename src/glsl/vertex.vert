@@ -9,10 +9,18 @@ uniform mat3 zoomMatrix;
 uniform mat3 aspectMatrix;
 uniform mat3 translateMatrix;
 
+// Image rows are displayed top to bottom
+uniform bool flipY;
+
 void main()
 {
     vec3 vert = aspectMatrix * translateMatrix * zoomMatrix * vec3(vertPos, 1.);
 
     gl_Position = vec4(vert.xy / vert.z, 0., 1.);
+
+    if (flipY) {
+        gl_Position.y = -gl_Position.y;
+    }
+
     uv = texCoords;
 }
\ No newline at end of file
@@ -0,0 +1,376 @@
+#include "DerivedDataCache.h"
+
+#include "Trace.h"
+
+#include <spectral/SpectralConverter.h>
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <filesystem>
+#include <fstream>
+#include <stdexcept>
+
+
+static const char     MAGIC[8] = {'T', 'R', 'S', 'C', 'A', 'C', 'H', 'E'};
+static const uint32_t VERSION  = 2;
+
+// Guards the allocations against corrupted entries
+static const uint64_t MAX_ELEMENTS = uint64_t(1) << 28;
+
+
+// FNV-1a, 64 bits
+static uint64_t hashBytes(const char *data, size_t size, uint64_t hash = 0xcbf29ce484222325ull)
+{
+    for (size_t i = 0; i < size; i++) {
+        hash ^= (unsigned char)data[i];
+        hash *= 0x100000001b3ull;
+    }
+
+    return hash;
+}
+
+// ----------------------------------------------------------------------------
+// Serialization, native byte order
+// ----------------------------------------------------------------------------
+
+template<typename T>
+static void writeValue(std::ostream &os, const T &value)
+{
+    os.write((const char *)&value, sizeof(T));
+}
+
+
+template<typename T>
+static T readValue(std::istream &is)
+{
+    T value;
+    is.read((char *)&value, sizeof(T));
+
+    return value;
+}
+
+
+template<typename T>
+static void writeVector(std::ostream &os, const std::vector<T> &values)
+{
+    writeValue<uint64_t>(os, values.size());
+    os.write((const char *)values.data(), values.size() * sizeof(T));
+}
+
+
+template<typename T>
+static void readVector(std::istream &is, std::vector<T> &values)
+{
+    const uint64_t size = readValue<uint64_t>(is);
+
+    if (!is || size > MAX_ELEMENTS) {
+        throw std::runtime_error("Malformed cache entry");
+    }
+
+    values.resize(size);
+    is.read((char *)values.data(), size * sizeof(T));
+}
+
+
+static void writeString(std::ostream &os, const std::string &value)
+{
+    writeVector(os, std::vector<char>(value.begin(), value.end()));
+}
+
+
+static std::string readString(std::istream &is)
+{
+    std::vector<char> value;
+    readVector(is, value);
+
+    return std::string(value.begin(), value.end());
+}
+
+// ----------------------------------------------------------------------------
+// Keys
+// ----------------------------------------------------------------------------
+
+bool DerivedDataCache::Key::operator==(const Key &other) const
+{
+    return path == other.path
+           && size == other.size
+           && modificationTime == other.modificationTime
+           && contentHash == other.contentHash;
+}
+
+
+DerivedDataCache::DerivedDataCache(Location location)
+    : _location(location)
+{
+}
+
+
+DerivedDataCache::Key DerivedDataCache::key(const std::string &path)
+{
+    TRACE_SCOPE("Cache key", "io");
+
+    Key key;
+
+    try {
+        key.path             = std::filesystem::absolute(path).string();
+        key.size             = std::filesystem::file_size(path);
+        key.modificationTime = std::filesystem::last_write_time(path).time_since_epoch().count();
+    } catch (const std::filesystem::filesystem_error &e) {
+        throw std::runtime_error(e.what());
+    }
+
+    std::ifstream is(path, std::ifstream::in | std::ifstream::binary);
+
+    if (!is) {
+        throw std::runtime_error("Could not open \"" + path + "\"");
+    }
+
+    // Evenly spread chunks, the last one ends with the file
+    std::vector<char> chunk(HASH_CHUNK_BYTES);
+
+    key.contentHash = hashBytes((const char *)&key.size, sizeof(key.size));
+
+    const uint64_t span = key.size > HASH_CHUNK_BYTES ? key.size - HASH_CHUNK_BYTES : 0;
+
+    for (size_t c = 0; c < HASH_CHUNKS; c++) {
+        const uint64_t offset = span * c / (HASH_CHUNKS - 1);
+
+        is.seekg(offset);
+        is.read(chunk.data(), chunk.size());
+
+        key.contentHash = hashBytes(chunk.data(), (size_t)is.gcount(), key.contentHash);
+        is.clear();
+    }
+
+    return key;
+}
+
+
+std::string DerivedDataCache::entryPath(const Key &key) const
+{
+    if (_location == LOCATION_SIDECAR) {
+        return key.path + ".tiresias";
+    }
+
+    const std::string directory = userDirectory();
+
+    if (directory.empty()) {
+        return "";
+    }
+
+    char name[32];
+    std::snprintf(name, sizeof(name), "%016llx.cache", (unsigned long long)hashBytes(key.path.data(), key.path.size()));
+
+    return directory + "/" + name;
+}
+
+
+std::string DerivedDataCache::userDirectory()
+{
+#ifdef _WIN32
+    if (const char *localAppData = std::getenv("LOCALAPPDATA")) {
+        return std::string(localAppData) + "/tiresias";
+    }
+#else
+    if (const char *cacheHome = std::getenv("XDG_CACHE_HOME")) {
+        if (*cacheHome) {
+            return std::string(cacheHome) + "/tiresias";
+        }
+    }
+
+    if (const char *home = std::getenv("HOME")) {
+        return std::string(home) + "/.cache/tiresias";
+    }
+#endif
+
+    return "";
+}
+
+// ----------------------------------------------------------------------------
+// Entries
+// ----------------------------------------------------------------------------
+
+bool DerivedDataCache::load(const Key &key, Entry &entry) const
+{
+    TRACE_SCOPE("Cache load", "io");
+
+    const std::string path = entryPath(key);
+
+    std::ifstream is(path, std::ifstream::in | std::ifstream::binary);
+
+    if (path.empty() || !is) {
+        return false;
+    }
+
+    try {
+        char magic[sizeof(MAGIC)];
+        is.read(magic, sizeof(magic));
+
+        if (!is || !std::equal(magic, magic + sizeof(MAGIC), MAGIC) || readValue<uint32_t>(is) != VERSION) {
+            return false;
+        }
+
+        Key stored;
+        stored.path             = readString(is);
+        stored.size             = readValue<uint64_t>(is);
+        stored.modificationTime = readValue<int64_t>(is);
+        stored.contentHash      = readValue<uint64_t>(is);
+
+        // Outdated, or another image with the same path hash
+        if (!is || !(stored == key)) {
+            return false;
+        }
+
+        entry.key = key;
+
+        entry.width      = readValue<uint32_t>(is);
+        entry.height     = readValue<uint32_t>(is);
+        entry.reflective = readValue<uint8_t>(is) != 0;
+        readVector(is, entry.wavelengths);
+
+        entry.previewWidth  = readValue<uint32_t>(is);
+        entry.previewHeight = readValue<uint32_t>(is);
+        readVector(is, entry.preview);
+
+        entry.exposure = readValue<float>(is);
+
+        entry.statistics.read(is);
+    } catch (const std::exception &) {
+        return false;
+    }
+
+    return is
+           && entry.preview.size() == 4 * size_t(entry.previewWidth) * entry.previewHeight
+           && entry.statistics.nBands() == entry.wavelengths.size();
+}
+
+
+void DerivedDataCache::store(const Entry &entry) const
+{
+    TRACE_SCOPE("Cache store", "io");
+
+    const std::string path = entryPath(entry.key);
+
+    if (path.empty()) {
+        throw std::runtime_error("No cache directory");
+    }
+
+    if (_location == LOCATION_USER) {
+        std::filesystem::create_directories(userDirectory());
+    }
+
+    const std::string temporaryPath = path + ".tmp";
+
+    {
+        std::ofstream os(temporaryPath, std::ofstream::out | std::ofstream::binary);
+
+        if (!os) {
+            throw std::runtime_error("Could not open \"" + temporaryPath + "\" for writing");
+        }
+
+        os.write(MAGIC, sizeof(MAGIC));
+        writeValue(os, VERSION);
+
+        writeString(os, entry.key.path);
+        writeValue(os, entry.key.size);
+        writeValue(os, entry.key.modificationTime);
+        writeValue(os, entry.key.contentHash);
+
+        writeValue(os, entry.width);
+        writeValue(os, entry.height);
+        writeValue<uint8_t>(os, entry.reflective ? 1 : 0);
+        writeVector(os, entry.wavelengths);
+
+        writeValue(os, entry.previewWidth);
+        writeValue(os, entry.previewHeight);
+        writeVector(os, entry.preview);
+
+        writeValue(os, entry.exposure);
+
+        entry.statistics.write(os);
+
+        if (!os) {
+            throw std::runtime_error("Could not write to \"" + temporaryPath + "\"");
+        }
+    }
+
+    std::error_code error;
+    std::filesystem::rename(temporaryPath, path, error);
+
+    if (error) {
+        std::filesystem::remove(temporaryPath, error);
+        throw std::runtime_error("Could not write \"" + path + "\"");
+    }
+}
+
+// ----------------------------------------------------------------------------
+// Derived data
+// ----------------------------------------------------------------------------
+
+void DerivedDataCache::makePreview(
+    const float             *spectra,
+    size_t                   width,
+    size_t                   height,
+    const SpectralConverter &converter,
+    Entry                   &entry,
+    int                      nThreads)
+{
+    TRACE_SCOPE("Cache preview", "convert");
+
+    if (nThreads <= 0) {
+        nThreads = SpectralConverter::maxThreads();
+    }
+
+    const size_t nBands = entry.wavelengths.size();
+
+    // Integer box filter, the preview covers the whole image
+    const size_t factor = std::max(size_t(1), (std::max(width, height) + PREVIEW_MAX_SIZE - 1) / PREVIEW_MAX_SIZE);
+
+    entry.previewWidth  = uint32_t((width + factor - 1) / factor);
+    entry.previewHeight = uint32_t((height + factor - 1) / factor);
+    entry.preview.assign(4 * size_t(entry.previewWidth) * entry.previewHeight, 0.f);
+
+#pragma omp parallel num_threads(nThreads)
+    {
+        std::vector<double> sum(nBands);
+        std::vector<size_t> count(nBands);
+        std::vector<float>  spectrum(nBands);
+
+#pragma omp for schedule(dynamic)
+        for (long py = 0; py < (long)entry.previewHeight; py++) {
+            for (size_t px = 0; px < entry.previewWidth; px++) {
+                std::fill(sum.begin(), sum.end(), 0.);
+                std::fill(count.begin(), count.end(), 0);
+
+                for (size_t y = py * factor; y < std::min(height, (py + 1) * factor); y++) {
+                    for (size_t x = px * factor; x < std::min(width, (px + 1) * factor); x++) {
+                        const float *s = &spectra[nBands * (y * width + x)];
+
+                        for (size_t b = 0; b < nBands; b++) {
+                            if (std::isfinite(s[b])) {
+                                sum[b] += s[b];
+                                count[b]++;
+                            }
+                        }
+                    }
+                }
+
+                for (size_t b = 0; b < nBands; b++) {
+                    spectrum[b] = count[b] > 0 ? float(sum[b] / count[b]) : 0.f;
+                }
+
+                // The conversion is linear: the mean spectrum gives the mean color
+                const glm::vec3 rgb = converter.convertPixel(spectrum.data());
+
+                float *out = &entry.preview[4 * (py * entry.previewWidth + px)];
+
+                out[0] = rgb.r;
+                out[1] = rgb.g;
+                out[2] = rgb.b;
+                out[3] = 1.f;
+            }
+        }
+    }
+}
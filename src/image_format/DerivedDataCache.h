@@ -0,0 +1,96 @@
+#pragma once
+
+#include <spectral/BandStatistics.h>
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+class SpectralConverter;
+
+
+// Data derived from a spectral image, kept on disk so reopening the image
+// is instant: linear RGB preview, per band statistics and the
+// header probe. Entries are written next to the image (sidecar) or in the
+// user cache directory.
+//
+// Entries are keyed by the path, size and modification time of the image
+// and a hash of its content. Hashing gigabytes on each open would defeat
+// the purpose: the hash covers HASH_CHUNKS chunks of HASH_CHUNK_BYTES
+// evenly spread over the file, first and last ones included.
+class DerivedDataCache
+{
+  public:
+    enum Location
+    {
+        LOCATION_USER,      // Per user cache directory
+        LOCATION_SIDECAR,   // Next to the image, as <image>.tiresias
+    };
+
+    struct Key {
+        std::string path;   // Absolute
+        uint64_t    size;
+        int64_t     modificationTime;
+        uint64_t    contentHash;
+
+        bool operator==(const Key &other) const;
+    };
+
+    struct Entry {
+        Key key;
+
+        // Header probe
+        uint32_t           width, height;
+        bool               reflective;
+        std::vector<float> wavelengths;
+
+        // Linear RGBA preview, PREVIEW_MAX_SIZE pixels on its longest side
+        uint32_t           previewWidth, previewHeight;
+        std::vector<float> preview;
+
+        // Exposure seeded from the statistics
+        float exposure;
+
+        BandStatistics statistics;
+    };
+
+    DerivedDataCache(Location location = LOCATION_USER);
+
+    Location location() const { return _location; }
+
+    // Throws when the image cannot be read
+    static Key key(const std::string &path);
+
+    std::string entryPath(const Key &key) const;
+
+    // False when there is no entry for the key, or an outdated or
+    // unreadable one. The entry may then be partially filled, but its key
+    // is left untouched.
+    bool load(const Key &key, Entry &entry) const;
+
+    // Written to a temporary file then renamed, so readers never see a
+    // partial entry. Throws on I/O errors.
+    void store(const Entry &entry) const;
+
+    // $XDG_CACHE_HOME/tiresias, ~/.cache/tiresias or %LOCALAPPDATA%/tiresias
+    static std::string userDirectory();
+
+    // Fills the preview of an entry from band first spectra, box filtered
+    // then converted. When nThreads is 0, all the available cores are used.
+    static void makePreview(
+        const float             *spectra,
+        size_t                   width,
+        size_t                   height,
+        const SpectralConverter &converter,
+        Entry                   &entry,
+        int                      nThreads = 0);
+
+    static const uint32_t PREVIEW_MAX_SIZE = 1024;
+
+    static const size_t HASH_CHUNKS      = 16;
+    static const size_t HASH_CHUNK_BYTES = size_t(1) << 16;
+
+  private:
+    Location _location;
+};
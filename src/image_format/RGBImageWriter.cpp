@@ -0,0 +1,60 @@
+#include "RGBImageWriter.h"
+
+#include <lodepng.h>
+
+#include <ImfChannelList.h>
+#include <ImfFrameBuffer.h>
+#include <ImfHeader.h>
+#include <ImfOutputFile.h>
+
+#include <stdexcept>
+
+#include "Trace.h"
+
+
+void RGBImageWriter::writePNG(
+    const std::string                &path,
+    size_t                            width,
+    size_t                            height,
+    const std::vector<unsigned char> &rgba)
+{
+    TRACE_SCOPE("PNG encode & write", "io");
+
+    const unsigned error = lodepng::encode(path, rgba, width, height);
+
+    if (error) {
+        throw std::runtime_error(path + ": " + lodepng_error_text(error));
+    }
+}
+
+
+void RGBImageWriter::writeEXR(
+    const std::string &path,
+    size_t             width,
+    size_t             height,
+    const float       *rgba)
+{
+    TRACE_SCOPE("EXR encode & write", "io");
+
+    const char *channels[3] = {"R", "G", "B"};
+
+    Imf::Header      header((int)width, (int)height);
+    Imf::FrameBuffer framebuffer;
+
+    // The alpha channel is skipped by the strides
+    for (size_t c = 0; c < 3; c++) {
+        header.channels().insert(channels[c], Imf::Channel(Imf::FLOAT));
+
+        framebuffer.insert(
+            channels[c],
+            Imf::Slice(
+                Imf::FLOAT,
+                (char *)(rgba + c),
+                4 * sizeof(float),
+                4 * sizeof(float) * width));
+    }
+
+    Imf::OutputFile file(path.c_str(), header);
+    file.setFrameBuffer(framebuffer);
+    file.writePixels((int)height);
+}
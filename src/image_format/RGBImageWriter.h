@@ -0,0 +1,26 @@
+#pragma once
+
+#include <cstddef>
+#include <string>
+#include <vector>
+
+
+// Writers for converted images, pixels are RGBA and rows ordered from the
+// top. Errors are reported as exceptions.
+class RGBImageWriter
+{
+  public:
+    // Display referred, 8 bits per channel
+    static void writePNG(
+        const std::string                &path,
+        size_t                            width,
+        size_t                            height,
+        const std::vector<unsigned char> &rgba);
+
+    // Scene referred, stored as 32 bits float R, G, B channels
+    static void writeEXR(
+        const std::string &path,
+        size_t             width,
+        size_t             height,
+        const float       *rgba);
+};
@@ -0,0 +1,126 @@
+#include "SpectralImageFile.h"
+
+#include "Trace.h"
+
+#include <spectral/BandStatistics.h>
+
+#include <algorithm>
+#include <cctype>
+#include <stdexcept>
+
+
+static std::string lowerExtension(const std::string &filepath)
+{
+    const size_t dot = filepath.find_last_of('.');
+
+    if (dot == std::string::npos) {
+        return "";
+    }
+
+    std::string ext = filepath.substr(dot + 1);
+    std::transform(ext.begin(), ext.end(), ext.begin(), ::tolower);
+
+    return ext;
+}
+
+
+SpectralImageFile::SpectralImageFile(const std::string &filepath, BandStatistics *statistics)
+    : _width(0)
+    , _height(0)
+    , _isReflective(false)
+{
+    TRACE_SCOPE("SpectralImageFile::SpectralImageFile", "io");
+
+    const std::string ext = lowerExtension(filepath);
+
+    if (ext == "exr") {
+        try {
+            _exr.reset(new SEXR::EXRSpectralImage(filepath));
+        } catch (const SEXR::SpectralImage::Errors &) {
+            throw std::runtime_error("\"" + filepath + "\" is not a spectral image");
+        }
+
+        _width  = _exr->width();
+        _height = _exr->height();
+
+        _isReflective = _exr->isReflective();
+
+        _wavelengths.resize(_exr->nSpectralBands());
+
+        for (size_t i = 0; i < _wavelengths.size(); i++) {
+            _wavelengths[i] = _exr->wavelength_nm(i);
+        }
+
+        // Half way to the neighbouring bands, see ImageViewerSpectralEXR
+        const size_t n = _wavelengths.size();
+
+        _boundsWidths.resize(n);
+
+        if (n > 1) {
+            for (size_t i = 1; i < n - 1; i++) {
+                _boundsWidths[i] = (_wavelengths[i + 1] - _wavelengths[i - 1]) / 2.f;
+            }
+
+            _boundsWidths[0]     = _wavelengths[1] - _wavelengths[0];
+            _boundsWidths[n - 1] = _wavelengths[n - 1] - _wavelengths[n - 2];
+        } else if (n == 1) {
+            _boundsWidths[0] = 1.f;
+        }
+    } else if (ext == "artraw") {
+        _artRaw.reset(new ArtRaw(filepath, statistics));
+
+        if (!_artRaw->isSpectral()) {
+            throw std::runtime_error("\"" + filepath + "\" is not a spectral image");
+        }
+
+        if (_artRaw->isPolarised()) {
+            throw std::runtime_error("Polarised ArtRaw images are not supported");
+        }
+
+        _width  = _artRaw->width();
+        _height = _artRaw->height();
+
+        const std::vector<double> &bounds = _artRaw->wavelengthBounds();
+
+        _wavelengths.resize(_artRaw->nSpectralBands());
+        _boundsWidths.resize(_artRaw->nSpectralBands());
+
+        for (size_t i = 0; i < _wavelengths.size(); i++) {
+            _wavelengths[i]  = _artRaw->wavelengths()[i];
+            _boundsWidths[i] = float(bounds[i + 1] - bounds[i]);
+        }
+    } else {
+        throw std::runtime_error("Unsupported image type \"" + filepath + "\"");
+    }
+
+    if (_wavelengths.empty()) {
+        throw std::runtime_error("\"" + filepath + "\" has no spectral band");
+    }
+
+    // Decoded by the EXR library, the statistics need their own pass
+    if (statistics && _exr) {
+        TRACE_SCOPE("Band statistics", "stats");
+
+        statistics->compute(data(), _width * _height, nSpectralBands());
+    }
+}
+
+
+bool SpectralImageFile::isSupported(const std::string &filepath)
+{
+    const std::string ext = lowerExtension(filepath);
+
+    return ext == "exr" || ext == "artraw";
+}
+
+
+const float *SpectralImageFile::data() const
+{
+    if (_artRaw) {
+        return _artRaw->data();
+    } else if (_exr->isEmissive()) {
+        return &_exr->emissive(0, 0, 0, 0);
+    } else {
+        return &_exr->reflective(0, 0, 0);
+    }
+}
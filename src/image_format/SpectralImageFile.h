@@ -0,0 +1,55 @@
+#pragma once
+
+#include "artraw.h"
+
+#include <EXRSpectralImage.h>
+
+#include <memory>
+#include <string>
+#include <vector>
+
+class BandStatistics;
+
+
+// Spectral image read from a spectral OpenEXR or an ArtRaw file, without any
+// OpenGL. Only the first Stokes component is kept for polarised images, as
+// in the viewer.
+class SpectralImageFile
+{
+  public:
+    // The format is chosen from the extension (.exr or .artraw), throws on
+    // unsupported or unreadable files. Per band statistics are computed
+    // when statistics is not null: while decoding for ArtRaw files, in a
+    // pass after the decoding for EXR files.
+    SpectralImageFile(const std::string &filepath, BandStatistics *statistics = nullptr);
+
+    static bool isSupported(const std::string &filepath);
+
+    size_t width() const { return _width; }
+    size_t height() const { return _height; }
+    size_t nSpectralBands() const { return _wavelengths.size(); }
+
+    // As in the viewer: the illuminant applies when the file holds
+    // reflective data, emissive data being read when present
+    bool isReflective() const { return _isReflective; }
+
+    // Band centers and widths, as expected by SpectralConverter::setBands()
+    const std::vector<float> &wavelengths() const { return _wavelengths; }
+    const std::vector<float> &boundsWidths() const { return _boundsWidths; }
+
+    // Spectra stored band first: data()[nSpectralBands() * (y * width + x) + band]
+    const float *data() const;
+
+    // Size of the spectral data in memory
+    size_t dataBytes() const { return sizeof(float) * _width * _height * nSpectralBands(); }
+
+  private:
+    std::unique_ptr<SEXR::EXRSpectralImage> _exr;
+    std::unique_ptr<ArtRaw>                 _artRaw;
+
+    size_t _width, _height;
+    bool   _isReflective;
+
+    std::vector<float> _wavelengths;
+    std::vector<float> _boundsWidths;
+};
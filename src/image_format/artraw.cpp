@@ -1,14 +1,56 @@
 #include "artraw.h"
 
+#include "Trace.h"
+
+#include <spectral/BandStatistics.h>
+
 #include <functional>
 #include <sstream>
 #include <cassert>
 #include <exception>
 #include <cstring>
+#include <algorithm>
+#include <memory>
+
+
+// Floats are stored least significant byte first
+static float getBuffer(const char *buff)
+{
+    union
+    {
+        float        f;
+        unsigned int i;
+    } value;
+
+    value.i = buff[3] & 0xff;
+    value.i <<= 8;
+    value.i += buff[2] & 0xff;
+    value.i <<= 8;
+    value.i += buff[1] & 0xff;
+    value.i <<= 8;
+    value.i += buff[0] & 0xff;
+
+    return value.f;
+}
+
 
+ArtRaw::ArtRaw()
+    : _spectrumType(SPECTRUM_EMISSIVE)
+    , _width(0)
+    , _height(0)
+    , _version(0.f)
+    , _dpiX(72.f)
+    , _dpiY(72.f)
+    , _spectral(false)
+    , _polarised(false)
+{
+}
 
-ArtRaw::ArtRaw(const std::string &filepath)
+
+ArtRaw::ArtRaw(const std::string &filepath, BandStatistics *statistics)
 {
+    TRACE_SCOPE("ArtRaw::ArtRaw", "io");
+
     std::ifstream       ifs(filepath, std::ifstream::in);
     size_t              width, height;
     size_t              n_channels;
@@ -18,9 +60,13 @@ ArtRaw::ArtRaw(const std::string &filepath)
         throw std::runtime_error("Cannot read ARTRAW header");
     }
 
-    if (!readImageData(ifs, width, height, n_channels, bounds)) {
+    if (!readImageData(ifs, width, height, n_channels, bounds, statistics)) {
         throw std::runtime_error("Cannot read ARTRAW file content");
     }
+
+    _width  = width;
+    _height = height;
+    _bounds = bounds;
 }
 
 
@@ -180,26 +226,9 @@ bool ArtRaw::readImageData(
     size_t                     width,
     size_t                     height,
     size_t                     n_channels,
-    const std::vector<double> &bounds)
+    const std::vector<double> &bounds,
+    BandStatistics            *statistics)
 {
-    std::function<float(const char *buff)> getBuffer = [](const char *buff) {
-        union
-        {
-            float        f;
-            unsigned int i;
-        } value;
-
-        value.i = buff[3] & 0xff;
-        value.i <<= 8;
-        value.i += buff[2] & 0xff;
-        value.i <<= 8;
-        value.i += buff[1] & 0xff;
-        value.i <<= 8;
-        value.i += buff[0] & 0xff;
-
-        return value.f;
-    };
-
     // Populate wavelengths
     _wavelengths.resize(n_channels);
 
@@ -252,20 +281,240 @@ bool ArtRaw::readImageData(
     std::vector<char> bufferedImage(dataSize);
 
     // Read pixel values
-    is.read(bufferedImage.data(), dataSize);
-
-    // Convert pixels bytes to float
-    for (size_t y = 0; y < height; y++) {
-        for (size_t x = 0; x < width; x++) {
-            for (size_t lambda = 0; lambda < n_channels; lambda++) {
-                // Notice file nChannels + 1: there is an alpha channel in ARTRAWs
-                const size_t fileOffset                              = (y * width + x) * (n_channels + 1) + lambda;
-                _emissiveData[n_channels * (y * width + x) + lambda] = getBuffer(&bufferedImage[4 * fileOffset]);
+    {
+        TRACE_SCOPE("ArtRaw read", "io");
+        is.read(bufferedImage.data(), dataSize);
+    }
+
+    TRACE_SCOPE("ArtRaw layout conversion", "layout");
+
+    if (statistics) {
+        statistics->reset(n_channels);
+    }
+
+    // All the cores, fewer when the accumulators would not fit in memory
+    const int nThreads = BandStatistics::threadCount(statistics ? n_channels : 0);
+
+    // Rows are converted in parallel, the statistics of each row gathered
+    // while it is still in cache
+#pragma omp parallel num_threads(nThreads)
+    {
+        std::unique_ptr<BandStatistics::Accumulator> accumulator;
+
+        if (statistics) {
+            accumulator.reset(new BandStatistics::Accumulator(n_channels));
+        }
+
+#pragma omp for schedule(static) nowait
+        for (long y = 0; y < (long)height; y++) {
+            for (size_t x = 0; x < width; x++) {
+                for (size_t lambda = 0; lambda < n_channels; lambda++) {
+                    // Notice file nChannels + 1: there is an alpha channel in ARTRAWs
+                    const size_t fileOffset                              = (y * width + x) * (n_channels + 1) + lambda;
+                    _emissiveData[n_channels * (y * width + x) + lambda] = getBuffer(&bufferedImage[4 * fileOffset]);
+                }
+                _alpha[y * width + x] = getBuffer(&bufferedImage[4 * ((y * width + x) * (n_channels + 1) + n_channels)]);
+            }
+
+            if (accumulator) {
+                accumulator->add(&_emissiveData[n_channels * y * width], y * width, width);
             }
-            _alpha[y * width + x] = getBuffer(&bufferedImage[4 * ((y * width + x) * (n_channels + 1) + n_channels)]);
+        }
+
+        if (accumulator) {
+#pragma omp critical
+            statistics->merge(*accumulator);
         }
     }
     // }
 
     return true;
-}
\ No newline at end of file
+}
+
+// ----------------------------------------------------------------------------
+// Streaming reader
+// ----------------------------------------------------------------------------
+
+ArtRawReader::ArtRawReader(const std::string &filepath)
+    : ArtRaw()
+    , _is(filepath, std::ifstream::in | std::ifstream::binary)
+    , _filepath(filepath)
+    , _rowsRead(0)
+{
+    if (!_is) {
+        throw std::runtime_error("Could not open \"" + filepath + "\"");
+    }
+
+    size_t              width, height;
+    size_t              n_channels;
+    std::vector<double> bounds;
+
+    if (!readHeader(_is, width, height, n_channels, bounds)) {
+        throw std::runtime_error("Cannot read ARTRAW header");
+    }
+
+    if (isPolarised()) {
+        throw std::runtime_error("Polarised ARTRAW images cannot be streamed");
+    }
+
+    _width  = width;
+    _height = height;
+    _bounds = bounds;
+
+    _wavelengths.resize(n_channels);
+
+    for (size_t c = 0; c < n_channels; c++) {
+        _wavelengths[c] = static_cast<unsigned int>((bounds[c] + bounds[c + 1]) / 2);
+    }
+}
+
+
+size_t ArtRawReader::readRows(size_t nRows, float *spectra)
+{
+    nRows = std::min(nRows, _height - _rowsRead);
+
+    if (nRows == 0) {
+        return 0;
+    }
+
+    TRACE_SCOPE("ArtRaw read rows", "io");
+
+    // One alpha value after each pixel
+    const size_t nChannels = nSpectralBands();
+    const size_t nPixels   = nRows * _width;
+
+    _buffer.resize(4 * nPixels * (nChannels + 1));
+    _is.read(_buffer.data(), _buffer.size());
+
+    if (!_is) {
+        throw std::runtime_error("Could not read \"" + _filepath + "\"");
+    }
+
+    for (size_t px = 0; px < nPixels; px++) {
+        for (size_t lambda = 0; lambda < nChannels; lambda++) {
+            spectra[nChannels * px + lambda] = getBuffer(&_buffer[4 * (px * (nChannels + 1) + lambda)]);
+        }
+    }
+
+    _rowsRead += nRows;
+
+    return nRows;
+}
+
+// ----------------------------------------------------------------------------
+// Writer
+// ----------------------------------------------------------------------------
+
+ArtRawWriter::ArtRawWriter(
+    const std::string         &filepath,
+    size_t                     width,
+    size_t                     height,
+    const std::vector<double> &bounds,
+    bool                       polarised)
+    : _os(filepath, std::ofstream::out | std::ofstream::binary)
+    , _filepath(filepath)
+    , _width(width)
+    , _height(height)
+    , _nBands(bounds.size() > 0 ? bounds.size() - 1 : 0)
+    , _polarised(polarised)
+    , _rowsWritten(0)
+{
+    if (!_os) {
+        throw std::runtime_error("Could not open \"" + filepath + "\" for writing");
+    }
+
+    if (_nBands == 0 || width == 0 || height == 0) {
+        throw std::runtime_error("Cannot write an empty ARTRAW image");
+    }
+
+    // Field values start at the column expected by ArtRaw::readHeader()
+    _os << "ART RAW image format 2.5\n"
+        << "\n"
+        << "File created by:    tiresias\n"
+        << "Platform:           unknown\n"
+        << "Command line:       \n"
+        << "Creation date:      unknown\n"
+        << "Render time:        0\n"
+        << "Samples per pixel:  1\n"
+        << "Image size:         " << width << " x " << height << "\n"
+        << "DPI:                72 x 72\n"
+        << "Image type:         " << (polarised ? "polarised" : "plain") << " spectrum with " << _nBands << " samples\n"
+        << "\n"
+        << "Sample bounds in nanometers:";
+
+    for (double b : bounds) {
+        _os << " " << b;
+    }
+
+    _os << "\n"
+        << "\n"
+        << "Big-endian binary coded IEEE float pixel values in scanline order follow:\n"
+        << "X";
+}
+
+
+void ArtRawWriter::put(float value)
+{
+    union
+    {
+        float        f;
+        unsigned int i;
+    } bits;
+
+    bits.f = value;
+
+    // Least significant byte first, see getBuffer()
+    for (size_t b = 0; b < 4; b++) {
+        _buffer.push_back(char((bits.i >> (8 * b)) & 0xff));
+    }
+}
+
+
+void ArtRawWriter::writeRow(const float *spectra, const float *alpha)
+{
+    if (_rowsWritten >= _height) {
+        throw std::runtime_error("Too many rows written to \"" + _filepath + "\"");
+    }
+
+    const size_t nStokes = _polarised ? 4 : 1;
+
+    _buffer.clear();
+    _buffer.reserve(4 * _width * (nStokes * _nBands + 1) + _width / 8 + 1);
+
+    for (size_t x = 0; x < _width; x++) {
+        // Polarised images: a flag byte before each group of 8 pixels tells
+        // which ones have the full Stokes vector, all of them here
+        if (_polarised && x % 8 == 0) {
+            const size_t nPixels = std::min(size_t(8), _width - x);
+            _buffer.push_back(char(0xff << (8 - nPixels)));
+        }
+
+        for (size_t i = 0; i < nStokes * _nBands; i++) {
+            put(spectra[nStokes * _nBands * x + i]);
+        }
+
+        put(alpha ? alpha[x] : 1.f);
+    }
+
+    _os.write(_buffer.data(), _buffer.size());
+
+    if (!_os) {
+        throw std::runtime_error("Could not write to \"" + _filepath + "\"");
+    }
+
+    _rowsWritten++;
+}
+
+
+void ArtRawWriter::close()
+{
+    if (_rowsWritten != _height) {
+        throw std::runtime_error("Missing rows in \"" + _filepath + "\"");
+    }
+
+    _os.close();
+
+    if (!_os) {
+        throw std::runtime_error("Could not write to \"" + _filepath + "\"");
+    }
+}
@@ -5,6 +5,8 @@
 #include <fstream>
 #include <cstddef>
 
+class BandStatistics;
+
 class ArtRaw
 {
   public:
@@ -16,10 +18,31 @@ class ArtRaw
         SPECTRUM_EMISSIVE_POLARISED = SPECTRUM_EMISSIVE | SPECTRUM_POLARISED,
     };
 
-    ArtRaw(const std::string &filepath);
+    // Per band statistics are gathered while the pixels are decoded when
+    // statistics is not null
+    ArtRaw(const std::string &filepath, BandStatistics *statistics = nullptr);
+
+    size_t width() const { return _width; }
+    size_t height() const { return _height; }
+
+    size_t nSpectralBands() const { return _wavelengths.size(); }
+    bool   isPolarised() const { return _spectrumType & SPECTRUM_POLARISED; }
+
+    // False for CIEXYZ images
+    bool isSpectral() const { return _spectral; }
 
+    // Band centers, and band bounds (nSpectralBands() + 1 values)
+    const std::vector<unsigned int> &wavelengths() const { return _wavelengths; }
+    const std::vector<double>       &wavelengthBounds() const { return _bounds; }
+
+    // Spectra stored band first: data()[nSpectralBands() * (y * width + x) + band]
+    const float *data() const { return _emissiveData.data(); }
+    const float *alpha() const { return _alpha.data(); }
 
   protected:
+    // Empty image, for ArtRawReader
+    ArtRaw();
+
     bool readHeader(
         std::istream        &is,
         size_t              &width,
@@ -32,7 +55,8 @@ class ArtRaw
         size_t                     width,
         size_t                     height,
         size_t                     n_channels,
-        const std::vector<double> &bounds);
+        const std::vector<double> &bounds,
+        BandStatistics            *statistics);
 
 
     // Image data
@@ -40,6 +64,7 @@ class ArtRaw
     size_t       _width, _height;
 
     std::vector<unsigned int> _wavelengths;
+    std::vector<double>       _bounds;
     std::vector<float>        _emissiveData;
     std::vector<float>        _alpha;
 
@@ -70,4 +95,63 @@ class ArtRaw
     float _dpiX, _dpiY;
     bool  _spectral;
     bool  _polarised;
+};
+
+
+// Reads plain ArtRaw files a few rows at a time, so images larger than the
+// memory can be processed. data() and alpha() stay empty.
+class ArtRawReader: public ArtRaw
+{
+  public:
+    ArtRawReader(const std::string &filepath);
+
+    // Band first spectra of the next rows, at most nRows of them:
+    // spectra[nSpectralBands() * (row * width() + x) + band]. Returns the
+    // number of rows read, 0 once the whole image was read.
+    size_t readRows(size_t nRows, float *spectra);
+
+    size_t rowsRead() const { return _rowsRead; }
+
+  private:
+    std::ifstream _is;
+    std::string   _filepath;
+
+    size_t            _rowsRead;
+    std::vector<char> _buffer;
+};
+
+
+// Writes ArtRaw 2.5 files scanline by scanline, so images larger than the
+// memory can be produced. The layout is the one expected by ArtRaw: floats
+// in the byte order of the reader, one alpha value after each pixel.
+class ArtRawWriter
+{
+  public:
+    ArtRawWriter(
+        const std::string         &filepath,
+        size_t                     width,
+        size_t                     height,
+        const std::vector<double> &bounds,
+        bool                       polarised = false);
+
+    // Band first spectra of the next row: spectra[nBands * x + band], or
+    // for polarised images the Stokes vectors:
+    // spectra[(4 * x + s) * nBands + band]. Alpha may be null (opaque).
+    void writeRow(const float *spectra, const float *alpha = nullptr);
+
+    // Throws if rows are missing or on I/O errors
+    void close();
+
+  private:
+    void put(float value);
+
+    std::ofstream _os;
+    std::string   _filepath;
+
+    size_t _width, _height;
+    size_t _nBands;
+    bool   _polarised;
+
+    size_t            _rowsWritten;
+    std::vector<char> _buffer;
 };
\ No newline at end of file
@@ -0,0 +1,211 @@
+#include "ExposureMeter.h"
+
+#include "Trace.h"
+
+#include <algorithm>
+#include <cmath>
+#include <numeric>
+
+
+ExposureMeter::ExposureMeter()
+    : _logProgram(nullptr)
+    , _histogramProgram(nullptr)
+    , _vao(0)
+    , _fbo_log(0)
+    , _tex_log(0)
+    , _fbo_histogram(0)
+    , _tex_histogram(0)
+    // A single metering in flight keeps both results consistent
+    , _averageReadback(1)
+    , _histogramReadback(1)
+    , _log2Average(0.f)
+    , _hasResult(false)
+{
+}
+
+
+ExposureMeter::~ExposureMeter()
+{
+    glDeleteVertexArrays(1, &_vao);
+    glDeleteFramebuffers(1, &_fbo_log);
+    glDeleteTextures(1, &_tex_log);
+    glDeleteFramebuffers(1, &_fbo_histogram);
+    glDeleteTextures(1, &_tex_histogram);
+}
+
+
+void ExposureMeter::initGL()
+{
+    _logProgram = std::unique_ptr<Shader>(new Shader("glsl/fullscreen.vert", "glsl/exposure_log.frag"));
+
+    _loc_region        = glGetUniformLocation(_logProgram->get(), "region");
+    _loc_reductionSize = glGetUniformLocation(_logProgram->get(), "reductionSize");
+
+    _histogramProgram = std::unique_ptr<Shader>(new Shader("glsl/exposure_histogram.vert", "glsl/scopes.frag"));
+
+    _loc_histogramRegion = glGetUniformLocation(_histogramProgram->get(), "region");
+    _loc_stride          = glGetUniformLocation(_histogramProgram->get(), "stride");
+    _loc_sampledSize     = glGetUniformLocation(_histogramProgram->get(), "sampledSize");
+    _loc_log2Range       = glGetUniformLocation(_histogramProgram->get(), "log2Range");
+    _loc_nBins           = glGetUniformLocation(_histogramProgram->get(), "nBins");
+
+    // Geometry is generated from the vertex index only
+    glGenVertexArrays(1, &_vao);
+
+    // Log luminance, with its full mip chain
+    glGenTextures(1, &_tex_log);
+    glBindTexture(GL_TEXTURE_2D, _tex_log);
+
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST_MIPMAP_NEAREST);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+    glTexImage2D(GL_TEXTURE_2D, 0, GL_RG32F, REDUCTION_SIZE, REDUCTION_SIZE, 0, GL_RG, GL_FLOAT, nullptr);
+    glGenerateMipmap(GL_TEXTURE_2D);
+
+    glGenFramebuffers(1, &_fbo_log);
+    glBindFramebuffer(GL_FRAMEBUFFER, _fbo_log);
+    glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, _tex_log, 0);
+
+    // Histogram of the log luminance
+    glGenTextures(1, &_tex_histogram);
+    glBindTexture(GL_TEXTURE_2D, _tex_histogram);
+
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+    glTexImage2D(GL_TEXTURE_2D, 0, GL_R32F, BINS, 1, 0, GL_RED, GL_FLOAT, nullptr);
+
+    glGenFramebuffers(1, &_fbo_histogram);
+    glBindFramebuffer(GL_FRAMEBUFFER, _fbo_histogram);
+    glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, _tex_histogram, 0);
+
+    glBindFramebuffer(GL_FRAMEBUFFER, 0);
+    glBindTexture(GL_TEXTURE_2D, 0);
+
+    _averageReadback.initGL();
+    _histogramReadback.initGL();
+}
+
+
+bool ExposureMeter::meter(GLuint texture, int x, int y, int width, int height)
+{
+    if (isPending() || width <= 0 || height <= 0) {
+        return false;
+    }
+
+    TRACE_SCOPE("Exposure metering", "render");
+
+    glBindVertexArray(_vao);
+
+    // ------------------------------------------------------------------------
+    // Log luminance, reduced by the mip chain
+    // ------------------------------------------------------------------------
+
+    glBindFramebuffer(GL_FRAMEBUFFER, _fbo_log);
+    glViewport(0, 0, REDUCTION_SIZE, REDUCTION_SIZE);
+
+    glUseProgram(_logProgram->get());
+    glUniform4i(_loc_region, x, y, width, height);
+    glUniform1i(_loc_reductionSize, REDUCTION_SIZE);
+
+    glActiveTexture(GL_TEXTURE0);
+    glBindTexture(GL_TEXTURE_2D, texture);
+
+    glDrawArrays(GL_TRIANGLES, 0, 3);
+
+    glBindTexture(GL_TEXTURE_2D, _tex_log);
+    glGenerateMipmap(GL_TEXTURE_2D);
+
+    // ------------------------------------------------------------------------
+    // Histogram of the pixels of the region
+    // ------------------------------------------------------------------------
+
+    const size_t  nPixels  = size_t(width) * size_t(height);
+    const GLint   stride   = std::max(1, (int)std::ceil(std::sqrt(double(nPixels) / HISTOGRAM_MAX_SAMPLES)));
+    const GLsizei sampledW = (width + stride - 1) / stride;
+    const GLsizei sampledH = (height + stride - 1) / stride;
+
+    glBindTexture(GL_TEXTURE_2D, texture);
+
+    glBindFramebuffer(GL_FRAMEBUFFER, _fbo_histogram);
+    glViewport(0, 0, BINS, 1);
+
+    glClearColor(0.f, 0.f, 0.f, 0.f);
+    glClear(GL_COLOR_BUFFER_BIT);
+
+    glEnable(GL_BLEND);
+    glBlendFunc(GL_ONE, GL_ONE);
+
+    glUseProgram(_histogramProgram->get());
+    glUniform4i(_loc_histogramRegion, x, y, width, height);
+    glUniform1i(_loc_stride, stride);
+    glUniform2i(_loc_sampledSize, sampledW, sampledH);
+    glUniform2f(_loc_log2Range, LOG2_MIN, LOG2_MAX);
+    glUniform1i(_loc_nBins, BINS);
+
+    glDrawArrays(GL_POINTS, 0, sampledW * sampledH);
+
+    glDisable(GL_BLEND);
+
+    glBindFramebuffer(GL_FRAMEBUFFER, 0);
+    glBindTexture(GL_TEXTURE_2D, 0);
+    glBindVertexArray(0);
+    glUseProgram(0);
+
+    // The top of the mip chain is a single texel
+    const GLint topLevel = (GLint)std::log2(REDUCTION_SIZE);
+
+    _averageReadback.request(_tex_log, -1, 0, 0, 1, 1, 2, 0, topLevel);
+    _histogramReadback.request(_tex_histogram, -1, 0, 0, BINS, 1, 1, 0);
+
+    return true;
+}
+
+
+bool ExposureMeter::poll()
+{
+    const bool averageUpdated   = _averageReadback.poll();
+    const bool histogramUpdated = _histogramReadback.poll();
+
+    if (histogramUpdated) {
+        _histogram = _histogramReadback.result();
+    }
+
+    if (averageUpdated) {
+        // Mean of the log sums over the mean share of valid taps
+        const std::vector<float> &value = _averageReadback.result();
+
+        _hasResult = value[1] > 0.f;
+
+        if (_hasResult) {
+            _log2Average = value[0] / value[1];
+        }
+    }
+
+    return averageUpdated || histogramUpdated;
+}
+
+
+float ExposureMeter::log2Percentile(float fraction) const
+{
+    const float total = std::accumulate(_histogram.begin(), _histogram.end(), 0.f);
+
+    if (total <= 0.f) {
+        return _log2Average;
+    }
+
+    float cumulated = 0.f;
+
+    for (size_t b = 0; b < _histogram.size(); b++) {
+        const float next = cumulated + _histogram[b];
+
+        if (next >= fraction * total) {
+            // Linear interpolation within the bin
+            const float t = _histogram[b] > 0.f ? (fraction * total - cumulated) / _histogram[b] : 0.f;
+
+            return LOG2_MIN + (LOG2_MAX - LOG2_MIN) * (b + t) / BINS;
+        }
+
+        cumulated = next;
+    }
+
+    return LOG2_MAX;
+}
@@ -0,0 +1,78 @@
+#pragma once
+
+#include "PixelReadback.h"
+
+#include <Shader.h>
+
+#include <GL/glew.h>
+
+#include <cstddef>
+#include <memory>
+#include <vector>
+
+
+// Luminance statistics of a region of a linear RGB texture, for automatic
+// exposure. The log2 luminance of the region is resampled to a square
+// REDUCTION_SIZE texture whose mip chain reduces it to the log-average. The
+// percentiles come from a histogram of the pixels themselves, sampled on a
+// grid of at most HISTOGRAM_MAX_SAMPLES: the reduction would average small
+// highlights away. Only the top mip and the histogram are read back,
+// asynchronously.
+class ExposureMeter
+{
+  public:
+    ExposureMeter();
+
+    virtual ~ExposureMeter();
+
+    void initGL();
+
+    // Queues the metering of [x, x + width) x [y, y + height) of the texture,
+    // returns false while the previous metering is being read back
+    bool meter(GLuint texture, int x, int y, int width, int height);
+
+    // Collects the results without blocking, to be called once per frame.
+    // Returns true when new results are available.
+    bool poll();
+
+    bool isPending() const { return _averageReadback.isPending() || _histogramReadback.isPending(); }
+
+    // False when the region had no positive finite luminance
+    bool hasResult() const { return _hasResult; }
+
+    float log2Average() const { return _log2Average; }
+
+    // log2 of the luminance under which the given fraction of the region is
+    float log2Percentile(float fraction) const;
+
+    static const size_t REDUCTION_SIZE = 256;
+    static const size_t BINS           = 256;
+
+    static const size_t HISTOGRAM_MAX_SAMPLES = size_t(1) << 22;
+
+    static constexpr float LOG2_MIN = -24.f;
+    static constexpr float LOG2_MAX = 8.f;
+
+  private:
+    std::unique_ptr<Shader> _logProgram;
+    std::unique_ptr<Shader> _histogramProgram;
+
+    GLint _loc_region;
+    GLint _loc_reductionSize;
+    GLint _loc_histogramRegion;
+    GLint _loc_stride;
+    GLint _loc_sampledSize;
+    GLint _loc_log2Range;
+    GLint _loc_nBins;
+
+    GLuint _vao;
+    GLuint _fbo_log, _tex_log;
+    GLuint _fbo_histogram, _tex_histogram;
+
+    PixelReadback _averageReadback;
+    PixelReadback _histogramReadback;
+
+    float              _log2Average;
+    std::vector<float> _histogram;
+    bool               _hasResult;
+};
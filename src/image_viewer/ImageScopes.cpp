@@ -0,0 +1,229 @@
+#include "ImageScopes.h"
+
+#include "Trace.h"
+
+#include <spectral/SpectralConverter.h>
+
+#include <algorithm>
+#include <cmath>
+
+
+ImageScopes::ImageScopes()
+    : _program(nullptr)
+    , _vao(0)
+    , _fbo_histograms(0)
+    , _tex_histograms(0)
+    , _fbo_waveform(0)
+    , _tex_waveform(0)
+    // A single read in flight keeps both results consistent
+    , _histogramReadback(1)
+    , _waveformReadback(1)
+{
+}
+
+
+ImageScopes::~ImageScopes()
+{
+    glDeleteVertexArrays(1, &_vao);
+    glDeleteFramebuffers(1, &_fbo_histograms);
+    glDeleteTextures(1, &_tex_histograms);
+    glDeleteFramebuffers(1, &_fbo_waveform);
+    glDeleteTextures(1, &_tex_waveform);
+}
+
+
+void ImageScopes::initGL()
+{
+    _program = std::unique_ptr<Shader>(new Shader("glsl/scopes.vert", "glsl/scopes.frag"));
+
+    const GLuint programId = _program->get();
+
+    _loc_waveform    = glGetUniformLocation(programId, "waveform");
+    _loc_stride      = glGetUniformLocation(programId, "stride");
+    _loc_sampledSize = glGetUniformLocation(programId, "sampledSize");
+    _loc_log2Range   = glGetUniformLocation(programId, "log2Range");
+    _loc_nBins       = glGetUniformLocation(programId, "nBins");
+    _loc_nColumns    = glGetUniformLocation(programId, "nColumns");
+
+    glUseProgram(programId);
+    glUniform1i(glGetUniformLocation(programId, "image"), 0);
+    glUseProgram(0);
+
+    // Points are generated from the vertex index only
+    glGenVertexArrays(1, &_vao);
+
+    auto createTarget = [](GLuint &fbo, GLuint &texture, GLsizei width, GLsizei height) {
+        glGenTextures(1, &texture);
+        glBindTexture(GL_TEXTURE_2D, texture);
+
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+        glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA32F, width, height, 0, GL_RGBA, GL_FLOAT, nullptr);
+
+        glGenFramebuffers(1, &fbo);
+        glBindFramebuffer(GL_FRAMEBUFFER, fbo);
+        glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, texture, 0);
+    };
+
+    createTarget(_fbo_histograms, _tex_histograms, BINS, 1);
+    createTarget(_fbo_waveform, _tex_waveform, WAVEFORM_COLUMNS, BINS);
+
+    glBindFramebuffer(GL_FRAMEBUFFER, 0);
+    glBindTexture(GL_TEXTURE_2D, 0);
+
+    _histogramReadback.initGL();
+    _waveformReadback.initGL();
+}
+
+
+bool ImageScopes::computeGPU(GLuint texture, unsigned int width, unsigned int height)
+{
+    if (isPending() || width == 0 || height == 0) {
+        return false;
+    }
+
+    TRACE_SCOPE("Scopes pass", "render");
+
+    const unsigned int stride   = sampleStride(width, height);
+    const GLsizei      sampledW = (width + stride - 1) / stride;
+    const GLsizei      sampledH = (height + stride - 1) / stride;
+
+    glUseProgram(_program->get());
+    glUniform1i(_loc_stride, stride);
+    glUniform2i(_loc_sampledSize, sampledW, sampledH);
+    glUniform2f(_loc_log2Range, LOG2_MIN, LOG2_MAX);
+    glUniform1i(_loc_nBins, BINS);
+    glUniform1i(_loc_nColumns, WAVEFORM_COLUMNS);
+
+    glActiveTexture(GL_TEXTURE0);
+    glBindTexture(GL_TEXTURE_2D, texture);
+    glBindVertexArray(_vao);
+
+    glEnable(GL_BLEND);
+    glBlendFunc(GL_ONE, GL_ONE);
+    glClearColor(0.f, 0.f, 0.f, 0.f);
+
+    // Histograms: a point per channel and luminance of each sample
+    glBindFramebuffer(GL_FRAMEBUFFER, _fbo_histograms);
+    glViewport(0, 0, BINS, 1);
+    glClear(GL_COLOR_BUFFER_BIT);
+
+    glUniform1i(_loc_waveform, 0);
+    glDrawArrays(GL_POINTS, 0, 4 * sampledW * sampledH);
+
+    // Waveform: a point per sample
+    glBindFramebuffer(GL_FRAMEBUFFER, _fbo_waveform);
+    glViewport(0, 0, WAVEFORM_COLUMNS, BINS);
+    glClear(GL_COLOR_BUFFER_BIT);
+
+    glUniform1i(_loc_waveform, 1);
+    glDrawArrays(GL_POINTS, 0, sampledW * sampledH);
+
+    glDisable(GL_BLEND);
+
+    glBindFramebuffer(GL_FRAMEBUFFER, 0);
+    glBindTexture(GL_TEXTURE_2D, 0);
+    glBindVertexArray(0);
+    glUseProgram(0);
+
+    _histogramReadback.request(_tex_histograms, -1, 0, 0, BINS, 1, 4, 0);
+    _waveformReadback.request(_tex_waveform, -1, 0, 0, WAVEFORM_COLUMNS, BINS, 1, 0);
+
+    return true;
+}
+
+
+void ImageScopes::computeCPU(const float *rgba, size_t width, size_t height, int nThreads)
+{
+    if (nThreads <= 0) {
+        nThreads = SpectralConverter::maxThreads();
+    }
+
+    TRACE_SCOPE("Scopes", "stats");
+
+    const unsigned int stride   = sampleStride(width, height);
+    const long         sampledH = (long)((height + stride - 1) / stride);
+
+    _histograms.assign(4 * BINS, 0.f);
+    _waveform.assign(WAVEFORM_COLUMNS * BINS, 0.f);
+
+    auto bin = [](float value, size_t &b) {
+        if (!(value > 0.f) || std::isinf(value)) {
+            return false;
+        }
+
+        const float t = (std::log2(value) - LOG2_MIN) / (LOG2_MAX - LOG2_MIN);
+
+        b = (size_t)std::max(0.f, std::min(std::floor(t * BINS), float(BINS - 1)));
+
+        return true;
+    };
+
+#pragma omp parallel num_threads(nThreads)
+    {
+        // Integer counts, merged once
+        std::vector<uint32_t> histograms(4 * BINS, 0);
+        std::vector<uint32_t> waveform(WAVEFORM_COLUMNS * BINS, 0);
+
+#pragma omp for schedule(static) nowait
+        for (long sy = 0; sy < sampledH; sy++) {
+            const size_t y = sy * stride;
+
+            for (size_t x = 0; x < width; x += stride) {
+                const float *px = &rgba[4 * (y * width + x)];
+
+                const float luminance = 0.2126f * px[0] + 0.7152f * px[1] + 0.0722f * px[2];
+                const float values[4] = {px[0], px[1], px[2], luminance};
+
+                size_t b;
+
+                for (size_t c = 0; c < 4; c++) {
+                    if (bin(values[c], b)) {
+                        histograms[4 * b + c]++;
+                    }
+                }
+
+                if (bin(luminance, b)) {
+                    waveform[WAVEFORM_COLUMNS * b + x * WAVEFORM_COLUMNS / width]++;
+                }
+            }
+        }
+
+#pragma omp critical
+        {
+            for (size_t i = 0; i < histograms.size(); i++) {
+                _histograms[i] += histograms[i];
+            }
+
+            for (size_t i = 0; i < waveform.size(); i++) {
+                _waveform[i] += waveform[i];
+            }
+        }
+    }
+}
+
+
+bool ImageScopes::poll()
+{
+    const bool histogramsUpdated = _histogramReadback.poll();
+    const bool waveformUpdated   = _waveformReadback.poll();
+
+    if (histogramsUpdated) {
+        _histograms = _histogramReadback.result();
+    }
+
+    if (waveformUpdated) {
+        // Counts are in the red channel of the RGBA target
+        _waveform = _waveformReadback.result();
+    }
+
+    return histogramsUpdated || waveformUpdated;
+}
+
+
+unsigned int ImageScopes::sampleStride(size_t width, size_t height)
+{
+    const double nPixels = double(width) * double(height);
+
+    return std::max(1u, (unsigned int)std::ceil(std::sqrt(nPixels / MAX_SAMPLES)));
+}
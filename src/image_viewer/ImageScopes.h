@@ -0,0 +1,88 @@
+#pragma once
+
+#include "PixelReadback.h"
+
+#include <Shader.h>
+
+#include <GL/glew.h>
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+
+// Histograms and waveform monitor of a linear RGB image. Values are binned
+// by their log2 over [LOG2_MIN, LOG2_MAX], so a change of exposure only
+// shifts the bins: the scopes are only computed again when the image
+// changes. Non positive and non finite values are ignored.
+//
+// The GPU path scatters one point per sample into the bins with additive
+// blending and reads the bins back asynchronously. The CPU path bins the
+// samples with all the cores.
+class ImageScopes
+{
+  public:
+    ImageScopes();
+
+    virtual ~ImageScopes();
+
+    void initGL();
+
+    // Queues the binning of a width x height RGBA texture, returns false when
+    // the previous results are still being read back
+    bool computeGPU(GLuint texture, unsigned int width, unsigned int height);
+
+    // Bins a row ordered RGBA image. When nThreads is 0, all the available
+    // cores are used.
+    void computeCPU(const float *rgba, size_t width, size_t height, int nThreads = 0);
+
+    // Collects the GPU results without blocking, to be called once per
+    // frame. Returns true when new results are available.
+    bool poll();
+
+    bool isPending() const { return _histogramReadback.isPending() || _waveformReadback.isPending(); }
+
+    bool hasResults() const { return !_histograms.empty() && !_waveform.empty(); }
+
+    // Red, green, blue and luminance counts, interleaved per bin
+    const std::vector<float> &histograms() const { return _histograms; }
+
+    // Luminance counts per column of the image, row ordered from the first
+    // bin: waveform[WAVEFORM_COLUMNS * bin + column]
+    const std::vector<float> &waveform() const { return _waveform; }
+
+    static float binLog2(size_t bin) { return LOG2_MIN + (LOG2_MAX - LOG2_MIN) * bin / BINS; }
+
+    static const size_t BINS             = 256;
+    static const size_t WAVEFORM_COLUMNS = 256;
+
+    static constexpr float LOG2_MIN = -24.f;
+    static constexpr float LOG2_MAX = 8.f;
+
+    // Images are sampled on a regular grid of at most this many pixels
+    static const size_t MAX_SAMPLES = size_t(1) << 22;
+
+  private:
+    // Sampling step keeping the number of samples under MAX_SAMPLES
+    static unsigned int sampleStride(size_t width, size_t height);
+
+    std::unique_ptr<Shader> _program;
+
+    GLint _loc_waveform;
+    GLint _loc_stride;
+    GLint _loc_sampledSize;
+    GLint _loc_log2Range;
+    GLint _loc_nBins;
+    GLint _loc_nColumns;
+
+    GLuint _vao;
+    GLuint _fbo_histograms, _tex_histograms;
+    GLuint _fbo_waveform, _tex_waveform;
+
+    PixelReadback _histogramReadback;
+    PixelReadback _waveformReadback;
+
+    std::vector<float> _histograms;
+    std::vector<float> _waveform;
+};
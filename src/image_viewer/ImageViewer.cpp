@@ -1,10 +1,12 @@
 #include "ImageViewer.h"
 
 #include "Util.h"
+#include "Trace.h"
 
 #include <glm/gtc/type_ptr.hpp>
 #include <imgui/imgui.h>
 
+#include <algorithm>
 #include <exception>
 #include <vector>
 
@@ -13,10 +15,14 @@ ImageViewer::ImageViewer()
     : _vbo(0)
     , _ebo(0)
     , _vao(0)
+    , _imageViewerInTexture(0)
     // GUI
     , _showViewControl(true)
     , _showColorControl(true)
     , _showInspector(true)
+    // Mouse control
+    , _mouseOverX(-1)
+    , _mouseOverY(-1)
     // Image transformation
     , _zoom(1.f)
     , _zoomMatrix(glm::mat3(1.f))
@@ -27,12 +33,23 @@ ImageViewer::ImageViewer()
     , _sRGBGamma(true)
     , _grayGamma(true)
     , _gamma(2.2f)
+    , _displayColormap(0)
+    , _displayColormapRange(0.f, 1.f)
+    , _colorAtMousePosition {0.f, 0.f, 0.f, 0.f}
+    , _xImageMouseOver(-1)
+    , _yImageMouseOver(-1)
+    , _readbackUpdated(false)
     // Image display
     , _shaderProgram(nullptr)
     , _imageWidth(0)
     , _imageHeight(0)
     , _windowWidth(0)
     , _windowHeight(0)
+    , _inputGeneration(0)
+    , _hasDrawnState(false)
+    , _colorRequestX(-1)
+    , _colorRequestY(-1)
+    , _colorRequestGeneration(0)
     // Internal use for GUI
     , _windowSizeSet(false)
     , _imageSizeSet(false)
@@ -46,9 +63,6 @@ ImageViewer::~ImageViewer()
     glDeleteBuffers(1, &_vbo);
     glDeleteVertexArrays(1, &_vao);
     glDeleteTextures(1, &_imageViewerInTexture);
-
-    glDeleteFramebuffers(1, &_imageViewerFBO);
-    glDeleteTextures(1, &_imageViewerOutTexture);
 }
 
 
@@ -58,6 +72,8 @@ ImageViewer::~ImageViewer()
 
 void ImageViewer::gui()
 {
+    _readbackUpdated = false;
+
     // TODO: change to independent class & windows
     if (_showViewControl) {
         ImGui::SeparatorText("View");
@@ -134,14 +150,20 @@ void ImageViewer::gui_inspectorTool()
         ImGui::Text("x: %d, y: %d", posImageX, posImageY);
     }
 
-    // ImGui::Text("x: %d, y: %d", _xImageMouseOver, _yImageMouseOver);
-
-    // if (   _xImageMouseOver >= 0 && _xImageMouseOver < _imageWidth
-    //     && _yImageMouseOver >= 0 && _yImageMouseOver < _imageHeight) {
-    //     // Color
-    //     ImGui::Text("R: %f, G: %f, B: %f", _colorAtMousePosition[0], _colorAtMousePosition[1], _colorAtMousePosition[2]);
-    //     ImGui::InputFloat3("Raw Color", _colorAtMousePosition);
-    // }
+    // Read back asynchronously, the value may belong to a pixel the mouse
+    // just left
+    if (_colorReadback.hasResult()
+        && _xImageMouseOver >= 0 && _xImageMouseOver < _imageWidth
+        && _yImageMouseOver >= 0 && _yImageMouseOver < _imageHeight) {
+        ImGui::Text(
+            "RGB (%d, %d): %g, %g, %g",
+            _xImageMouseOver,
+            _yImageMouseOver,
+            _colorAtMousePosition[0],
+            _colorAtMousePosition[1],
+            _colorAtMousePosition[2]);
+        ImGui::TextDisabled("Read back after %u frame(s)", _colorReadback.resultLatency());
+    }
 }
 
 
@@ -164,6 +186,8 @@ void ImageViewer::menuImageTools()
 
 void ImageViewer::initGL()
 {
+    TRACE_SCOPE("ImageViewer::initGL", "load");
+
     // ------------------------------------------------------------------------
     // Shader management
     // ------------------------------------------------------------------------
@@ -177,8 +201,19 @@ void ImageViewer::initGL()
     _loc_translateMatrix = glGetUniformLocation(shaderId, "translateMatrix");
 
     _loc_exposure  = glGetUniformLocation(shaderId, "exposure");
-    _loc_sRGBGamma = glGetUniformLocation(shaderId, "sRGBGamma");
-    _loc_gamma     = glGetUniformLocation(shaderId, "gamma");
+    _loc_sRGBGamma    = glGetUniformLocation(shaderId, "sRGBGamma");
+    _loc_hardwareSRGB = glGetUniformLocation(shaderId, "hardwareSRGB");
+    _loc_gamma        = glGetUniformLocation(shaderId, "gamma");
+
+    _loc_falseColor      = glGetUniformLocation(shaderId, "falseColor");
+    _loc_falseColorRange = glGetUniformLocation(shaderId, "falseColorRange");
+
+    // The display pass targets framebuffers shown top row first, other
+    // passes keep the OpenGL convention
+    glUseProgram(shaderId);
+    glUniform1i(glGetUniformLocation(shaderId, "flipY"), 1);
+    glUniform1i(glGetUniformLocation(shaderId, "colormap"), 1);
+    glUseProgram(0);
 
     // ------------------------------------------------------------------------
     // Geometry management
@@ -241,87 +276,151 @@ void ImageViewer::initGL()
 
     glBindTexture(GL_TEXTURE_2D, 0);
 
-    // ------------------------------------------------------------------------
-    // Main FBO
-    // ------------------------------------------------------------------------
-
-    glGenTextures(1, &_imageViewerOutTexture);
-    glBindTexture(GL_TEXTURE_2D, _imageViewerOutTexture);
-    glTexImage2D(
-        GL_TEXTURE_2D,
-        0,
-        GL_RGBA32F,
-        _windowWidth,
-        _windowHeight,
-        0,
-        GL_RGBA,
-        GL_FLOAT,
-        nullptr);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
-
-    glGenFramebuffers(1, &_imageViewerFBO);
-    glBindFramebuffer(GL_FRAMEBUFFER, _imageViewerFBO);
+    _colorReadback.initGL();
+}
 
-    glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, _imageViewerOutTexture, 0);
 
-    glBindFramebuffer(GL_FRAMEBUFFER, 0);
-    glBindTexture(GL_TEXTURE_2D, 0);
+void ImageViewer::render()
+{
+    // The input texture is ready for display
+    updateColorReadback();
 }
 
 
-void ImageViewer::render()
+void ImageViewer::draw(bool framebufferSRGB)
 {
-    glBindFramebuffer(GL_FRAMEBUFFER, _imageViewerFBO);
-    glViewport(0, 0, _windowWidth, _windowHeight);
-    glClear(GL_COLOR_BUFFER_BIT);
+    TRACE_SCOPE("Display pass", "render");
+
+    const DisplayState state = displayState(framebufferSRGB);
+
+    if (state.hardwareSRGB) {
+        glEnable(GL_FRAMEBUFFER_SRGB);
+    }
 
     glUseProgram(_shaderProgram->get());
 
-    glUniformMatrix3fv(_loc_zoomMatrix, 1, GL_FALSE, glm::value_ptr(_zoomMatrix));
-    glUniformMatrix3fv(_loc_aspectMatrix, 1, GL_FALSE, glm::value_ptr(_aspectMatrix));
-    glUniformMatrix3fv(_loc_translateMatrix, 1, GL_FALSE, glm::value_ptr(_translateMatrix));
-    glUniform1f(_loc_exposure, _exposure);
-    glUniform1i(_loc_sRGBGamma, _sRGBGamma);
-    glUniform3fv(_loc_gamma, 1, glm::value_ptr(_gamma));
+    // The program belongs to this viewer: uniforms keep their values
+    if (!_hasDrawnState || !(state == _drawnState)) {
+        glUniformMatrix3fv(_loc_zoomMatrix, 1, GL_FALSE, glm::value_ptr(state.zoomMatrix));
+        glUniformMatrix3fv(_loc_aspectMatrix, 1, GL_FALSE, glm::value_ptr(state.aspectMatrix));
+        glUniformMatrix3fv(_loc_translateMatrix, 1, GL_FALSE, glm::value_ptr(state.translateMatrix));
+        glUniform1f(_loc_exposure, state.exposure);
+        glUniform1i(_loc_sRGBGamma, state.sRGBGamma);
+        glUniform1i(_loc_hardwareSRGB, state.hardwareSRGB);
+        glUniform3fv(_loc_gamma, 1, glm::value_ptr(state.gamma));
+        glUniform1i(_loc_falseColor, state.colormap != 0);
+        glUniform2fv(_loc_falseColorRange, 1, glm::value_ptr(state.colormapRange));
+
+        _drawnState    = state;
+        _hasDrawnState = true;
+    }
+
+    if (state.colormap) {
+        glActiveTexture(GL_TEXTURE1);
+        glBindTexture(GL_TEXTURE_1D, state.colormap);
+    }
 
     glActiveTexture(GL_TEXTURE0);
-    glBindTexture(GL_TEXTURE_2D, _imageViewerInTexture);
+    glBindTexture(GL_TEXTURE_2D, state.texture);
     glBindVertexArray(_vao);
 
     glDrawElements(GL_TRIANGLES, 6, GL_UNSIGNED_INT, 0);
 
+    glBindTexture(GL_TEXTURE_2D, 0);
 
-    // // to NDC
-    // glm::vec3 pos = glm::vec3(
-    //     2.f * (float)_mouseOverX/(float)_windowWidth - 1.f,
-    //     2.f * (float)_mouseOverY/(float)_windowHeight - 1.f,
-    //     1.);
+    if (state.colormap) {
+        glActiveTexture(GL_TEXTURE1);
+        glBindTexture(GL_TEXTURE_1D, 0);
+        glActiveTexture(GL_TEXTURE0);
+    }
 
-    // glm::mat3 transform = _aspectMatrix * _translateMatrix * _zoomMatrix;
-    // glm::vec3 pos_s = glm::inverse(transform) * pos;
+    glBindVertexArray(0);
+    glUseProgram(0);
 
-    // // NDC to 0..1
-    // glm::vec2 coordsImage = glm::vec2(pos_s.x, pos_s.y)/pos_s.z;
-    // coordsImage = (coordsImage + glm::vec2(1.f))/2.f;
-    // coordsImage *= glm::vec2(_imageWidth, _imageHeight);
+    if (state.hardwareSRGB) {
+        glDisable(GL_FRAMEBUFFER_SRGB);
+    }
+}
 
-    // _xImageMouseOver = (int)std::round(coordsImage.x);
-    // _yImageMouseOver = (int)std::round(coordsImage.y);
 
-    // glReadPixels(_xImageMouseOver, _yImageMouseOver, 1, 1, GL_RGBA, GL_FLOAT, _colorAtMousePosition);
+void ImageViewer::updateColorReadback()
+{
+    if (_colorReadback.poll()) {
+        const std::vector<float> &rgba = _colorReadback.result();
 
+        std::copy(rgba.begin(), rgba.end(), _colorAtMousePosition);
+        _xImageMouseOver = PixelReadback::tagX(_colorReadback.resultTag());
+        _yImageMouseOver = PixelReadback::tagY(_colorReadback.resultTag());
 
-    glBindTexture(GL_TEXTURE_2D, 0);
-    glBindVertexArray(0);
-    glUseProgram(0);
-    glBindFramebuffer(GL_FRAMEBUFFER, 0);
+        _readbackUpdated = true;
+    }
+
+    int x, y;
+
+    if (!mouseImagePixel(x, y)) {
+        return;
+    }
+
+    // Already requested, unless the content changed since
+    if (x == _colorRequestX && y == _colorRequestY && _colorRequestGeneration == _inputGeneration) {
+        return;
+    }
+
+    // Both image and window aligned textures have their first row at the top
+    const GLint texelX = isDisplayTextureWindowAligned() ? _mouseOverX : x;
+    const GLint texelY = isDisplayTextureWindowAligned() ? _mouseOverY : y;
+
+    // Retried next frame when all the buffers are in flight
+    if (_colorReadback.request(displayTexture(), -1, texelX, texelY, 1, 1, 4, PixelReadback::pixelTag(x, y))) {
+        _colorRequestX          = x;
+        _colorRequestY          = y;
+        _colorRequestGeneration = _inputGeneration;
+    }
+}
+
+
+ImageViewer::DisplayState ImageViewer::displayState(bool framebufferSRGB) const
+{
+    DisplayState state;
+
+    // Window aligned textures are drawn as is
+    if (isDisplayTextureWindowAligned()) {
+        state.zoomMatrix      = glm::mat3(1.f);
+        state.aspectMatrix    = glm::mat3(1.f);
+        state.translateMatrix = glm::mat3(1.f);
+    } else {
+        state.zoomMatrix      = _zoomMatrix;
+        state.aspectMatrix    = _aspectMatrix;
+        state.translateMatrix = _translateMatrix;
+    }
+
+    state.exposure  = _exposure;
+    state.sRGBGamma = _sRGBGamma;
+    // A custom gamma is applied by the shader, the hardware encoding would
+    // come on top of it
+    state.hardwareSRGB = framebufferSRGB && _sRGBGamma;
+    state.gamma        = _gamma;
+    state.texture      = displayTexture();
+
+    state.colormap      = _displayColormap;
+    state.colormapRange = _displayColormapRange;
+
+    return state;
 }
 
 
-GLuint ImageViewer::getTexture() const
+bool ImageViewer::DisplayState::operator==(const DisplayState &other) const
 {
-    return _imageViewerOutTexture;
+    return zoomMatrix == other.zoomMatrix
+           && aspectMatrix == other.aspectMatrix
+           && translateMatrix == other.translateMatrix
+           && exposure == other.exposure
+           && sRGBGamma == other.sRGBGamma
+           && hardwareSRGB == other.hardwareSRGB
+           && gamma == other.gamma
+           && texture == other.texture
+           && colormap == other.colormap
+           && colormapRange == other.colormapRange;
 }
 
 
@@ -338,20 +437,6 @@ void ImageViewer::resizeWindow(unsigned int width, unsigned int height)
         _windowHeight = height;
 
         updateAspect();
-
-        // Resize FBO's texture
-        glBindTexture(GL_TEXTURE_2D, _imageViewerOutTexture);
-        glTexImage2D(
-            GL_TEXTURE_2D,
-            0,
-            GL_RGBA32F,
-            _windowWidth,
-            _windowHeight,
-            0,
-            GL_RGBA,
-            GL_FLOAT,
-            nullptr);
-        glBindTexture(GL_TEXTURE_2D, 0);
     }
 }
 
@@ -494,6 +579,35 @@ void ImageViewer::setFitView()
 }
 
 
+void ImageViewer::copyView(const ImageViewer &other)
+{
+    _zoom                = other._zoom;
+    _zoomMatrix          = other._zoomMatrix;
+    _translateMatrix     = other._translateMatrix;
+    _prevTranslateMatrix = other._prevTranslateMatrix;
+
+    if (other._windowSizeSet) {
+        resizeWindow(other._windowWidth, other._windowHeight);
+    }
+}
+
+
+bool ImageViewer::mouseImagePixel(int &x, int &y) const
+{
+    if (_mouseOverX < 0 || _mouseOverX >= (int)_windowWidth
+        || _mouseOverY < 0 || _mouseOverY >= (int)_windowHeight) {
+        return false;
+    }
+
+    const glm::vec2 posImage = windowToImage(glm::vec2(_mouseOverX, _mouseOverY));
+
+    x = (int)std::floor(posImage.x);
+    y = (int)std::floor(posImage.y);
+
+    return x >= 0 && x < (int)_imageWidth && y >= 0 && y < (int)_imageHeight;
+}
+
+
 glm::vec2 ImageViewer::windowToImage(const glm::vec2 &windowCoords) const
 {
     // Window coordinates to Normalized Device Coordiantes (NDC)
@@ -516,14 +630,17 @@ glm::vec2 ImageViewer::windowToImage(const glm::vec2 &windowCoords) const
 
 glm::vec2 ImageViewer::imageToWindow(const glm::vec2 &imageCoords) const
 {
-    // Image coordinates to vertex coordinates
-    const glm::vec2 vertPos = 2.f * imageCoords / glm::vec2(_imageWidth - 1, _imageHeight - 1)
-                              - glm::vec2(1.f);
+    // Image coordinates to texture coordinates
+    const glm::vec2 uvCoords = imageCoords / glm::vec2(_imageWidth, _imageHeight);
+
+    // Vertex position from the texture coordinates
+    const glm::vec3 vertPos = glm::vec3(2.f * uvCoords - glm::vec2(1.f), 1.f);
 
     // Transformation chain applied in vertex shader
     const glm::mat3 transformation = _aspectMatrix * _translateMatrix * _zoomMatrix;
 
-    const glm::vec3 ndc = transformation * glm::vec3(vertPos, 1.f);
+    const glm::vec3 ndc = transformation * vertPos;
 
-    // const glm::vec3 windowCoords = ndc
-}
\ No newline at end of file
+    // Normalized Device Coordinates to window coordinates
+    return (glm::vec2(ndc.x, ndc.y) / ndc.z + glm::vec2(1.f)) / 2.f * glm::vec2(_windowWidth - 1, _windowHeight - 1);
+}
@@ -1,13 +1,17 @@
 #pragma once
 
+#include "PixelReadback.h"
+
 #include <Shader.h>
 
 #include <GL/glew.h>
 
 #include <glm/glm.hpp>
 
+#include <cstdint>
 #include <memory>
 
+struct ImDrawList;
 
 class ImageViewer
 {
@@ -39,9 +43,24 @@ class ImageViewer
 
     virtual void initGL();
 
+    // Offscreen passes, to be called before draw()
     virtual void render();
 
-    virtual GLuint getTexture() const;
+    // Display pass: draws the image with the view transformation, exposure
+    // and gamma to the bound framebuffer, in the current viewport. On sRGB
+    // capable framebuffers, the sRGB encoding is left to the hardware.
+    virtual void draw(bool framebufferSRGB = false);
+
+    // GUI primitives drawn over the image, origin being the screen position
+    // of the top left corner of the window
+    virtual void drawOverlay(ImDrawList *drawList, const glm::vec2 &origin) {}
+
+    // Work is left for the next frames even without user input
+    virtual bool needsRedraw() const { return _colorReadback.isPending() || _readbackUpdated; }
+
+    // The displayed result is still being produced over several frames.
+    // Unlike needsRedraw(), becomes false without any GUI frame.
+    virtual bool isConverting() const { return false; }
 
     virtual void resizeWindow(unsigned int width, unsigned int height);
     virtual void resizeImage(unsigned int width, unsigned int height);
@@ -57,6 +76,9 @@ class ImageViewer
     unsigned int imageWidth() const { return _imageWidth; }
     unsigned int imageHeight() const { return _imageHeight; }
 
+    unsigned int windowWidth() const { return _windowWidth; }
+    unsigned int windowHeight() const { return _windowHeight; }
+
     // ------------------------------------------------------------------------
     // Utility functions
     // ------------------------------------------------------------------------
@@ -73,12 +95,33 @@ class ImageViewer
 
     void setAbsoluteZoom(float zoom);
 
+    float getExposure() const { return _exposure; }
+    void  setExposure(float exposure) { _exposure = exposure; }
+
     void setFitView();
 
+    // Same zoom and pan as another viewer of an image of the same size
+    void copyView(const ImageViewer &other);
+
     glm::vec2 windowToImage(const glm::vec2 &windowCoords) const;
     glm::vec2 imageToWindow(const glm::vec2 &imageCoords) const;
 
   protected:
+    // Texture sampled by the display pass. Window aligned textures are
+    // displayed as is, without the view transformation.
+    virtual GLuint displayTexture() const { return _imageViewerInTexture; }
+    virtual bool   isDisplayTextureWindowAligned() const { return false; }
+
+    // To be called when the content of the displayed texture is modified
+    void markInputChanged() { _inputGeneration++; }
+
+    // Changes each time the content of the displayed texture is modified
+    uint64_t inputGeneration() const { return _inputGeneration; }
+
+    // Image pixel under the mouse, false when the mouse is outside of the
+    // image or of the window
+    bool mouseImagePixel(int &x, int &y) const;
+
     GLuint _vbo, _ebo, _vao;
     GLuint _imageViewerInTexture;
 
@@ -105,10 +148,42 @@ class ImageViewer
     bool      _grayGamma;
     glm::vec3 _gamma;
 
+    // 1D colormap applied by the display pass to the red channel of the
+    // displayed texture, none when 0
+    GLuint    _displayColormap;
+    glm::vec2 _displayColormapRange;
+
+    // Displayed color read back from the GPU, lagging a few frames behind
+    // the mouse
     float _colorAtMousePosition[4];
     int   _xImageMouseOver, _yImageMouseOver;
 
+    // A read back value arrived since the last GUI update
+    bool _readbackUpdated;
+
   private:
+    // Uniforms and texture of the display pass
+    struct DisplayState {
+        glm::mat3 zoomMatrix;
+        glm::mat3 aspectMatrix;
+        glm::mat3 translateMatrix;
+        float     exposure;
+        bool      sRGBGamma;
+        bool      hardwareSRGB;
+        glm::vec3 gamma;
+        GLuint    texture;
+        GLuint    colormap;
+        glm::vec2 colormapRange;
+
+        bool operator==(const DisplayState &other) const;
+    };
+
+    DisplayState displayState(bool framebufferSRGB) const;
+
+    // Collects the last color read back and queues a read at the mouse
+    // position, never waits for the GPU
+    void updateColorReadback();
+
     std::unique_ptr<Shader> _shaderProgram;
 
     // Image transformation
@@ -119,14 +194,25 @@ class ImageViewer
     // Color control
     GLuint _loc_exposure;
     GLuint _loc_sRGBGamma;
+    GLuint _loc_hardwareSRGB;
     GLuint _loc_gamma;
+    GLuint _loc_falseColor;
+    GLuint _loc_falseColorRange;
 
     unsigned int _imageWidth, _imageHeight;
     unsigned int _windowWidth, _windowHeight;
 
-    // Framebuffer
-    GLuint _imageViewerFBO;
-    GLuint _imageViewerOutTexture;
+    // Change tracking, uniforms are only sent when the state changes. The
+    // pass itself runs each frame: it draws to the default framebuffer,
+    // redrawn with the GUI.
+    uint64_t     _inputGeneration;
+    DisplayState _drawnState;
+    bool         _hasDrawnState;
+
+    // Color under the mouse
+    PixelReadback _colorReadback;
+    int           _colorRequestX, _colorRequestY;
+    uint64_t      _colorRequestGeneration;
 
     // Internal use for GUI
     bool _windowSizeSet;
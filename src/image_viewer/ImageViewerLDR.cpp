@@ -6,10 +6,14 @@
 
 #include <lodepng.h>
 
+#include "Trace.h"
+
 
 ImageViewerLDR::ImageViewerLDR(const std::string &filepath)
     : ImageViewer()
 {
+    TRACE_SCOPE("PNG read & decode", "io");
+
     unsigned int width, height;
 
     unsigned error = lodepng::decode(_imageData, width, height, filepath);
@@ -24,8 +28,12 @@ ImageViewerLDR::ImageViewerLDR(const std::string &filepath)
 
 void ImageViewerLDR::initGL()
 {
+    TRACE_SCOPE("ImageViewerLDR::initGL", "load");
+
     ImageViewer::initGL();
 
+    TRACE_SCOPE("Texture upload", "upload");
+
     glActiveTexture(GL_TEXTURE0);
     glBindTexture(GL_TEXTURE_2D, _imageViewerInTexture);
 
@@ -41,6 +49,8 @@ void ImageViewerLDR::initGL()
         _imageData.data());
 
     glBindTexture(GL_TEXTURE_2D, 0);
+
+    markInputChanged();
 }
 
 
@@ -0,0 +1,54 @@
+#include "ImageViewerPreview.h"
+
+#include <imgui.h>
+
+#include "Trace.h"
+
+
+ImageViewerPreview::ImageViewerPreview(const DerivedDataCache::Entry &entry)
+    : ImageViewer()
+    , _entry(entry)
+{
+    resizeImage(_entry.width, _entry.height);
+    setExposure(_entry.exposure);
+}
+
+
+void ImageViewerPreview::initGL()
+{
+    TRACE_SCOPE("ImageViewerPreview::initGL", "load");
+
+    ImageViewer::initGL();
+
+    TRACE_SCOPE("Texture upload", "upload");
+
+    glActiveTexture(GL_TEXTURE0);
+    glBindTexture(GL_TEXTURE_2D, _imageViewerInTexture);
+
+    glTexImage2D(
+        GL_TEXTURE_2D,
+        0,
+        GL_RGBA32F,
+        _entry.previewWidth,
+        _entry.previewHeight,
+        0,
+        GL_RGBA,
+        GL_FLOAT,
+        _entry.preview.data());
+
+    // Magnified unless the image is small
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+
+    glBindTexture(GL_TEXTURE_2D, 0);
+
+    markInputChanged();
+}
+
+
+void ImageViewerPreview::gui_inspectorTool()
+{
+    ImGui::Text("Cached preview, loading the spectral data...");
+    ImGui::Text("Preview Size: %dx%d", _entry.previewWidth, _entry.previewHeight);
+    ImGui::Text("Spectral bands: %d", (int)_entry.wavelengths.size());
+    ImageViewer::gui_inspectorTool();
+}
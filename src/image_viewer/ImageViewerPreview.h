@@ -0,0 +1,22 @@
+#pragma once
+
+#include "ImageViewer.h"
+
+#include <image_format/DerivedDataCache.h>
+
+
+// Cached RGB preview of a spectral image, displayed while the full cube
+// loads. The preview is stretched over the full image size so the view is
+// unchanged when the spectral viewer replaces it.
+class ImageViewerPreview: public ImageViewer
+{
+  public:
+    ImageViewerPreview(const DerivedDataCache::Entry &entry);
+
+    virtual void initGL();
+
+    virtual void gui_inspectorTool();
+
+  protected:
+    DerivedDataCache::Entry _entry;
+};
@@ -3,26 +3,145 @@
 #include <imgui.h>
 #include <glm/gtc/type_ptr.hpp>
 
-#include <spectrum_data.h>
+#include <nfd.h>
+
+#include "Trace.h"
+
+#include <algorithm>
+#include <cfloat>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <iostream>
+
+
+// Colormaps as sRGB encoded control points
+struct Colormap {
+    const char               *name;
+    std::vector<unsigned int> colors;
+};
+
+// clang-format off
+static const Colormap COLORMAPS[] = {
+    {"Viridis", {0x440154, 0x482878, 0x3e4989, 0x31688e, 0x26828e, 0x1f9e89, 0x35b779, 0x6ece58, 0xb5de2b, 0xfde725}},
+    {"Inferno", {0x000004, 0x1b0c41, 0x4a0c6b, 0x781c6d, 0xa52c60, 0xcf4446, 0xed6925, 0xfb9b06, 0xf7d13d, 0xfcffa4}},
+    {"Grayscale", {0x000000, 0xffffff}}
+};
+// clang-format on
+
+static const size_t N_COLORMAPS = sizeof(COLORMAPS) / sizeof(COLORMAPS[0]);
 
 
 ImageViewerSpectral::ImageViewerSpectral()
     : ImageViewer()
+    , _tex_imageViewerSpectralIn(0)
+    , _observers(Colorimetry::builtinObservers())
+    , _illuminants(Colorimetry::builtinIlluminants())
+    , _observerIdx(0)
+    , _illuminantIdx(0)
+    , _textureCache(size_t(1024) << 20)
+    , _cacheCapacityMB(1024)
+    , _pcaComponents(0)
+    , _usePCA(false)
+    , _displayMode(DISPLAY_RGB)
+    , _falseColorBand(0)
+    , _falseColorWindow {400.f, 700.f}
+    , _falseColorRange {0.f, 1.f}
+    , _colormapIdx(0)
+    , _showRenderingControl(true)
+    , _showColorimetryControl(true)
+    , _showFalseColorControl(true)
+    , _showCPUReference(false)
+    , _useComputeShader(true)
+    , _progressive(true)
+    , _frameBudgetMs(8.f)
+    , _resolutionMode(RESOLUTION_AUTO)
+    , _footprintSamples(4)
+    , _computeProgram(nullptr)
+    , _fbo_imageViewerSpectral(0)
+    , _tex_bandWeights(0)
+    , _tex_colormap(0)
+    , _weightsOffset {0.f, 0.f, 0.f}
+    , _tex_spectralBack(0)
+    , _tex_spectralTarget(0)
+    , _hasSpectralResult(false)
+    , _imageResultAllocated(false)
+    , _fbo_viewport(0)
+    , _tex_viewport(0)
+    , _viewportWidth(0)
+    , _viewportHeight(0)
+    , _viewportTransform(1.f)
+    , _viewportActive(false)
+    , _viewportNeedsUpdate(true)
+    , _nTiles(0)
+    , _tileTimingIdx(0)
+    , _tileGpuMs(-1.)
     , _spectralNeedsUpdate(true)
+    , _xSpectrumMouseOver(-1)
+    , _ySpectrumMouseOver(-1)
+    , _spectrumRequestX(-1)
+    , _spectrumRequestY(-1)
+    , _inspectorKernel(1)
+    , _showRegionTool(false)
+    , _regionSelecting(false)
+    , _regionDragging(false)
+    , _hasRegion(false)
+    , _regionFinal(false)
+    , _region {0, 0, 0, 0}
+    , _autoExposure(AUTO_EXPOSURE_OFF)
+    , _autoExposurePercentile(99.f)
+    , _autoExposureVisibleOnly(true)
+    , _exposureMetered(false)
+    , _meteredGeneration(0)
+    , _meteredRegion {0, 0, 0, 0}
+    , _autoContrast(false)
+    , _contrastFitted(false)
+    , _contrastRegion {0, 0, 0, 0}
+    , _scopesReadback(1)
+    , _showScopes(false)
+    , _scopesOnGPU(true)
+    , _scopesChannels(0)
+    , _scopesComputed(false)
+    , _scopesGeneration(0)
+    , _tex_waveformDisplay(0)
+    , _waveformDisplayDirty(false)
+    , _waveformDisplayExposure(0.f)
+    , _showBandAnalysis(false)
+    , _bandMatrixType(0)
+    , _bandMatrixScale(1.)
+    , _tex_bandMatrix(0)
+    , _bandMatrixDirty(false)
+    , _bandCovarianceTime(0.)
+    , _cpuConversionTime(0.)
+    , _cpuMaxAbsError(0.f)
+    , _cpuCompared(false)
 {
-    // Default
-    // clang-format off
-    _xyzToRgb = glm::mat3(
-         3.2406, -0.9689,  0.0557,
-        -1.5372,  1.8758, -0.2040,
-        -0.4986,  0.0415,  1.0570);
-    // clang-format on
+    for (TileTiming &timing : _tileTimings) {
+        timing.queries[0] = 0;
+        timing.queries[1] = 0;
+        timing.nTiles     = 0;
+        timing.pending    = false;
+    }
 }
 
 
 ImageViewerSpectral::~ImageViewerSpectral()
 {
+    waitPyramidBuild();
+
     glDeleteFramebuffers(1, &_fbo_imageViewerSpectral);
+    glDeleteTextures(1, &_tex_bandWeights);
+    glDeleteTextures(1, &_tex_colormap);
+    glDeleteTextures(1, &_tex_spectralBack);
+    glDeleteFramebuffers(1, &_fbo_viewport);
+    glDeleteTextures(1, &_tex_viewport);
+    glDeleteTextures(1, &_tex_waveformDisplay);
+    glDeleteTextures(1, &_tex_bandMatrix);
+
+    for (TileTiming &timing : _tileTimings) {
+        glDeleteQueries(2, timing.queries);
+    }
 }
 
 
@@ -30,6 +149,269 @@ ImageViewerSpectral::~ImageViewerSpectral()
 // GUI elements
 // ----------------------------------------------------------------------------
 
+void ImageViewerSpectral::gui()
+{
+    ImageViewer::gui();
+
+    if (_showRegionTool) {
+        ImGui::SeparatorText("Region");
+        gui_regionTool();
+    }
+
+    if (_showScopes) {
+        ImGui::SeparatorText("Scopes");
+        gui_scopesTool();
+    }
+
+    if (_showBandAnalysis) {
+        ImGui::SeparatorText("Band analysis");
+        gui_bandAnalysisTool();
+    }
+
+    if (_showColorimetryControl) {
+        ImGui::SeparatorText("Colorimetry");
+        gui_colorimetryControl();
+    }
+
+    if (_showFalseColorControl) {
+        ImGui::SeparatorText("False color");
+        gui_falseColorControl();
+    }
+
+    if (_showRenderingControl) {
+        ImGui::SeparatorText("Rendering");
+        gui_renderingControl();
+    }
+
+    if (_showCPUReference) {
+        ImGui::SeparatorText("CPU reference");
+        gui_cpuReferenceTool();
+    }
+}
+
+
+void ImageViewerSpectral::gui_colorControl()
+{
+    ImageViewer::gui_colorControl();
+
+    const char *modes[] = {"Manual", "Log-average", "Percentile"};
+    int         mode    = _autoExposure;
+
+    if (ImGui::Combo("Auto exposure", &mode, modes, IM_ARRAYSIZE(modes))) {
+        setAutoExposure((AutoExposure)mode);
+    }
+
+    if (spectralData()) {
+        bool autoContrast = _autoContrast;
+
+        if (ImGui::Checkbox("Auto contrast (visible region)", &autoContrast)) {
+            setAutoContrast(autoContrast);
+        }
+    }
+
+    if (_autoExposure != AUTO_EXPOSURE_OFF) {
+        if (_autoExposure == AUTO_EXPOSURE_PERCENTILE) {
+            float percentile = _autoExposurePercentile;
+
+            if (ImGui::SliderFloat("Percentile", &percentile, 50.f, 100.f, "%.1f%%")) {
+                setAutoExposurePercentile(percentile);
+            }
+        }
+
+        bool visibleOnly = _autoExposureVisibleOnly;
+
+        if (ImGui::Checkbox("Visible region only", &visibleOnly)) {
+            setAutoExposureVisibleOnly(visibleOnly);
+        }
+    }
+}
+
+
+void ImageViewerSpectral::gui_renderingControl()
+{
+    if (computeShaderAvailable()) {
+        if (ImGui::Checkbox("Compute shader", &_useComputeShader)) {
+            invalidateResults();
+        }
+    } else if (!_computeError.empty()) {
+        ImGui::TextDisabled("Compute shader: could not be built");
+    } else if (!_computeProgram) {
+        ImGui::TextDisabled("Compute shader: requires OpenGL 4.3");
+    } else {
+        ImGui::TextDisabled("Compute shader: more than %d bands", COMPUTE_MAX_BANDS);
+    }
+
+    const char *resolutionModes[] = {"Auto", "Image", "Viewport"};
+    int         resolutionMode    = _resolutionMode;
+
+    if (ImGui::Combo("Resolution", &resolutionMode, resolutionModes, 3)) {
+        _resolutionMode = (ResolutionMode)resolutionMode;
+    }
+
+    if (_resolutionMode != RESOLUTION_IMAGE) {
+        if (ImGui::SliderInt("Footprint samples", &_footprintSamples, 1, 16)) {
+            _viewportNeedsUpdate = true;
+        }
+    }
+
+    if (_viewportActive) {
+        ImGui::Text("Evaluating visible pixels only");
+    }
+
+    ImGui::Checkbox("Progressive", &_progressive);
+
+    if (_progressive) {
+        ImGui::SliderFloat("Frame budget (ms)", &_frameBudgetMs, 1.f, 100.f);
+    }
+
+    if (!_pendingTiles.empty() && _nTiles > 0) {
+        ImGui::ProgressBar(1.f - (float)_pendingTiles.size() / (float)_nTiles);
+    }
+}
+
+
+void ImageViewerSpectral::gui_colorimetryControl()
+{
+    if (ImGui::BeginCombo("Observer", _observers[_observerIdx].name.c_str())) {
+        for (size_t i = 0; i < _observers.size(); i++) {
+            if (ImGui::Selectable(_observers[i].name.c_str(), i == _observerIdx)) {
+                setColorimetry(i, _illuminantIdx);
+            }
+        }
+
+        ImGui::EndCombo();
+    }
+
+    // Emissive images are not affected by the illuminant
+    if (_hasReflective) {
+        if (ImGui::BeginCombo("Illuminant", _illuminants[_illuminantIdx].name.c_str())) {
+            for (size_t i = 0; i < _illuminants.size(); i++) {
+                if (ImGui::Selectable(_illuminants[i].name.c_str(), i == _illuminantIdx)) {
+                    setColorimetry(_observerIdx, i);
+                }
+            }
+
+            ImGui::EndCombo();
+        }
+    }
+
+    const bool loadObserver   = ImGui::Button("Load observer");
+    bool       loadIlluminant = false;
+
+    if (_hasReflective) {
+        ImGui::SameLine();
+        loadIlluminant = ImGui::Button("Load illuminant");
+    }
+
+    if (loadObserver || loadIlluminant) {
+        nfdchar_t  *outPath = NULL;
+        nfdresult_t result  = NFD_OpenDialog(NULL, NULL, &outPath);
+
+        if (result == NFD_OKAY) {
+            try {
+                if (loadObserver) {
+                    addObserver(Colorimetry::loadObserver(outPath));
+                    setColorimetry(_observers.size() - 1, _illuminantIdx);
+                } else {
+                    addIlluminant(Colorimetry::loadIlluminant(outPath));
+                    setColorimetry(_observerIdx, _illuminants.size() - 1);
+                }
+
+                _colorimetryError.clear();
+            } catch (const std::exception &e) {
+                _colorimetryError = e.what();
+            }
+        }
+
+        free(outPath);
+    }
+
+    if (!_colorimetryError.empty()) {
+        ImGui::TextWrapped("%s", _colorimetryError.c_str());
+    }
+
+    ImGui::Text(
+        "Cached results: %d (%.0f MB)",
+        (int)_textureCache.size(),
+        _textureCache.bytesUsed() / float(1 << 20));
+
+    if (ImGui::SliderInt("Cache size (MB)", &_cacheCapacityMB, 0, 8192)) {
+        _textureCache.setCapacity(size_t(_cacheCapacityMB) << 20);
+    }
+}
+
+
+void ImageViewerSpectral::gui_falseColorControl()
+{
+    int mode = _displayMode;
+
+    ImGui::RadioButton("RGB", &mode, DISPLAY_RGB);
+    ImGui::SameLine();
+    ImGui::RadioButton("Band", &mode, DISPLAY_BAND);
+    ImGui::SameLine();
+    ImGui::RadioButton("Range", &mode, DISPLAY_RANGE);
+
+    if (mode != _displayMode) {
+        setDisplayMode((DisplayMode)mode);
+    }
+
+    if (_displayMode == DISPLAY_RGB) {
+        return;
+    }
+
+    if (_displayMode == DISPLAY_BAND) {
+        int band = _falseColorBand;
+
+        if (ImGui::SliderInt(
+                "Band",
+                &band,
+                0,
+                _nSpectralBands - 1,
+                ("%d: " + std::to_string((int)_imageWavelengths[_falseColorBand]) + "nm").c_str())) {
+            setFalseColorBand(band);
+        }
+    } else {
+        float window[2] = {_falseColorWindow[0], _falseColorWindow[1]};
+
+        if (ImGui::DragFloatRange2(
+                "Wavelengths",
+                &window[0],
+                &window[1],
+                1.f,
+                _imageWavelengths.front(),
+                _imageWavelengths.back(),
+                "%.0fnm")) {
+            setFalseColorWindow(window[0], window[1]);
+        }
+    }
+
+    if (ImGui::BeginCombo("Colormap", COLORMAPS[_colormapIdx].name)) {
+        for (size_t i = 0; i < N_COLORMAPS; i++) {
+            if (ImGui::Selectable(COLORMAPS[i].name, i == _colormapIdx)) {
+                _colormapIdx = i;
+                uploadColormap();
+            }
+        }
+
+        ImGui::EndCombo();
+    }
+
+    float range[2] = {_falseColorRange[0], _falseColorRange[1]};
+
+    if (ImGui::DragFloatRange2("Values", &range[0], &range[1], 0.01f)) {
+        setFalseColorRange(range[0], range[1]);
+    }
+
+    if (spectralData()) {
+        ImGui::SameLine();
+
+        if (ImGui::Button("Fit")) {
+            fitFalseColorRange();
+        }
+    }
+}
+
+
 void ImageViewerSpectral::gui_inspectorTool()
 {
     ImageViewer::gui_inspectorTool();
@@ -43,228 +425,2161 @@ void ImageViewerSpectral::gui_inspectorTool()
     if (_hasEmissive) {
         ImGui::Text("Polarised: %s", _isPolarised ? "Yes" : "No");
     }
+
+    const double bandsMB = double(imageWidth()) * double(imageHeight()) * sizeof(float) / double(1 << 20);
+
+    if (_usePCA) {
+        ImGui::Separator();
+
+        ImGui::Text("PCA components: %zu", _pca.nComponents());
+        ImGui::Text("Explained variance: %.4f%%", 100. * _pca.explainedVariance());
+        ImGui::Text("Reconstruction RMS error: %g", _pca.rmsError());
+        ImGui::Text("Reconstruction max. error: %g", _pca.maxAbsError());
+        ImGui::Text(
+            "GPU cube: %.1f MiB (%.1f MiB uncompressed)",
+            bandsMB * _pca.nComponents(),
+            bandsMB * _nSpectralBands);
+    } else {
+        ImGui::Text("GPU cube: %.1f MiB", bandsMB * _nSpectralBands);
+    }
+
+    if (!_pcaError.empty()) {
+        ImGui::TextColored(ImVec4(1.f, 0.3f, 0.3f, 1.f), "PCA: %s", _pcaError.c_str());
+    }
+
+    if (!_bandStatistics.empty()) {
+        ImGui::SeparatorText("Band statistics");
+        gui_bandStatistics();
+    }
+
+    ImGui::SeparatorText("Spectrum");
+    gui_spectrumPlot();
 }
 
 
-// ----------------------------------------------------------------------------
-// OpenGL
-// ----------------------------------------------------------------------------
+void ImageViewerSpectral::gui_bandStatistics()
+{
+    const uint64_t nNaN = _bandStatistics.nNaN();
+    const uint64_t nInf = _bandStatistics.nInf();
+
+    if (nNaN + nInf == 0) {
+        ImGui::Text("No NaN or Inf");
+    } else {
+        ImGui::TextColored(
+            ImVec4(1.f, 0.3f, 0.3f, 1.f),
+            "%llu NaN, %llu Inf",
+            (unsigned long long)nNaN,
+            (unsigned long long)nInf);
+    }
 
-void ImageViewerSpectral::initGL()
+    const ImGuiTableFlags flags = ImGuiTableFlags_Borders | ImGuiTableFlags_RowBg | ImGuiTableFlags_ScrollY
+                                  | ImGuiTableFlags_SizingFixedFit;
+
+    if (!ImGui::BeginTable("##BandStatistics", 8, flags, ImVec2(0.f, 12.f * ImGui::GetTextLineHeight()))) {
+        return;
+    }
+
+    ImGui::TableSetupColumn("Band");
+    ImGui::TableSetupColumn("Min");
+    ImGui::TableSetupColumn("Max");
+    ImGui::TableSetupColumn("Mean");
+    ImGui::TableSetupColumn("P1");
+    ImGui::TableSetupColumn("P99");
+    ImGui::TableSetupColumn("NaN / Inf");
+    ImGui::TableSetupColumn("First");
+    ImGui::TableHeadersRow();
+
+    for (size_t b = 0; b < _bandStatistics.nBands(); b++) {
+        const BandStatistics::Band &band = _bandStatistics.band(b);
+
+        ImGui::TableNextRow();
+
+        ImGui::TableNextColumn();
+        ImGui::Text("%.1f nm", _imageWavelengths[b]);
+        ImGui::TableNextColumn();
+        ImGui::Text("%g", band.min);
+        ImGui::TableNextColumn();
+        ImGui::Text("%g", band.max);
+        ImGui::TableNextColumn();
+        ImGui::Text("%g", band.mean);
+        ImGui::TableNextColumn();
+        ImGui::Text("%g", _bandStatistics.percentile(b, 0.01f));
+        ImGui::TableNextColumn();
+        ImGui::Text("%g", _bandStatistics.percentile(b, 0.99f));
+        ImGui::TableNextColumn();
+        ImGui::Text("%llu / %llu", (unsigned long long)band.nNaN, (unsigned long long)band.nInf);
+        ImGui::TableNextColumn();
+
+        // Pixel to look at for fireflies
+        if (band.nNaN + band.nInf > 0) {
+            ImGui::Text(
+                "(%llu, %llu)",
+                (unsigned long long)(band.firstNonFinite % imageWidth()),
+                (unsigned long long)(band.firstNonFinite / imageWidth()));
+        }
+    }
+
+    ImGui::EndTable();
+}
+
+
+void ImageViewerSpectral::gui_spectrumPlot()
 {
-    ImageViewer::initGL();
+    // The kernel is centered on the pixel
+    ImGui::SliderInt("Kernel", &_inspectorKernel, 1, INSPECTOR_MAX_KERNEL, "%d px");
+    _inspectorKernel |= 1;
+
+    const float *spectrum = nullptr;
+    int          x, y;
+
+    // The resident copy is averaged at every frame, otherwise the value
+    // read back from the GPU is shown once available
+    if (spectralData()) {
+        if (mouseImagePixel(x, y)) {
+            kernelSpectrum(x, y, _inspectorKernel, _inspectorSpectrum);
+            spectrum = _inspectorSpectrum.data();
+        }
+    } else if (_spectrumAtMousePosition.size() == _nSpectralBands) {
+        x        = _xSpectrumMouseOver;
+        y        = _ySpectrumMouseOver;
+        spectrum = _spectrumAtMousePosition.data();
+
+        ImGui::TextDisabled("No CPU copy: single pixel read from the GPU");
+    }
 
-    // ------------------------------------------------------------------------
-    // Shader management
-    // ------------------------------------------------------------------------
+    if (!spectrum || _nSpectralBands == 0) {
+        ImGui::TextDisabled("Hover the image to inspect its spectra");
+        return;
+    }
+
+    char overlay[64];
+    std::snprintf(overlay, sizeof(overlay), "(%d, %d)", x, y);
+
+    ImGui::PlotLines(
+        "##Spectrum",
+        spectrum,
+        (int)_nSpectralBands,
+        0,
+        overlay,
+        FLT_MAX,
+        FLT_MAX,
+        ImVec2(ImGui::GetContentRegionAvail().x, 120.f));
+
+    ImGui::Text(
+        "%.1f nm - %.1f nm, %d bands",
+        _imageWavelengths.front(),
+        _imageWavelengths.back(),
+        _nSpectralBands);
+
+    gui_spectrumColors(spectrum);
+}
 
-    _shaderProgram = std::unique_ptr<Shader>(new Shader("glsl/notransform.vert", "glsl/spectral.frag"));
 
-    GLuint shaderId    = _shaderProgram->get();
-    _loc_spectralImage = glGetUniformLocation(shaderId, "spectralImage");
+void ImageViewerSpectral::gui_spectrumColors(const float *spectrum)
+{
+    // Linear values, before exposure and gamma
+    const glm::vec3 xyz = _converter.convertPixelXYZ(spectrum);
+    const glm::vec3 rgb = _converter.convertPixel(spectrum);
+    const glm::vec3 lab = SpectralConverter::xyzToLab(xyz, _converter.whitePointXYZ());
+
+    ImGui::Text("XYZ: %.4f, %.4f, %.4f", xyz.x, xyz.y, xyz.z);
+    ImGui::Text("RGB: %.4f, %.4f, %.4f", rgb.r, rgb.g, rgb.b);
+    ImGui::Text("Lab: %.2f, %.2f, %.2f", lab.x, lab.y, lab.z);
+}
 
-    _loc_imageWavelengths    = glGetUniformLocation(shaderId, "imageWavelengths");
-    _loc_imageWlBoundsWidths = glGetUniformLocation(shaderId, "imageWlBoundsWidths");
 
-    _loc_width          = glGetUniformLocation(shaderId, "width");
-    _loc_height         = glGetUniformLocation(shaderId, "height");
-    _loc_nSpectralBands = glGetUniformLocation(shaderId, "nSpectralBands");
-    _loc_isReflective   = glGetUniformLocation(shaderId, "isReflective");
+void ImageViewerSpectral::gui_regionTool()
+{
+    ImGui::Checkbox("Select with the left button", &_regionSelecting);
 
-    _loc_cmfXYZ             = glGetUniformLocation(shaderId, "cmfXYZ");
-    _loc_cmfFirstWavelength = glGetUniformLocation(shaderId, "cmfFirstWavelength");
-    _loc_cmfSize            = glGetUniformLocation(shaderId, "cmfSize");
+    if (!spectralData()) {
+        ImGui::TextDisabled("No spectral data in memory");
+        return;
+    }
 
-    _loc_illuminant                 = glGetUniformLocation(shaderId, "illuminant");
-    _loc_illuminantFirstWavelength  = glGetUniformLocation(shaderId, "illuminantFirstWavelength");
-    _loc_illuminantSize             = glGetUniformLocation(shaderId, "illuminantSize");
+    if (_integralImage.empty()) {
+        ImGui::TextDisabled("Summed-area tables over budget");
+    } else {
+        ImGui::Text(
+            "Summed-area tables: %.1f MiB",
+            SpectralIntegralImage::bytes(imageWidth(), imageHeight(), _nSpectralBands) / double(1 << 20));
+    }
 
-    _loc_xyzToRgb = glGetUniformLocation(shaderId, "xyzToRgb");
+    if (!_hasRegion) {
+        ImGui::TextDisabled("No region selected");
+        return;
+    }
 
-    // ------------------------------------------------------------------------
-    // Texture management
-    // ------------------------------------------------------------------------
+    ImGui::Text(
+        "(%d, %d) - (%d, %d), %dx%d px",
+        _region[0],
+        _region[1],
+        _region[2],
+        _region[3],
+        _region[2] - _region[0],
+        _region[3] - _region[1]);
 
-    glEnable(GL_TEXTURE_3D);
-    glEnable(GL_TEXTURE_1D);
+    ImGui::SameLine();
 
-    // Managed later by subclasses that implements this class
-    glGenTextures(1, &_tex_imageViewerSpectralIn);
+    if (ImGui::Button("Clear")) {
+        clearRegion();
+        return;
+    }
 
-    // Wavelengths
-    glGenTextures(1, &_tex_imageWavelengths);
-    glBindTexture(GL_TEXTURE_1D, _tex_imageWavelengths);
-    glTexImage1D(
-        GL_TEXTURE_1D,
-        0,
-        GL_R32F,
-        _nSpectralBands,
-        0,
-        GL_RED,
-        GL_FLOAT,
-        _imageWavelengths.data());
+    if (!_regionFinal || _regionMean.size() != _nSpectralBands) {
+        ImGui::TextDisabled("Statistics evaluated on release");
+        return;
+    }
 
-    glTexParameteri(GL_TEXTURE_1D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_BORDER);
-    glTexParameteri(GL_TEXTURE_1D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
-    glTexParameteri(GL_TEXTURE_1D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+    const ImVec2 plotSize(ImGui::GetContentRegionAvail().x, 80.f);
 
-    // Wavelength bounds
-    glGenTextures(1, &_tex_imageWlBoundsWidths);
-    glBindTexture(GL_TEXTURE_1D, _tex_imageWlBoundsWidths);
-    glTexImage1D(
-        GL_TEXTURE_1D,
-        0,
-        GL_R32F,
-        _nSpectralBands,
-        0,
-        GL_RED,
-        GL_FLOAT,
-        _imageWlBoundsWidths.data());
+    ImGui::Text("Mean");
+    ImGui::PlotLines("##Mean", _regionMean.data(), (int)_regionMean.size(), 0, NULL, FLT_MAX, FLT_MAX, plotSize);
+    ImGui::Text("Standard deviation");
+    ImGui::PlotLines("##StdDev", _regionStdDev.data(), (int)_regionStdDev.size(), 0, NULL, FLT_MAX, FLT_MAX, plotSize);
 
-    glTexParameteri(GL_TEXTURE_1D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_BORDER);
-    glTexParameteri(GL_TEXTURE_1D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
-    glTexParameteri(GL_TEXTURE_1D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+    // The conversion is linear: color of the mean spectrum is the mean color
+    gui_spectrumColors(_regionMean.data());
+}
 
-    // CMFs
-    _cmfSize            = sizeof(SEXR::CIE1931_2DEG_X) / sizeof(SEXR::CIE1931_2DEG_X[0]);
-    _cmfFirstWavelength = (unsigned int)SEXR::CIE1931_2DEG_FIRST_WAVELENGTH_NM;
 
-    std::vector<float> cmfValues(3 * _cmfSize);
-    for (size_t i = 0; i < _cmfSize; i++) {
-        cmfValues[3 * i + 0] = SEXR::CIE1931_2DEG_X[i];
-        cmfValues[3 * i + 1] = SEXR::CIE1931_2DEG_Y[i];
-        cmfValues[3 * i + 2] = SEXR::CIE1931_2DEG_Z[i];
+void ImageViewerSpectral::gui_cpuReferenceTool()
+{
+    const float *spectra = spectralData();
+
+    if (!spectra) {
+        ImGui::Text("No spectral data in memory");
+        return;
     }
 
-    glGenTextures(1, &_tex_cmfXYZ);
-    glBindTexture(GL_TEXTURE_1D, _tex_cmfXYZ);
-    glTexImage1D(
-        GL_TEXTURE_1D,
-        0,
-        GL_RGB32F,
-        _cmfSize,
-        0,
-        GL_RGB,
-        GL_FLOAT,
-        cmfValues.data());
+    ImGui::Text("Threads: %d", SpectralConverter::maxThreads());
 
-    glTexParameteri(GL_TEXTURE_1D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_BORDER);
-    glTexParameteri(GL_TEXTURE_1D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
-    glTexParameteri(GL_TEXTURE_1D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    // The comparison is done against the full resolution result
+    if (!_hasSpectralResult || _viewportActive) {
+        ImGui::TextDisabled("Requires an image resolution result");
+        return;
+    }
 
-    glBindTexture(GL_TEXTURE_1D, 0);
+    if (ImGui::Button("Convert & compare")) {
+        std::vector<float> cpuRGBA(4 * imageWidth() * imageHeight());
+        std::vector<float> gpuRGBA(4 * imageWidth() * imageHeight());
+
+        const auto start = std::chrono::steady_clock::now();
+        _converter.convert(spectra, imageWidth(), imageHeight(), cpuRGBA.data());
+        const auto end = std::chrono::steady_clock::now();
+
+        _cpuConversionTime = std::chrono::duration<double, std::milli>(end - start).count();
 
-    // Illuminant
-    _illuminantSize = sizeof(SEXR::D_65_SPD) / sizeof(SEXR::D_65_SPD[0]);
-    _illuminantFirstWavelength = (unsigned int)SEXR::D_65_FIRST_WAVELENGTH_NM;
+        // Fetch the result of the spectral pass
+        glBindTexture(GL_TEXTURE_2D, _imageViewerInTexture);
+        glGetTexImage(GL_TEXTURE_2D, 0, GL_RGBA, GL_FLOAT, gpuRGBA.data());
+        glBindTexture(GL_TEXTURE_2D, 0);
 
-    std::vector<float> illuminantValues(_illuminantSize);
-    for (size_t i = 0; i < _illuminantSize; i++) {
-        illuminantValues[i] = SEXR::D_65_SPD[i];
+        _cpuMaxAbsError = 0.f;
+
+        for (size_t i = 0; i < cpuRGBA.size(); i++) {
+            _cpuMaxAbsError = std::max(_cpuMaxAbsError, std::abs(cpuRGBA[i] - gpuRGBA[i]));
+        }
+
+        _cpuCompared = true;
     }
 
-    glGenTextures(1, &_tex_illuminant);
-    glBindTexture(GL_TEXTURE_1D, _tex_illuminant);
-    glTexImage1D(
-        GL_TEXTURE_1D,
-        0,
-        GL_R32F,
-        _illuminantSize,
-        0,
-        GL_RED,
-        GL_FLOAT,
-        illuminantValues.data());
+    if (_cpuCompared) {
+        ImGui::Text("CPU conversion: %.1f ms", _cpuConversionTime);
+        ImGui::Text("Max. difference with GPU: %g", _cpuMaxAbsError);
+    }
+}
 
-    glTexParameteri(GL_TEXTURE_1D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_BORDER);
-    glTexParameteri(GL_TEXTURE_1D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
-    glTexParameteri(GL_TEXTURE_1D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
 
-    glBindTexture(GL_TEXTURE_1D, 0);
+void ImageViewerSpectral::gui_scopesTool()
+{
+    if (ImGui::Checkbox("GPU", &_scopesOnGPU)) {
+        _scopesComputed = false;
+    }
 
-    // ------------------------------------------------------------------------
-    // Main FBO
-    // ------------------------------------------------------------------------
+    ImGui::SameLine();
+    ImGui::RadioButton("Luminance", &_scopesChannels, 0);
+    ImGui::SameLine();
+    ImGui::RadioButton("RGB", &_scopesChannels, 1);
 
-    glBindTexture(GL_TEXTURE_2D, _imageViewerInTexture);
+    if (!_scopes.hasResults()) {
+        ImGui::TextDisabled("Computing...");
+        return;
+    }
 
-    glTexImage2D(
-        GL_TEXTURE_2D,
-        0,
-        GL_RGBA32F,
-        imageWidth(),
-        imageHeight(),
-        0,
-        GL_RGBA,
-        GL_FLOAT,
-        0);
+    ImGui::TextDisabled(
+        "%s, %+.0f EV to %+.0f EV around the display white",
+        _viewportActive ? "Visible pixels" : "Image",
+        SCOPES_MIN_EV,
+        SCOPES_MAX_EV);
 
-    glGenFramebuffers(1, &_fbo_imageViewerSpectral);
-    glBindFramebuffer(GL_FRAMEBUFFER, _fbo_imageViewerSpectral);
+    const float width = ImGui::GetContentRegionAvail().x;
 
-    glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, _imageViewerInTexture, 0);
+    // Histograms
+    const ImVec2 position = ImGui::GetCursorScreenPos();
+    ImGui::Dummy(ImVec2(width, 100.f));
 
-    glBindFramebuffer(GL_FRAMEBUFFER, 0);
-    glBindTexture(GL_TEXTURE_2D, 0);
+    drawHistograms(ImGui::GetWindowDrawList(), glm::vec2(position.x, position.y), glm::vec2(width, 100.f));
+
+    // Share of the luminance samples over the display white
+    const std::vector<float> &histograms = _scopes.histograms();
+
+    double total = 0., overWhite = 0.;
+
+    for (size_t b = 0; b < ImageScopes::BINS; b++) {
+        total += histograms[4 * b + 3];
+
+        if (ImageScopes::binLog2(b) + _exposure >= 0.f) {
+            overWhite += histograms[4 * b + 3];
+        }
+    }
+
+    ImGui::Text("Over white: %.2f%%", total > 0. ? 100. * overWhite / total : 0.);
+
+    // Waveform
+    updateWaveformDisplay();
+
+    ImGui::Image((ImTextureID)(intptr_t)_tex_waveformDisplay, ImVec2(width, 128.f));
 }
 
 
-void ImageViewerSpectral::render()
+void ImageViewerSpectral::gui_bandAnalysisTool()
 {
-    if (_spectralNeedsUpdate) {
-        glBindFramebuffer(GL_FRAMEBUFFER, _fbo_imageViewerSpectral);
-        glViewport(0, 0, imageWidth(), imageHeight());
-        glClear(GL_COLOR_BUFFER_BIT);
+    if (!spectralData()) {
+        ImGui::TextDisabled("No spectral data in memory");
+        return;
+    }
+
+    if (ImGui::Button(_bandCovariance.empty() ? "Compute" : "Compute again")) {
+        computeBandCovariance();
+    }
+
+    if (_bandCovariance.empty()) {
+        ImGui::TextDisabled("Covariance of every pair of bands over the image");
+        return;
+    }
 
-        // Bind textures
-        glActiveTexture(GL_TEXTURE0);
-        glBindTexture(GL_TEXTURE_3D, _tex_imageViewerSpectralIn);
+    ImGui::SameLine();
+    ImGui::Text("%.0f ms", _bandCovarianceTime);
 
-        glActiveTexture(GL_TEXTURE1);
-        glBindTexture(GL_TEXTURE_1D, _tex_imageWavelengths);
+    bool matrixChanged = ImGui::RadioButton("Correlation", &_bandMatrixType, 0);
+    ImGui::SameLine();
+    matrixChanged |= ImGui::RadioButton("Covariance", &_bandMatrixType, 1);
 
-        glActiveTexture(GL_TEXTURE2);
-        glBindTexture(GL_TEXTURE_1D, _tex_imageWlBoundsWidths);
+    if (matrixChanged) {
+        _bandMatrixDirty = true;
+    }
 
-        glActiveTexture(GL_TEXTURE3);
-        glBindTexture(GL_TEXTURE_1D, _tex_cmfXYZ);
+    updateBandMatrixDisplay();
 
-        glActiveTexture(GL_TEXTURE4);
-        glBindTexture(GL_TEXTURE_1D, _tex_illuminant);
+    const size_t n    = _bandCovariance.nBands();
+    const float  size = std::min(ImGui::GetContentRegionAvail().x, 320.f);
 
-        glUseProgram(_shaderProgram->get());
+    ImGui::Image((ImTextureID)(intptr_t)_tex_bandMatrix, ImVec2(size, size));
 
-        // Set texture units
-        glUniform1i(_loc_spectralImage, 0);
-        glUniform1i(_loc_imageWavelengths, 1);
-        glUniform1i(_loc_imageWlBoundsWidths, 2);
-        glUniform1i(_loc_cmfXYZ, 3);
-        glUniform1i(_loc_illuminant, 4);
+    // Value of the pair of bands under the mouse
+    if (ImGui::IsItemHovered()) {
+        const ImVec2 mouse  = ImGui::GetMousePos();
+        const ImVec2 corner = ImGui::GetItemRectMin();
 
-        // Other parameters
-        glUniform1ui(_loc_cmfFirstWavelength, _cmfFirstWavelength);
-        glUniform1ui(_loc_cmfSize, _cmfSize);
+        const size_t j = std::min(n - 1, size_t(std::max(0.f, (mouse.x - corner.x) / size * n)));
+        const size_t i = std::min(n - 1, size_t(std::max(0.f, (mouse.y - corner.y) / size * n)));
 
-        glUniform1ui(_loc_illuminantFirstWavelength, _illuminantFirstWavelength);
-        glUniform1ui(_loc_illuminantSize, _illuminantSize);
+        ImGui::SetTooltip(
+            "%.1f nm / %.1f nm: %g",
+            _imageWavelengths[i],
+            _imageWavelengths[j],
+            _bandMatrix[n * i + j]);
+    }
 
-        glUniformMatrix3fv(_loc_xyzToRgb, 1, GL_FALSE, glm::value_ptr(_xyzToRgb));
+    ImGui::TextDisabled("Blue: %g, white: 0, red: %g", -_bandMatrixScale, _bandMatrixScale);
+    ImGui::Text("Finite pixels: %llu", (unsigned long long)_bandCovariance.count());
+}
 
-        glUniform1i(_loc_width, imageWidth());
-        glUniform1i(_loc_height, imageHeight());
-        glUniform1ui(_loc_nSpectralBands, _nSpectralBands);
-        glUniform1i(_loc_isReflective, _hasReflective ? 1 : 0);
 
-        glBindVertexArray(_vao);
-        glDrawElements(GL_TRIANGLES, 6, GL_UNSIGNED_INT, 0);
+void ImageViewerSpectral::menuImageControls()
+{
+    ImageViewer::menuImageControls();
+    ImGui::MenuItem("Colorimetry", NULL, &_showColorimetryControl);
+    ImGui::MenuItem("False color", NULL, &_showFalseColorControl);
+    ImGui::MenuItem("Rendering", NULL, &_showRenderingControl);
+}
 
-        glBindTexture(GL_TEXTURE_3D, 0);
-        glBindVertexArray(0);
 
-        glUseProgram(0);
-        glBindFramebuffer(GL_FRAMEBUFFER, 0);
+void ImageViewerSpectral::menuImageTools()
+{
+    ImageViewer::menuImageTools();
+    ImGui::MenuItem("Region", NULL, &_showRegionTool);
+    ImGui::MenuItem("Scopes", NULL, &_showScopes);
+    ImGui::MenuItem("Band analysis", NULL, &_showBandAnalysis);
+    ImGui::MenuItem("CPU reference", NULL, &_showCPUReference);
+}
 
-        _spectralNeedsUpdate = false;
+
+// ----------------------------------------------------------------------------
+// OpenGL
+// ----------------------------------------------------------------------------
+
+void ImageViewerSpectral::initGL()
+{
+    TRACE_SCOPE("ImageViewerSpectral::initGL", "load");
+
+    ImageViewer::initGL();
+
+    // ------------------------------------------------------------------------
+    // Shader management
+    // ------------------------------------------------------------------------
+
+    _shaderProgram = std::unique_ptr<Shader>(new Shader("glsl/notransform.vert", "glsl/spectral.frag"));
+
+    getUniforms(_shaderProgram->get(), _loc_fragment);
+
+    _viewportProgram = std::unique_ptr<Shader>(new Shader("glsl/vertex.vert", "glsl/spectral_viewport.frag"));
+    getUniforms(_viewportProgram->get(), _loc_viewport);
+
+    // Optional compute path, the context is 3.3 when 4.3 is not supported.
+    // Drivers with a partial 4.3 support may fail to build it: the fragment
+    // path is used instead.
+    if (GLEW_VERSION_4_3) {
+        try {
+            _computeProgram = std::unique_ptr<Shader>(new Shader("glsl/spectral.comp"));
+            getUniforms(_computeProgram->get(), _loc_compute);
+        } catch (const std::exception &e) {
+            std::cerr << "[ERROR] glsl/spectral.comp: " << e.what() << std::endl;
+
+            _computeProgram.reset();
+            _computeError = e.what();
+        }
     }
 
-    ImageViewer::render();
-}
\ No newline at end of file
+    // ------------------------------------------------------------------------
+    // Texture management
+    // ------------------------------------------------------------------------
+
+    glEnable(GL_TEXTURE_3D);
+    glEnable(GL_TEXTURE_1D);
+
+    // Managed later by subclasses that implements this class
+    glGenTextures(1, &_tex_imageViewerSpectralIn);
+
+    // Band weights: the CMFs, illuminant and bounds are folded in by the
+    // converter which also serves as CPU reference
+    applyColorimetry();
+    _converter.setBands(_imageWavelengths, _imageWlBoundsWidths, _hasReflective);
+
+    glGenTextures(1, &_tex_bandWeights);
+    glBindTexture(GL_TEXTURE_1D, _tex_bandWeights);
+
+    glTexParameteri(GL_TEXTURE_1D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_BORDER);
+    glTexParameteri(GL_TEXTURE_1D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+    glTexParameteri(GL_TEXTURE_1D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+
+    glBindTexture(GL_TEXTURE_1D, 0);
+
+    uploadBandWeights();
+
+    // Colormap for false color display
+    glGenTextures(1, &_tex_colormap);
+    glBindTexture(GL_TEXTURE_1D, _tex_colormap);
+
+    glTexParameteri(GL_TEXTURE_1D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_1D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_1D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+
+    glBindTexture(GL_TEXTURE_1D, 0);
+
+    uploadColormap();
+
+    // ------------------------------------------------------------------------
+    // Main FBO
+    // ------------------------------------------------------------------------
+
+    // Image sized textures are allocated by the first full resolution
+    // conversion, see allocateImageResult()
+    glGenFramebuffers(1, &_fbo_imageViewerSpectral);
+
+    for (TileTiming &timing : _tileTimings) {
+        glGenQueries(2, timing.queries);
+    }
+
+    // ------------------------------------------------------------------------
+    // Viewport FBO
+    // ------------------------------------------------------------------------
+
+    glGenTextures(1, &_tex_viewport);
+    glBindTexture(GL_TEXTURE_2D, _tex_viewport);
+
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+
+    glGenFramebuffers(1, &_fbo_viewport);
+
+    glBindFramebuffer(GL_FRAMEBUFFER, 0);
+    glBindTexture(GL_TEXTURE_2D, 0);
+
+    _spectrumReadback.initGL();
+
+    // ------------------------------------------------------------------------
+    // Scopes
+    // ------------------------------------------------------------------------
+
+    _scopes.initGL();
+    _scopesReadback.initGL();
+    _exposureMeter.initGL();
+
+    glGenTextures(1, &_tex_waveformDisplay);
+    glBindTexture(GL_TEXTURE_2D, _tex_waveformDisplay);
+
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+
+    // Band matrix heatmap, one texel per pair of bands
+    glGenTextures(1, &_tex_bandMatrix);
+    glBindTexture(GL_TEXTURE_2D, _tex_bandMatrix);
+
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+
+    glBindTexture(GL_TEXTURE_2D, 0);
+}
+
+
+void ImageViewerSpectral::render()
+{
+    TRACE_SCOPE("ImageViewerSpectral::render", "render");
+
+    // May change the false color range, before the conversion
+    updateAutoContrast();
+
+    _viewportActive = useViewportResolution();
+
+    if (_viewportActive) {
+        // The image resolution conversion resumes when zooming back in
+        renderViewport();
+    } else {
+        if (_spectralNeedsUpdate) {
+            startConversion();
+            _spectralNeedsUpdate = false;
+        }
+
+        if (!_pendingTiles.empty()) {
+            continueConversion();
+        }
+    }
+
+    // Mapped to colors by the display pass
+    _displayColormap      = _displayMode != DISPLAY_RGB ? _tex_colormap : 0;
+    _displayColormapRange = glm::vec2(_falseColorRange[0], _falseColorRange[1]);
+
+    ImageViewer::render();
+
+    updateSpectrumReadback();
+    updateScopes();
+    updateAutoExposure();
+}
+
+
+void ImageViewerSpectral::drawOverlay(ImDrawList *drawList, const glm::vec2 &origin)
+{
+    if (!_hasRegion) {
+        return;
+    }
+
+    const glm::vec2 a = origin + imageToWindow(glm::vec2(_region[0], _region[1]));
+    const glm::vec2 b = origin + imageToWindow(glm::vec2(_region[2], _region[3]));
+
+    drawList->AddRect(
+        ImVec2(std::min(a.x, b.x), std::min(a.y, b.y)),
+        ImVec2(std::max(a.x, b.x), std::max(a.y, b.y)),
+        IM_COL32(255, 220, 0, 255));
+}
+
+
+void ImageViewerSpectral::mouseLeftPress(double xpos, double ypos)
+{
+    _regionDragging = _regionSelecting && spectralData();
+
+    if (!_regionDragging) {
+        ImageViewer::mouseLeftPress(xpos, ypos);
+        return;
+    }
+
+    // Drag positions are screen coordinates while the press happens over
+    // the hovered window position
+    _regionPressPos  = glm::vec2(xpos, ypos);
+    _regionDragStart = glm::vec2(_mouseOverX, _mouseOverY);
+
+    selectRegion(_regionDragStart, _regionDragStart);
+}
+
+
+void ImageViewerSpectral::mouseLeftDrag(double xpos, double ypos)
+{
+    if (!_regionDragging) {
+        ImageViewer::mouseLeftDrag(xpos, ypos);
+        return;
+    }
+
+    selectRegion(_regionDragStart, _regionDragStart + glm::vec2(xpos, ypos) - _regionPressPos);
+}
+
+
+void ImageViewerSpectral::mouseLeftRelease(double xpos, double ypos)
+{
+    if (!_regionDragging) {
+        ImageViewer::mouseLeftRelease(xpos, ypos);
+        return;
+    }
+
+    _regionDragging = false;
+
+    selectRegion(_regionDragStart, _regionDragStart + glm::vec2(xpos, ypos) - _regionPressPos);
+}
+
+
+void ImageViewerSpectral::setAutoExposure(AutoExposure mode)
+{
+    _autoExposure    = mode;
+    _exposureMetered = false;
+
+    if (mode != AUTO_EXPOSURE_OFF) {
+        _autoContrast = false;
+    }
+}
+
+
+void ImageViewerSpectral::setAutoContrast(bool enable)
+{
+    _autoContrast   = enable;
+    _contrastFitted = false;
+
+    if (enable) {
+        _autoExposure = AUTO_EXPOSURE_OFF;
+    }
+}
+
+
+void ImageViewerSpectral::visibleImageRegion(int region[4]) const
+{
+    const glm::vec2 a = windowToImage(glm::vec2(0.f));
+    const glm::vec2 b = windowToImage(glm::vec2(windowWidth() - 1, windowHeight() - 1));
+
+    const int x0 = std::max(0, (int)std::floor(std::min(a.x, b.x)));
+    const int y0 = std::max(0, (int)std::floor(std::min(a.y, b.y)));
+    const int x1 = std::min((int)imageWidth(), (int)std::ceil(std::max(a.x, b.x)));
+    const int y1 = std::min((int)imageHeight(), (int)std::ceil(std::max(a.y, b.y)));
+
+    region[0] = x0;
+    region[1] = y0;
+    region[2] = std::max(0, x1 - x0);
+    region[3] = std::max(0, y1 - y0);
+}
+
+
+std::string ImageViewerSpectral::displayedValuesKey() const
+{
+    switch (_displayMode) {
+        case DISPLAY_BAND:
+            return "band/" + std::to_string(_falseColorBand);
+
+        case DISPLAY_RANGE:
+            return "range/" + std::to_string(_falseColorWindow[0]) + "/" + std::to_string(_falseColorWindow[1]);
+
+        default:
+            return "rgb/" + resultKey();
+    }
+}
+
+
+void ImageViewerSpectral::startPyramidBuild()
+{
+    // The worker reads its own copy of everything but the cube, which
+    // outlives the build (see waitPyramidBuild)
+    const float             *spectra      = spectralData();
+    const size_t             width        = imageWidth();
+    const size_t             height       = imageHeight();
+    const size_t             nBands       = _nSpectralBands;
+    const DisplayMode        mode         = _displayMode;
+    const std::vector<float> boundsWidths = _imageWlBoundsWidths;
+    const SpectralConverter  converter    = _converter;
+
+    size_t begin, end;
+    activeBands(begin, end);
+
+    _pyramidBuildKey = displayedValuesKey();
+    _pyramidBuild    = std::async(std::launch::async, [=]() {
+        TRACE_SCOPE("Statistics pyramid", "stats");
+
+        std::shared_ptr<StatisticsPyramid> pyramid = std::make_shared<StatisticsPyramid>();
+
+        // Same values as the spectral pass, luminance for RGB
+        pyramid->build(width, height, [&](size_t y, float *values) {
+            for (size_t x = 0; x < width; x++) {
+                const float *spectrum = &spectra[nBands * (y * width + x)];
+
+                float value = 0.f;
+
+                if (mode == DISPLAY_RGB) {
+                    const glm::vec3 rgb = converter.convertPixel(spectrum);
+
+                    value = 0.2126f * rgb.r + 0.7152f * rgb.g + 0.0722f * rgb.b;
+                } else if (mode == DISPLAY_BAND) {
+                    value = spectrum[begin];
+                } else {
+                    for (size_t i = begin; i < end; i++) {
+                        value += spectrum[i] * boundsWidths[i];
+                    }
+                }
+
+                values[x] = value;
+            }
+        });
+
+        return pyramid;
+    });
+}
+
+
+const StatisticsPyramid *ImageViewerSpectral::findPyramid(const std::string &key) const
+{
+    for (const auto &cached : _pyramids) {
+        if (cached.first == key) {
+            return cached.second.get();
+        }
+    }
+
+    return nullptr;
+}
+
+
+void ImageViewerSpectral::waitPyramidBuild()
+{
+    if (_pyramidBuild.valid()) {
+        _pyramidBuild.wait();
+    }
+}
+
+
+void ImageViewerSpectral::updateAutoContrast()
+{
+    // A finished build is kept even when the auto contrast was disabled since
+    if (_pyramidBuild.valid()
+        && _pyramidBuild.wait_for(std::chrono::seconds(0)) == std::future_status::ready) {
+        _pyramids.insert(_pyramids.begin(), std::make_pair(_pyramidBuildKey, _pyramidBuild.get()));
+
+        if (_pyramids.size() > PYRAMID_CACHE_SIZE) {
+            _pyramids.pop_back();
+        }
+    }
+
+    if (!_autoContrast || !spectralData()) {
+        return;
+    }
+
+    const std::string        key     = displayedValuesKey();
+    const StatisticsPyramid *pyramid = findPyramid(key);
+
+    // The previous range holds until the pyramid is built. While scrubbing
+    // through bands, the values displayed when a build ends are built next.
+    if (!pyramid) {
+        if (!_pyramidBuild.valid()) {
+            startPyramidBuild();
+        }
+
+        return;
+    }
+
+    int region[4];
+    visibleImageRegion(region);
+
+    if (_contrastFitted && key == _contrastKey && std::equal(region, region + 4, _contrastRegion)) {
+        return;
+    }
+
+    _contrastFitted = true;
+    _contrastKey    = key;
+    std::copy(region, region + 4, _contrastRegion);
+
+    const StatisticsPyramid::Range range = pyramid->query(
+        region[0],
+        region[1],
+        region[0] + region[2],
+        region[1] + region[3]);
+
+    if (range.count == 0) {
+        return;
+    }
+
+    if (_displayMode == DISPLAY_RGB) {
+        if (range.max > 0.f) {
+            _exposure = -std::log2(range.max);
+        }
+    } else if (range.min < range.max) {
+        setFalseColorRange(range.min, range.max);
+    }
+}
+
+
+void ImageViewerSpectral::setAutoExposurePercentile(float percentile)
+{
+    _autoExposurePercentile = std::max(0.f, std::min(percentile, 100.f));
+
+    // The histogram of the last metering still holds
+    applyAutoExposure();
+}
+
+
+void ImageViewerSpectral::setAutoExposureVisibleOnly(bool visibleOnly)
+{
+    _autoExposureVisibleOnly = visibleOnly;
+    _exposureMetered         = false;
+}
+
+
+void ImageViewerSpectral::updateAutoExposure()
+{
+    if (_exposureMeter.poll()) {
+        applyAutoExposure();
+        _readbackUpdated = true;
+    }
+
+    // Intermediate results of a conversion are not metered
+    if (_autoExposure == AUTO_EXPOSURE_OFF || isConverting()) {
+        return;
+    }
+
+    int region[4];
+
+    if (_viewportActive) {
+        // Only the visible pixels are converted
+        region[0] = 0;
+        region[1] = 0;
+        region[2] = _viewportWidth;
+        region[3] = _viewportHeight;
+    } else if (_hasSpectralResult) {
+        region[0] = 0;
+        region[1] = 0;
+        region[2] = imageWidth();
+        region[3] = imageHeight();
+
+        if (_autoExposureVisibleOnly) {
+            visibleImageRegion(region);
+        }
+    } else {
+        return;
+    }
+
+    if (_exposureMetered
+        && _meteredGeneration == inputGeneration()
+        && std::equal(region, region + 4, _meteredRegion)) {
+        return;
+    }
+
+    // Retried next frame while the previous metering is read back
+    if (_exposureMeter.meter(displayTexture(), region[0], region[1], region[2], region[3])) {
+        _exposureMetered   = true;
+        _meteredGeneration = inputGeneration();
+        std::copy(region, region + 4, _meteredRegion);
+    }
+}
+
+
+void ImageViewerSpectral::applyAutoExposure()
+{
+    if (!_exposureMeter.hasResult()) {
+        return;
+    }
+
+    switch (_autoExposure) {
+        case AUTO_EXPOSURE_LOG_AVERAGE:
+            _exposure = std::log2(MIDDLE_GRAY) - _exposureMeter.log2Average();
+            break;
+
+        case AUTO_EXPOSURE_PERCENTILE:
+            _exposure = -_exposureMeter.log2Percentile(_autoExposurePercentile / 100.f);
+            break;
+
+        case AUTO_EXPOSURE_OFF:
+            break;
+    }
+}
+
+
+void ImageViewerSpectral::updateScopes()
+{
+    if (_scopes.poll()) {
+        _waveformDisplayDirty = true;
+        _readbackUpdated      = true;
+    }
+
+    if (_scopesReadback.poll() && !_scopesOnGPU) {
+        const uint64_t tag = _scopesReadback.resultTag();
+
+        _scopes.computeCPU(_scopesReadback.result().data(), PixelReadback::tagX(tag), PixelReadback::tagY(tag));
+
+        _waveformDisplayDirty = true;
+        _readbackUpdated      = true;
+    }
+
+    // Intermediate results of a conversion are not binned
+    if (!_showScopes || isConverting() || (_scopesComputed && _scopesGeneration == inputGeneration())) {
+        return;
+    }
+
+    // Both paths bin the displayed texture, whatever the mode
+    unsigned int width = 0, height = 0;
+
+    if (_viewportActive) {
+        width  = _viewportWidth;
+        height = _viewportHeight;
+    } else if (_hasSpectralResult) {
+        width  = imageWidth();
+        height = imageHeight();
+    }
+
+    if (width == 0 || height == 0) {
+        return;
+    }
+
+    bool started = false;
+
+    if (_scopesOnGPU) {
+        started = _scopes.computeGPU(displayTexture(), width, height);
+    } else {
+        // Binned once read back, the size is kept in the tag
+        started = _scopesReadback.request(
+            displayTexture(), -1, 0, 0, width, height, 4, PixelReadback::pixelTag(width, height));
+    }
+
+    if (started) {
+        _scopesComputed   = true;
+        _scopesGeneration = inputGeneration();
+    }
+}
+
+
+void ImageViewerSpectral::drawHistograms(ImDrawList *drawList, const glm::vec2 &position, const glm::vec2 &size) const
+{
+    const std::vector<float> &histograms = _scopes.histograms();
+
+    const float binsPerStop = ImageScopes::BINS / (ImageScopes::LOG2_MAX - ImageScopes::LOG2_MIN);
+
+    // Bins of the exposure window, a change of exposure only shifts it
+    const int firstBin = (int)std::floor((SCOPES_MIN_EV - _exposure - ImageScopes::LOG2_MIN) * binsPerStop);
+    const int nBins    = (int)((SCOPES_MAX_EV - SCOPES_MIN_EV) * binsPerStop);
+
+    const size_t channelBegin = _scopesChannels == 0 ? 3 : 0;
+    const size_t channelEnd   = _scopesChannels == 0 ? 4 : 3;
+
+    auto count = [&](int bin, size_t channel) {
+        return (bin >= 0 && bin < (int)ImageScopes::BINS) ? histograms[4 * bin + channel] : 0.f;
+    };
+
+    float maxCount = 0.f;
+
+    for (int i = 0; i < nBins; i++) {
+        for (size_t c = channelBegin; c < channelEnd; c++) {
+            maxCount = std::max(maxCount, count(firstBin + i, c));
+        }
+    }
+
+    drawList->AddRectFilled(
+        ImVec2(position.x, position.y),
+        ImVec2(position.x + size.x, position.y + size.y),
+        IM_COL32(20, 20, 20, 255));
+
+    // Display white
+    const float whiteX = position.x + size.x * -SCOPES_MIN_EV / (SCOPES_MAX_EV - SCOPES_MIN_EV);
+
+    drawList->AddLine(ImVec2(whiteX, position.y), ImVec2(whiteX, position.y + size.y), IM_COL32(128, 128, 128, 255));
+
+    if (maxCount <= 0.f) {
+        return;
+    }
+
+    const ImU32 colors[4] = {
+        IM_COL32(255, 80, 80, 255),
+        IM_COL32(80, 255, 80, 255),
+        IM_COL32(80, 80, 255, 255),
+        IM_COL32(230, 230, 230, 255)};
+
+    for (size_t c = channelBegin; c < channelEnd; c++) {
+        ImVec2 previous;
+
+        for (int i = 0; i < nBins; i++) {
+            const ImVec2 current(
+                position.x + size.x * (i + 0.5f) / nBins,
+                position.y + size.y * (1.f - count(firstBin + i, c) / maxCount));
+
+            if (i > 0) {
+                drawList->AddLine(previous, current, colors[c]);
+            }
+
+            previous = current;
+        }
+    }
+}
+
+
+void ImageViewerSpectral::updateWaveformDisplay()
+{
+    if (!_waveformDisplayDirty && _waveformDisplayExposure == _exposure) {
+        return;
+    }
+
+    const std::vector<float> &waveform = _scopes.waveform();
+
+    const size_t columns     = ImageScopes::WAVEFORM_COLUMNS;
+    const float  binsPerStop = ImageScopes::BINS / (ImageScopes::LOG2_MAX - ImageScopes::LOG2_MIN);
+
+    const int firstBin = (int)std::floor((SCOPES_MIN_EV - _exposure - ImageScopes::LOG2_MIN) * binsPerStop);
+    const int nBins    = (int)((SCOPES_MAX_EV - SCOPES_MIN_EV) * binsPerStop);
+
+    float maxCount = 0.f;
+
+    for (float c : waveform) {
+        maxCount = std::max(maxCount, c);
+    }
+
+    // Highest values on the first row, log density
+    std::vector<unsigned char> pixels(4 * columns * nBins);
+
+    for (int row = 0; row < nBins; row++) {
+        const int bin = firstBin + nBins - 1 - row;
+
+        for (size_t x = 0; x < columns; x++) {
+            const float c = (bin >= 0 && bin < (int)ImageScopes::BINS) ? waveform[columns * bin + x] : 0.f;
+            const float t = maxCount > 0.f ? std::log1p(c) / std::log1p(maxCount) : 0.f;
+
+            unsigned char *px = &pixels[4 * (row * columns + x)];
+
+            px[0] = (unsigned char)(40.f * t);
+            px[1] = (unsigned char)(255.f * t);
+            px[2] = (unsigned char)(80.f * t);
+            px[3] = 255;
+        }
+    }
+
+    glBindTexture(GL_TEXTURE_2D, _tex_waveformDisplay);
+    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, columns, nBins, 0, GL_RGBA, GL_UNSIGNED_BYTE, pixels.data());
+    glBindTexture(GL_TEXTURE_2D, 0);
+
+    _waveformDisplayDirty    = false;
+    _waveformDisplayExposure = _exposure;
+}
+
+
+void ImageViewerSpectral::computeBandCovariance()
+{
+    const float *spectra = spectralData();
+
+    if (!spectra) {
+        return;
+    }
+
+    TRACE_SCOPE("Band covariance", "stats");
+
+    const auto start = std::chrono::steady_clock::now();
+
+    _bandCovariance.reset(_nSpectralBands);
+    _bandCovariance.add(spectra, size_t(imageWidth()) * size_t(imageHeight()));
+
+    _bandCovarianceTime = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+    _bandMatrixDirty    = true;
+}
+
+
+void ImageViewerSpectral::updateBandMatrixDisplay()
+{
+    if (!_bandMatrixDirty) {
+        return;
+    }
+
+    if (_bandMatrixType == 0) {
+        _bandCovariance.correlation(_bandMatrix);
+        _bandMatrixScale = 1.;
+    } else {
+        _bandCovariance.covariance(_bandMatrix);
+        _bandMatrixScale = 0.;
+
+        for (double v : _bandMatrix) {
+            _bandMatrixScale = std::max(_bandMatrixScale, std::abs(v));
+        }
+    }
+
+    const size_t n = _bandCovariance.nBands();
+
+    // Diverging map: negative values blue, positive values red
+    std::vector<unsigned char> pixels(4 * n * n);
+
+    for (size_t i = 0; i < n * n; i++) {
+        const double t = _bandMatrixScale > 0. ? std::max(-1., std::min(1., _bandMatrix[i] / _bandMatrixScale)) : 0.;
+
+        const float fade = 1.f - (float)std::abs(t);
+
+        unsigned char *px = &pixels[4 * i];
+
+        px[0] = (unsigned char)(255.f * (t > 0. ? 1.f : fade));
+        px[1] = (unsigned char)(255.f * fade);
+        px[2] = (unsigned char)(255.f * (t < 0. ? 1.f : fade));
+        px[3] = 255;
+    }
+
+    glBindTexture(GL_TEXTURE_2D, _tex_bandMatrix);
+    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, n, n, 0, GL_RGBA, GL_UNSIGNED_BYTE, pixels.data());
+    glBindTexture(GL_TEXTURE_2D, 0);
+
+    _bandMatrixDirty = false;
+}
+
+
+void ImageViewerSpectral::setComputeShader(bool enable)
+{
+    if (enable != _useComputeShader) {
+        _useComputeShader = enable;
+        invalidateResults();
+    }
+}
+
+
+bool ImageViewerSpectral::useViewportResolution() const
+{
+    switch (_resolutionMode) {
+        case RESOLUTION_IMAGE:
+            return false;
+
+        case RESOLUTION_VIEWPORT:
+            return true;
+
+        default:
+            break;
+    }
+
+    if (windowWidth() < 2 || windowHeight() < 2) {
+        return false;
+    }
+
+    // Image pixels covered by a screen pixel at the center of the view
+    const glm::vec2 center(windowWidth() / 2, windowHeight() / 2);
+    const glm::vec2 p0 = windowToImage(center);
+    const glm::vec2 p1 = windowToImage(center + glm::vec2(1.f, 0.f));
+
+    return std::abs(p1.x - p0.x) >= VIEWPORT_MIN_FOOTPRINT;
+}
+
+
+void ImageViewerSpectral::setColorimetry(size_t observer, size_t illuminant)
+{
+    if (observer >= _observers.size() || illuminant >= _illuminants.size()) {
+        return;
+    }
+
+    _observerIdx   = observer;
+    _illuminantIdx = illuminant;
+
+    applyColorimetry();
+
+    // Only relevant once back to RGB
+    if (_displayMode != DISPLAY_RGB) {
+        return;
+    }
+
+    uploadBandWeights();
+
+    const std::string key = resultKey();
+
+    // Already displayed: cancel any conversion in progress
+    if (_hasSpectralResult && key == _frontKey) {
+        _pendingTiles.clear();
+        _spectralNeedsUpdate = false;
+        return;
+    }
+
+    const GLuint cached = _textureCache.take(key);
+
+    if (cached != 0) {
+        _pendingTiles.clear();
+        _spectralNeedsUpdate = false;
+        _viewportNeedsUpdate = true;
+
+        if (!_frontKey.empty()) {
+            _textureCache.put(_frontKey, _imageViewerInTexture, spectralTextureBytes());
+        } else if (_tex_spectralBack == 0) {
+            _tex_spectralBack = _imageViewerInTexture;
+        } else {
+            glDeleteTextures(1, &_imageViewerInTexture);
+        }
+
+        _imageViewerInTexture = cached;
+        _frontKey             = key;
+
+        markInputChanged();
+    } else {
+        invalidateResults();
+    }
+}
+
+
+void ImageViewerSpectral::setRegion(int x0, int y0, int x1, int y1)
+{
+    _region[0] = std::max(0, std::min(x0, (int)imageWidth()));
+    _region[1] = std::max(0, std::min(y0, (int)imageHeight()));
+    _region[2] = std::max(_region[0], std::min(x1, (int)imageWidth()));
+    _region[3] = std::max(_region[1], std::min(y1, (int)imageHeight()));
+
+    _hasRegion = _region[2] > _region[0] && _region[3] > _region[1];
+
+    updateRegionStatistics(!_regionDragging);
+}
+
+
+void ImageViewerSpectral::clearRegion()
+{
+    _hasRegion   = false;
+    _regionFinal = false;
+
+    _regionMean.clear();
+    _regionStdDev.clear();
+}
+
+
+void ImageViewerSpectral::selectRegion(const glm::vec2 &windowStart, const glm::vec2 &windowEnd)
+{
+    const glm::vec2 a = windowToImage(windowStart);
+    const glm::vec2 b = windowToImage(windowEnd);
+
+    // Both corner pixels are included
+    setRegion(
+        (int)std::floor(std::min(a.x, b.x)),
+        (int)std::floor(std::min(a.y, b.y)),
+        (int)std::floor(std::max(a.x, b.x)) + 1,
+        (int)std::floor(std::max(a.y, b.y)) + 1);
+}
+
+
+void ImageViewerSpectral::updateRegionStatistics(bool final)
+{
+    const float *spectra = spectralData();
+
+    if (!_hasRegion || !spectra) {
+        clearRegion();
+        return;
+    }
+
+    if (!_integralImage.empty()) {
+        _integralImage.regionStatistics(_region[0], _region[1], _region[2], _region[3], _regionMean, _regionStdDev);
+        _regionFinal = true;
+    } else if (final) {
+        TRACE_SCOPE("Region statistics", "stats");
+
+        SpectralIntegralImage::regionStatistics(
+            spectra,
+            imageWidth(),
+            _nSpectralBands,
+            _region[0],
+            _region[1],
+            _region[2],
+            _region[3],
+            _regionMean,
+            _regionStdDev);
+
+        _regionFinal = true;
+    } else {
+        _regionFinal = false;
+    }
+}
+
+
+void ImageViewerSpectral::addObserver(const Colorimetry::Observer &observer)
+{
+    _observers.push_back(observer);
+}
+
+
+void ImageViewerSpectral::addIlluminant(const Colorimetry::Illuminant &illuminant)
+{
+    _illuminants.push_back(illuminant);
+}
+
+
+void ImageViewerSpectral::setDisplayMode(DisplayMode mode)
+{
+    _displayMode = mode;
+
+    if (_displayMode == DISPLAY_RGB) {
+        // Picks up the cached RGB result if any
+        setColorimetry(_observerIdx, _illuminantIdx);
+    } else {
+        uploadBandWeights();
+        invalidateResults();
+    }
+}
+
+
+void ImageViewerSpectral::setFalseColorBand(int band)
+{
+    _falseColorBand = std::max(0, std::min(band, (int)_nSpectralBands - 1));
+
+    if (_displayMode == DISPLAY_BAND) {
+        uploadBandWeights();
+        invalidateResults();
+    }
+}
+
+
+void ImageViewerSpectral::setFalseColorWindow(float wavelengthMin, float wavelengthMax)
+{
+    _falseColorWindow[0] = std::min(wavelengthMin, wavelengthMax);
+    _falseColorWindow[1] = std::max(wavelengthMin, wavelengthMax);
+
+    if (_displayMode == DISPLAY_RANGE) {
+        uploadBandWeights();
+        invalidateResults();
+    }
+}
+
+
+void ImageViewerSpectral::setFalseColorRange(float valueMin, float valueMax)
+{
+    _falseColorRange[0] = valueMin;
+    _falseColorRange[1] = valueMax;
+
+    // Applied by the display pass, the result still holds
+}
+
+
+void ImageViewerSpectral::fitFalseColorRange()
+{
+    const float *spectra = spectralData();
+
+    if (!spectra || _displayMode == DISPLAY_RGB) {
+        return;
+    }
+
+    size_t begin, end;
+    activeBands(begin, end);
+
+    // Already known for a single band
+    if (_displayMode == DISPLAY_BAND && !_bandStatistics.empty()) {
+        const BandStatistics::Band &band = _bandStatistics.band(begin);
+
+        if (band.min <= band.max) {
+            setFalseColorRange(band.min, band.max);
+        }
+
+        return;
+    }
+
+    const long nPixels = (long)imageWidth() * (long)imageHeight();
+
+    float valueMin = INFINITY;
+    float valueMax = -INFINITY;
+
+#pragma omp parallel for reduction(min : valueMin) reduction(max : valueMax)
+    for (long px = 0; px < nPixels; px++) {
+        const float *spectrum = &spectra[_nSpectralBands * px];
+
+        float value = 0.f;
+
+        if (_displayMode == DISPLAY_BAND) {
+            value = spectrum[begin];
+        } else {
+            for (size_t i = begin; i < end; i++) {
+                value += spectrum[i] * _imageWlBoundsWidths[i];
+            }
+        }
+
+        if (std::isfinite(value)) {
+            valueMin = std::min(valueMin, value);
+            valueMax = std::max(valueMax, value);
+        }
+    }
+
+    if (valueMin <= valueMax) {
+        setFalseColorRange(valueMin, valueMax);
+    }
+}
+
+
+void ImageViewerSpectral::activeBands(size_t &begin, size_t &end) const
+{
+    switch (_displayMode) {
+        case DISPLAY_BAND:
+            begin = _falseColorBand;
+            end   = begin + 1;
+            break;
+
+        case DISPLAY_RANGE:
+            begin = _nSpectralBands;
+            end   = 0;
+
+            for (size_t i = 0; i < _nSpectralBands; i++) {
+                if (_imageWavelengths[i] >= _falseColorWindow[0]
+                    && _imageWavelengths[i] <= _falseColorWindow[1]) {
+                    begin = std::min(begin, i);
+                    end   = i + 1;
+                }
+            }
+
+            if (begin > end) {
+                begin = end = 0;
+            }
+            break;
+
+        default:
+            begin = 0;
+            end   = _nSpectralBands;
+            break;
+    }
+}
+
+
+void ImageViewerSpectral::applyColorimetry()
+{
+    const Colorimetry::Observer   &observer   = _observers[_observerIdx];
+    const Colorimetry::Illuminant &illuminant = _illuminants[_illuminantIdx];
+
+    _converter.setCMF(observer.firstWavelength, observer.xyz);
+    _converter.setIlluminant(illuminant.firstWavelength, illuminant.spd);
+}
+
+
+void ImageViewerSpectral::uploadBandWeights()
+{
+    std::vector<float> weights;
+
+    if (_displayMode == DISPLAY_RGB) {
+        weights = _converter.bandWeightsRGB();
+    } else {
+        // The false color value is stored in every channel: the band value
+        // or the integral of the radiance over the wavelength window
+        size_t begin, end;
+        activeBands(begin, end);
+
+        weights.assign(3 * _nSpectralBands, 0.f);
+
+        for (size_t i = begin; i < end; i++) {
+            const float w = (_displayMode == DISPLAY_BAND) ? 1.f : _imageWlBoundsWidths[i];
+
+            weights[3 * i + 0] = w;
+            weights[3 * i + 1] = w;
+            weights[3 * i + 2] = w;
+        }
+    }
+
+    _weightsOffset[0] = _weightsOffset[1] = _weightsOffset[2] = 0.f;
+
+    if (_usePCA) {
+        std::vector<float> projected, offset;
+        _pca.projectWeights(weights, 3, projected, offset);
+
+        weights.swap(projected);
+        std::copy(offset.begin(), offset.end(), _weightsOffset);
+    }
+
+    glBindTexture(GL_TEXTURE_1D, _tex_bandWeights);
+    glTexImage1D(
+        GL_TEXTURE_1D,
+        0,
+        GL_RGB32F,
+        textureBands(),
+        0,
+        GL_RGB,
+        GL_FLOAT,
+        weights.data());
+    glBindTexture(GL_TEXTURE_1D, 0);
+}
+
+
+void ImageViewerSpectral::uploadColormap()
+{
+    const std::vector<unsigned int> &colors = COLORMAPS[_colormapIdx].colors;
+
+    // Linearized since the display pass applies the transfer function
+    auto toLinear = [](unsigned int c) {
+        const float v = c / 255.f;
+        return (v <= 0.04045f) ? v / 12.92f : std::pow((v + 0.055f) / 1.055f, 2.4f);
+    };
+
+    std::vector<float> values(3 * colors.size());
+
+    for (size_t i = 0; i < colors.size(); i++) {
+        values[3 * i + 0] = toLinear((colors[i] >> 16) & 0xff);
+        values[3 * i + 1] = toLinear((colors[i] >> 8) & 0xff);
+        values[3 * i + 2] = toLinear(colors[i] & 0xff);
+    }
+
+    glBindTexture(GL_TEXTURE_1D, _tex_colormap);
+    glTexImage1D(
+        GL_TEXTURE_1D,
+        0,
+        GL_RGB32F,
+        colors.size(),
+        0,
+        GL_RGB,
+        GL_FLOAT,
+        values.data());
+    glBindTexture(GL_TEXTURE_1D, 0);
+}
+
+
+std::string ImageViewerSpectral::resultKey() const
+{
+    // False color results are cheap and change too often to be worth caching
+    if (_displayMode != DISPLAY_RGB) {
+        return "";
+    }
+
+    // Observers and illuminants are only appended, their indices are stable
+    return std::to_string(_observerIdx) + "/"
+           + (_hasReflective ? std::to_string(_illuminantIdx) : "-");
+}
+
+
+GLuint ImageViewerSpectral::createSpectralTexture() const
+{
+    GLuint texture;
+
+    glGenTextures(1, &texture);
+    glBindTexture(GL_TEXTURE_2D, texture);
+
+    glTexImage2D(
+        GL_TEXTURE_2D,
+        0,
+        GL_RGBA32F,
+        imageWidth(),
+        imageHeight(),
+        0,
+        GL_RGBA,
+        GL_FLOAT,
+        0);
+
+    float borderColor[] = {0.f, 0.f, 0.f, 0.f};
+    glTexParameterfv(GL_TEXTURE_2D, GL_TEXTURE_BORDER_COLOR, borderColor);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_BORDER);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_BORDER);
+
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+
+    glBindTexture(GL_TEXTURE_2D, 0);
+
+    return texture;
+}
+
+
+size_t ImageViewerSpectral::spectralTextureBytes() const
+{
+    return size_t(imageWidth()) * size_t(imageHeight()) * 4 * sizeof(float);
+}
+
+
+bool ImageViewerSpectral::computeShaderAvailable() const
+{
+    return _computeProgram && textureBands() <= COMPUTE_MAX_BANDS;
+}
+
+
+unsigned int ImageViewerSpectral::textureBands() const
+{
+    return _usePCA ? _pca.nComponents() : _nSpectralBands;
+}
+
+
+void ImageViewerSpectral::uploadSpectralImage(const float *spectra)
+{
+    const size_t nPixels = size_t(imageWidth()) * size_t(imageHeight());
+
+    if (_bandStatistics.nBands() != _nSpectralBands || _bandStatistics.nPixels() != nPixels) {
+        TRACE_SCOPE("Band statistics", "stats");
+
+        _bandStatistics.compute(spectra, nPixels, _nSpectralBands);
+    }
+
+    seedDisplayDefaults();
+
+    _usePCA = false;
+    _pcaError.clear();
+
+    if (_pcaComponents > 0 && _pcaComponents < _nSpectralBands) {
+        try {
+            TRACE_SCOPE("PCA compression", "layout");
+
+            _pca.compute(spectra, nPixels, _nSpectralBands, _pcaComponents);
+            _usePCA = true;
+        } catch (const std::exception &e) {
+            // Falls back on the bands
+            _pcaError = e.what();
+        }
+    }
+
+    glActiveTexture(GL_TEXTURE0);
+    glBindTexture(GL_TEXTURE_3D, _tex_imageViewerSpectralIn);
+
+    {
+        TRACE_SCOPE("Texture upload", "upload");
+
+        // Same layout for bands and coefficients:
+        // data[nBands * (width * y + x) + band]
+        glTexImage3D(
+            GL_TEXTURE_3D,
+            0,
+            GL_R32F,
+            textureBands(),
+            imageWidth(),
+            imageHeight(),
+            0,
+            GL_RED,
+            GL_FLOAT,
+            _usePCA ? _pca.coefficients().data() : spectra);
+    }
+
+    glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+    glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+
+    glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_BORDER);
+    glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_BORDER);
+
+    glBindTexture(GL_TEXTURE_3D, 0);
+
+    if (_usePCA) {
+        _pca.releaseCoefficients();
+    }
+
+    // Weights are projected on the basis
+    uploadBandWeights();
+    invalidateResults();
+
+    // The spectrum under the mouse is read again from the new cube
+    _spectrumRequestX = -1;
+    _spectrumRequestY = -1;
+
+    // Region statistics follow the selection at a constant cost
+    _integralImage.clear();
+    clearRegion();
+
+    if (SpectralIntegralImage::bytes(imageWidth(), imageHeight(), _nSpectralBands) <= REGION_TABLES_MAX_BYTES) {
+        TRACE_SCOPE("Summed-area tables", "stats");
+
+        _integralImage.compute(spectra, imageWidth(), imageHeight(), _nSpectralBands);
+    }
+
+    // Built on demand from the new cube
+    _pyramids.clear();
+    _bandCovariance.reset(0);
+}
+
+
+void ImageViewerSpectral::seedDisplayDefaults()
+{
+    if (_bandStatistics.nBands() != _nSpectralBands) {
+        return;
+    }
+
+    std::vector<float> highSpectrum(_nSpectralBands);
+
+    float valueMin = INFINITY;
+    float valueMax = -INFINITY;
+
+    for (size_t b = 0; b < _nSpectralBands; b++) {
+        const float low  = _bandStatistics.percentile(b, SEED_LOW_PERCENTILE);
+        const float high = _bandStatistics.percentile(b, SEED_HIGH_PERCENTILE);
+
+        // NaN for bands without any finite value
+        if (std::isfinite(low) && std::isfinite(high)) {
+            valueMin = std::min(valueMin, low);
+            valueMax = std::max(valueMax, high);
+        }
+
+        highSpectrum[b] = std::isfinite(high) ? high : 0.f;
+    }
+
+    // Bright pixels, all bands at their high percentile, map to white
+    const glm::vec3 rgb       = _converter.convertPixel(highSpectrum.data());
+    const float     luminance = 0.2126f * rgb.r + 0.7152f * rgb.g + 0.0722f * rgb.b;
+
+    if (luminance > 0.f && std::isfinite(luminance)) {
+        _exposure = -std::log2(luminance);
+    }
+
+    // Spans the single band values of every band
+    if (valueMin < valueMax) {
+        _falseColorRange[0] = valueMin;
+        _falseColorRange[1] = valueMax;
+    }
+}
+
+
+void ImageViewerSpectral::makeCacheEntry(DerivedDataCache::Entry &entry)
+{
+    TRACE_SCOPE("Cache entry", "stats");
+
+    const float *spectra = spectralData();
+    const size_t nPixels = size_t(imageWidth()) * size_t(imageHeight());
+
+    if (!spectra) {
+        throw std::runtime_error("No spectral data resident in memory");
+    }
+
+    // Same state as initGL() sets, so the preview matches the display
+    applyColorimetry();
+    _converter.setBands(_imageWavelengths, _imageWlBoundsWidths, _hasReflective);
+
+    if (_bandStatistics.nBands() != _nSpectralBands || _bandStatistics.nPixels() != nPixels) {
+        TRACE_SCOPE("Band statistics", "stats");
+
+        _bandStatistics.compute(spectra, nPixels, _nSpectralBands);
+    }
+
+    seedDisplayDefaults();
+
+    entry.width       = imageWidth();
+    entry.height      = imageHeight();
+    entry.reflective  = _hasReflective;
+    entry.wavelengths = _imageWavelengths;
+    entry.exposure    = _exposure;
+    entry.statistics  = _bandStatistics;
+
+    DerivedDataCache::makePreview(spectra, imageWidth(), imageHeight(), _converter, entry);
+}
+
+
+void ImageViewerSpectral::startConversion()
+{
+    allocateImageResult();
+
+    // Until a first result exists, tiles are rendered straight to the
+    // displayed texture. Afterwards, the previous result stays visible.
+    if (_hasSpectralResult && _tex_spectralBack == 0) {
+        _tex_spectralBack = createSpectralTexture();
+    }
+
+    _tex_spectralTarget = _hasSpectralResult ? _tex_spectralBack : _imageViewerInTexture;
+    _targetKey          = resultKey();
+
+    glBindFramebuffer(GL_FRAMEBUFFER, _fbo_imageViewerSpectral);
+    glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, _tex_spectralTarget, 0);
+    glBindFramebuffer(GL_FRAMEBUFFER, 0);
+
+    const unsigned int tileSize = _progressive
+                                      ? PROGRESSIVE_TILE_SIZE
+                                      : std::max(imageWidth(), imageHeight());
+
+    _pendingTiles.clear();
+
+    for (unsigned int y = 0; y < imageHeight(); y += tileSize) {
+        for (unsigned int x = 0; x < imageWidth(); x += tileSize) {
+            SpectralTile tile;
+            tile.x      = x;
+            tile.y      = y;
+            tile.width  = std::min(tileSize, imageWidth() - x);
+            tile.height = std::min(tileSize, imageHeight() - y);
+
+            _pendingTiles.push_back(tile);
+        }
+    }
+
+    _nTiles = _pendingTiles.size();
+
+    // Tiles are consumed from the back: the ones near the center of the
+    // viewport are sorted last
+    const glm::vec2 center = windowToImage(glm::vec2(windowWidth() / 2, windowHeight() / 2));
+
+    auto distance = [&center](const SpectralTile &t) {
+        const float dx = t.x + t.width / 2.f - center.x;
+        const float dy = t.y + t.height / 2.f - center.y;
+
+        return dx * dx + dy * dy;
+    };
+
+    std::sort(
+        _pendingTiles.begin(),
+        _pendingTiles.end(),
+        [&distance](const SpectralTile &a, const SpectralTile &b) {
+            return distance(a) > distance(b);
+        });
+}
+
+
+void ImageViewerSpectral::continueConversion()
+{
+    TRACE_SCOPE("Spectral pass", "render");
+
+    collectTileTimings();
+
+    // As many tiles as the GPU time measured on the previous frames allows,
+    // at least one per frame
+    size_t nTiles = _pendingTiles.size();
+
+    if (_progressive) {
+        nTiles = 1;
+
+        if (_tileGpuMs > 0.) {
+            nTiles = std::max(size_t(1), size_t(_frameBudgetMs / _tileGpuMs));
+        }
+
+        nTiles = std::min(nTiles, _pendingTiles.size());
+    }
+
+    // Without a free query, the frame is converted but not measured
+    TileTiming &timing  = _tileTimings[_tileTimingIdx];
+    const bool  measure = _progressive && !timing.pending;
+
+    if (measure) {
+        glQueryCounter(timing.queries[0], GL_TIMESTAMP);
+    }
+
+    for (size_t i = 0; i < nTiles; i++) {
+        const SpectralTile tile = _pendingTiles.back();
+        _pendingTiles.pop_back();
+
+        if (_useComputeShader && computeShaderAvailable()) {
+            convertCompute(tile);
+        } else {
+            convertFragment(tile);
+        }
+    }
+
+    if (measure) {
+        glQueryCounter(timing.queries[1], GL_TIMESTAMP);
+
+        timing.nTiles  = nTiles;
+        timing.pending = true;
+        _tileTimingIdx = (_tileTimingIdx + 1) % TILE_QUERY_FRAMES;
+    }
+
+    // Tiles written to the back texture are not shown until it is swapped
+    // in: the displayed image is unchanged meanwhile
+    if (_tex_spectralTarget == _imageViewerInTexture) {
+        markInputChanged();
+    }
+
+    if (_pendingTiles.empty()) {
+        // Present the new result
+        if (_tex_spectralTarget != _imageViewerInTexture) {
+            if (_targetKey == _frontKey || _frontKey.empty()) {
+                std::swap(_imageViewerInTexture, _tex_spectralBack);
+            } else {
+                // Keep the previous combination around to switch back
+                _textureCache.put(_frontKey, _imageViewerInTexture, spectralTextureBytes());
+
+                _imageViewerInTexture = _tex_spectralBack;
+                _tex_spectralBack     = 0;
+            }
+
+            markInputChanged();
+        }
+
+        _frontKey          = _targetKey;
+        _hasSpectralResult = true;
+    }
+}
+
+
+void ImageViewerSpectral::getUniforms(GLuint program, SpectralUniforms &uniforms) const
+{
+    uniforms.spectralImage   = glGetUniformLocation(program, "spectralImage");
+    uniforms.bandWeights     = glGetUniformLocation(program, "bandWeights");
+    uniforms.weightsOffset   = glGetUniformLocation(program, "weightsOffset");
+    uniforms.nSpectralBands  = glGetUniformLocation(program, "nSpectralBands");
+    uniforms.bandBegin       = glGetUniformLocation(program, "bandBegin");
+    uniforms.bandEnd         = glGetUniformLocation(program, "bandEnd");
+    uniforms.tileOffset      = glGetUniformLocation(program, "tileOffset");
+    uniforms.tileSize        = glGetUniformLocation(program, "tileSize");
+
+    uniforms.zoomMatrix       = glGetUniformLocation(program, "zoomMatrix");
+    uniforms.aspectMatrix     = glGetUniformLocation(program, "aspectMatrix");
+    uniforms.translateMatrix  = glGetUniformLocation(program, "translateMatrix");
+    uniforms.footprintSamples = glGetUniformLocation(program, "footprintSamples");
+}
+
+
+void ImageViewerSpectral::setUniforms(const SpectralUniforms &uniforms) const
+{
+    // Bind textures
+    glActiveTexture(GL_TEXTURE0);
+    glBindTexture(GL_TEXTURE_3D, _tex_imageViewerSpectralIn);
+
+    glActiveTexture(GL_TEXTURE1);
+    glBindTexture(GL_TEXTURE_1D, _tex_bandWeights);
+
+    // Set texture units
+    glUniform1i(uniforms.spectralImage, 0);
+    glUniform1i(uniforms.bandWeights, 1);
+
+    // Other parameters
+    size_t begin = 0, end = textureBands();
+
+    // All the components contribute to any band
+    if (!_usePCA) {
+        activeBands(begin, end);
+    }
+
+    glUniform3fv(uniforms.weightsOffset, 1, _weightsOffset);
+    glUniform1ui(uniforms.nSpectralBands, textureBands());
+    glUniform1ui(uniforms.bandBegin, begin);
+    glUniform1ui(uniforms.bandEnd, end);
+}
+
+
+void ImageViewerSpectral::collectTileTimings()
+{
+    for (TileTiming &timing : _tileTimings) {
+        if (!timing.pending) {
+            continue;
+        }
+
+        GLint available = GL_FALSE;
+        glGetQueryObjectiv(timing.queries[1], GL_QUERY_RESULT_AVAILABLE, &available);
+
+        if (!available) {
+            continue;
+        }
+
+        GLuint64 t0, t1;
+        glGetQueryObjectui64v(timing.queries[0], GL_QUERY_RESULT, &t0);
+        glGetQueryObjectui64v(timing.queries[1], GL_QUERY_RESULT, &t1);
+
+        timing.pending = false;
+
+        const double tileMs = double(t1 - t0) * 1e-6 / double(timing.nTiles);
+
+        // Smoothed, the cost of a tile varies with its content and the load
+        _tileGpuMs = _tileGpuMs < 0. ? tileMs : 0.5 * (_tileGpuMs + tileMs);
+    }
+}
+
+
+void ImageViewerSpectral::convertFragment(const SpectralTile &tile)
+{
+    glBindFramebuffer(GL_FRAMEBUFFER, _fbo_imageViewerSpectral);
+    glViewport(0, 0, imageWidth(), imageHeight());
+
+    glEnable(GL_SCISSOR_TEST);
+    glScissor(tile.x, tile.y, tile.width, tile.height);
+
+    glUseProgram(_shaderProgram->get());
+    setUniforms(_loc_fragment);
+
+    glBindVertexArray(_vao);
+    glDrawElements(GL_TRIANGLES, 6, GL_UNSIGNED_INT, 0);
+
+    glDisable(GL_SCISSOR_TEST);
+
+    glBindTexture(GL_TEXTURE_1D, 0);
+    glActiveTexture(GL_TEXTURE0);
+    glBindTexture(GL_TEXTURE_3D, 0);
+    glBindVertexArray(0);
+
+    glUseProgram(0);
+    glBindFramebuffer(GL_FRAMEBUFFER, 0);
+}
+
+
+void ImageViewerSpectral::convertCompute(const SpectralTile &tile)
+{
+    glBindImageTexture(0, _tex_spectralTarget, 0, GL_FALSE, 0, GL_WRITE_ONLY, GL_RGBA32F);
+
+    glUseProgram(_computeProgram->get());
+    setUniforms(_loc_compute);
+
+    glUniform2i(_loc_compute.tileOffset, tile.x, tile.y);
+    glUniform2i(_loc_compute.tileSize, tile.width, tile.height);
+
+    glDispatchCompute(
+        (tile.width + COMPUTE_TILE_SIZE - 1) / COMPUTE_TILE_SIZE,
+        (tile.height + COMPUTE_TILE_SIZE - 1) / COMPUTE_TILE_SIZE,
+        1);
+
+    // The display pass samples the result
+    glMemoryBarrier(GL_TEXTURE_FETCH_BARRIER_BIT | GL_SHADER_IMAGE_ACCESS_BARRIER_BIT);
+
+    glBindImageTexture(0, 0, 0, GL_FALSE, 0, GL_WRITE_ONLY, GL_RGBA32F);
+    glBindTexture(GL_TEXTURE_1D, 0);
+    glActiveTexture(GL_TEXTURE0);
+    glBindTexture(GL_TEXTURE_3D, 0);
+
+    glUseProgram(0);
+}
+
+
+void ImageViewerSpectral::invalidateResults()
+{
+    _spectralNeedsUpdate = true;
+    _viewportNeedsUpdate = true;
+}
+
+
+void ImageViewerSpectral::allocateImageResult()
+{
+    if (_imageResultAllocated) {
+        return;
+    }
+
+    glBindTexture(GL_TEXTURE_2D, _imageViewerInTexture);
+
+    glTexImage2D(
+        GL_TEXTURE_2D,
+        0,
+        GL_RGBA32F,
+        imageWidth(),
+        imageHeight(),
+        0,
+        GL_RGBA,
+        GL_FLOAT,
+        0);
+
+    glBindTexture(GL_TEXTURE_2D, 0);
+
+    _imageResultAllocated = true;
+}
+
+
+void ImageViewerSpectral::kernelSpectrum(int x, int y, int size, std::vector<float> &spectrum) const
+{
+    const float *spectra = spectralData();
+
+    const int x0 = std::max(0, x - size / 2);
+    const int y0 = std::max(0, y - size / 2);
+    const int x1 = std::min((int)imageWidth(), x + size / 2 + 1);
+    const int y1 = std::min((int)imageHeight(), y + size / 2 + 1);
+
+    spectrum.assign(_nSpectralBands, 0.f);
+
+    // Spectra are contiguous in the band first layout
+    for (int j = y0; j < y1; j++) {
+        for (int i = x0; i < x1; i++) {
+            const float *s = &spectra[size_t(_nSpectralBands) * (size_t(j) * imageWidth() + i)];
+
+            for (size_t b = 0; b < _nSpectralBands; b++) {
+                spectrum[b] += s[b];
+            }
+        }
+    }
+
+    const float n = float((x1 - x0) * (y1 - y0));
+
+    for (float &v : spectrum) {
+        v /= n;
+    }
+}
+
+
+void ImageViewerSpectral::updateSpectrumReadback()
+{
+    if (_spectrumReadback.poll()) {
+        const std::vector<float> &values = _spectrumReadback.result();
+
+        if (_usePCA && values.size() == _pca.nComponents()) {
+            _spectrumAtMousePosition.resize(_nSpectralBands);
+            _pca.reconstruct(values.data(), _spectrumAtMousePosition.data());
+        } else {
+            _spectrumAtMousePosition = values;
+        }
+
+        _xSpectrumMouseOver = PixelReadback::tagX(_spectrumReadback.resultTag());
+        _ySpectrumMouseOver = PixelReadback::tagY(_spectrumReadback.resultTag());
+
+        _readbackUpdated = true;
+    }
+
+    // Not needed when the spectra are resident in memory
+    if (spectralData()) {
+        return;
+    }
+
+    int x, y;
+
+    if (!mouseImagePixel(x, y) || (x == _spectrumRequestX && y == _spectrumRequestY)) {
+        return;
+    }
+
+    // The cube is (bands, width, height): layer y holds the spectra of row
+    // y, one pixel per texture row
+    if (_spectrumReadback.request(
+            _tex_imageViewerSpectralIn,
+            y,
+            0,
+            x,
+            textureBands(),
+            1,
+            1,
+            PixelReadback::pixelTag(x, y))) {
+        _spectrumRequestX = x;
+        _spectrumRequestY = y;
+    }
+}
+
+
+GLuint ImageViewerSpectral::displayTexture() const
+{
+    return _viewportActive ? _tex_viewport : _imageViewerInTexture;
+}
+
+
+void ImageViewerSpectral::renderViewport()
+{
+    TRACE_SCOPE("Viewport spectral pass", "render");
+
+    if (_viewportWidth != windowWidth() || _viewportHeight != windowHeight()) {
+        _viewportWidth  = windowWidth();
+        _viewportHeight = windowHeight();
+
+        glBindTexture(GL_TEXTURE_2D, _tex_viewport);
+        glTexImage2D(
+            GL_TEXTURE_2D,
+            0,
+            GL_RGBA32F,
+            _viewportWidth,
+            _viewportHeight,
+            0,
+            GL_RGBA,
+            GL_FLOAT,
+            nullptr);
+        glBindTexture(GL_TEXTURE_2D, 0);
+
+        glBindFramebuffer(GL_FRAMEBUFFER, _fbo_viewport);
+        glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, _tex_viewport, 0);
+        glBindFramebuffer(GL_FRAMEBUFFER, 0);
+
+        _viewportNeedsUpdate = true;
+    }
+
+    // Only the view and the conversion settings affect the result, the
+    // exposure and gamma are applied by the display pass
+    const glm::mat3 transform = _aspectMatrix * _translateMatrix * _zoomMatrix;
+
+    if (!_viewportNeedsUpdate && transform == _viewportTransform) {
+        return;
+    }
+
+    glBindFramebuffer(GL_FRAMEBUFFER, _fbo_viewport);
+    glViewport(0, 0, _viewportWidth, _viewportHeight);
+
+    glClearColor(0.f, 0.f, 0.f, 0.f);
+    glClear(GL_COLOR_BUFFER_BIT);
+
+    glUseProgram(_viewportProgram->get());
+    setUniforms(_loc_viewport);
+
+    glUniformMatrix3fv(_loc_viewport.zoomMatrix, 1, GL_FALSE, glm::value_ptr(_zoomMatrix));
+    glUniformMatrix3fv(_loc_viewport.aspectMatrix, 1, GL_FALSE, glm::value_ptr(_aspectMatrix));
+    glUniformMatrix3fv(_loc_viewport.translateMatrix, 1, GL_FALSE, glm::value_ptr(_translateMatrix));
+    glUniform1i(_loc_viewport.footprintSamples, _footprintSamples);
+
+    glBindVertexArray(_vao);
+    glDrawElements(GL_TRIANGLES, 6, GL_UNSIGNED_INT, 0);
+
+    glBindTexture(GL_TEXTURE_1D, 0);
+    glActiveTexture(GL_TEXTURE0);
+    glBindTexture(GL_TEXTURE_3D, 0);
+    glBindVertexArray(0);
+
+    glUseProgram(0);
+    glBindFramebuffer(GL_FRAMEBUFFER, 0);
+
+    _viewportTransform   = transform;
+    _viewportNeedsUpdate = false;
+
+    markInputChanged();
+}
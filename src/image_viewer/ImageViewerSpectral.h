@@ -2,13 +2,50 @@
 
 #include "ImageViewer.h"
 
+#include "ExposureMeter.h"
+#include "ImageScopes.h"
+#include "SpectralTextureCache.h"
+
+#include <image_format/DerivedDataCache.h>
+#include <spectral/BandCovariance.h>
+#include <spectral/BandStatistics.h>
+#include <spectral/Colorimetry.h>
+#include <spectral/SpectralConverter.h>
+#include <spectral/SpectralIntegralImage.h>
+#include <spectral/SpectralPCA.h>
+#include <spectral/StatisticsPyramid.h>
+
+#include <future>
+#include <memory>
 #include <string>
+#include <utility>
 #include <vector>
 
 
 class ImageViewerSpectral: public ImageViewer
 {
   public:
+    enum DisplayMode
+    {
+        DISPLAY_RGB,
+        DISPLAY_BAND,    // Single band through a colormap
+        DISPLAY_RANGE,   // Integral over a wavelength window through a colormap
+    };
+
+    enum AutoExposure
+    {
+        AUTO_EXPOSURE_OFF,
+        AUTO_EXPOSURE_LOG_AVERAGE,   // Log-average luminance to middle gray
+        AUTO_EXPOSURE_PERCENTILE,    // Luminance percentile to the display white
+    };
+
+    enum ResolutionMode
+    {
+        RESOLUTION_AUTO,       // Viewport when zoomed out past VIEWPORT_MIN_FOOTPRINT
+        RESOLUTION_IMAGE,      // Full image, resampled by the display pass
+        RESOLUTION_VIEWPORT,   // Visible screen pixels only
+    };
+
     ImageViewerSpectral();
 
     virtual ~ImageViewerSpectral();
@@ -17,7 +54,23 @@ class ImageViewerSpectral: public ImageViewer
     // GUI elements
     // ------------------------------------------------------------------------
 
+    virtual void gui();
+
+    virtual void gui_colorControl();
+    virtual void gui_renderingControl();
+    virtual void gui_colorimetryControl();
+    virtual void gui_falseColorControl();
+
     virtual void gui_inspectorTool();
+    virtual void gui_bandStatistics();
+    virtual void gui_spectrumPlot();
+    virtual void gui_regionTool();
+    virtual void gui_scopesTool();
+    virtual void gui_bandAnalysisTool();
+    virtual void gui_cpuReferenceTool();
+
+    virtual void menuImageControls();
+    virtual void menuImageTools();
 
     // ------------------------------------------------------------------------
     // OpenGL
@@ -26,7 +79,182 @@ class ImageViewerSpectral: public ImageViewer
     virtual void initGL();
     virtual void render();
 
+    virtual void drawOverlay(ImDrawList *drawList, const glm::vec2 &origin);
+
+    // Left button drags select a region instead of moving the image while
+    // the region selection is enabled
+    virtual void mouseLeftPress(double xpos, double ypos);
+    virtual void mouseLeftDrag(double xpos, double ypos);
+    virtual void mouseLeftRelease(double xpos, double ypos);
+
+    // Compute path needs OpenGL 4.3 and the weights to fit in shared memory
+    bool computeShaderAvailable() const;
+
+    static const unsigned int COMPUTE_MAX_BANDS = 1024;
+    static const unsigned int COMPUTE_TILE_SIZE = 32;
+
+    // True while a spectral conversion is pending or in progress
+    virtual bool isConverting() const { return !_viewportActive && (_spectralNeedsUpdate || !_pendingTiles.empty()); }
+
+    virtual bool needsRedraw() const
+    {
+        return isConverting() || _spectrumReadback.isPending() || _scopes.isPending()
+               || _scopesReadback.isPending() || _exposureMeter.isPending() || _pyramidBuild.valid()
+               || ImageViewer::needsRedraw();
+    }
+
+    static const unsigned int PROGRESSIVE_TILE_SIZE = 256;
+
+    // Largest averaging kernel of the inspector
+    static const int INSPECTOR_MAX_KERNEL = 31;
+
+    // Stops shown by the scopes, relative to the display white
+    static constexpr float SCOPES_MIN_EV = -12.f;
+    static constexpr float SCOPES_MAX_EV = 4.f;
+
+    // Conversion settings of the rendering control
+    void setComputeShader(bool enable);
+    void setProgressive(bool enable) { _progressive = enable; }
+    void setResolutionMode(ResolutionMode mode) { _resolutionMode = mode; }
+
+    // Discards the current result, converted again by the next render()
+    void reconvert() { invalidateResults(); }
+
+    // True when spectra are evaluated for the visible screen pixels, by
+    // integrating over each pixel's footprint, instead of the whole image
+    bool useViewportResolution() const;
+
+    // Image pixels per screen pixel from which the automatic mode switches
+    // to the viewport resolution
+    static constexpr float VIEWPORT_MIN_FOOTPRINT = 2.f;
+
+    // ------------------------------------------------------------------------
+    // Automatic exposure
+    // ------------------------------------------------------------------------
+
+    // The exposure follows the displayed result, metered on the GPU each
+    // time its content or the view changes
+    void setAutoExposure(AutoExposure mode);
+    void setAutoExposurePercentile(float percentile);
+    void setAutoExposureVisibleOnly(bool visibleOnly);
+
+    // Luminance mapped to middle gray by the log-average mode
+    static constexpr float MIDDLE_GRAY = 0.18f;
+
+    // Fits the displayed values of the visible region: the exposure maps the
+    // brightest luminance to the display white in RGB, the false color range
+    // spans the values otherwise. Queries a pyramid of the values built from
+    // the CPU copy, so it follows the view at no cost. Pyramids are built in
+    // the background, once per displayed values, the range being kept
+    // meanwhile. Exclusive with the automatic exposure.
+    void setAutoContrast(bool enable);
+
+    // Recently displayed values for which a pyramid is kept
+    static const size_t PYRAMID_CACHE_SIZE = 4;
+
+    // ------------------------------------------------------------------------
+    // CPU access
+    // ------------------------------------------------------------------------
+
+    // Spectral data resident in memory, band first (see SpectralConverter)
+    virtual const float *spectralData() const { return nullptr; }
+
+    const SpectralConverter &converter() const { return _converter; }
+
+    // Per band statistics of the whole cube, gathered when it is uploaded
+    const BandStatistics &bandStatistics() const { return _bandStatistics; }
+
+    // Statistics known beforehand, from the derived data cache, are not
+    // gathered again on upload
+    void setBandStatistics(const BandStatistics &statistics) { _bandStatistics = statistics; }
+
+    // Fills the probe, statistics, preview and exposure of a cache entry
+    // from the resident cube. CPU only: may be called by a loading
+    // thread before initGL().
+    void makeCacheEntry(DerivedDataCache::Entry &entry);
+
+    // Percentiles seeding the exposure and the false color range of a new
+    // image, robust to a few outliers such as fireflies
+    static constexpr float SEED_LOW_PERCENTILE  = 0.005f;
+    static constexpr float SEED_HIGH_PERCENTILE = 0.995f;
+
+    // ------------------------------------------------------------------------
+    // Region statistics
+    // ------------------------------------------------------------------------
+
+    // Selects the pixels [x0, x1) x [y0, y1), clipped to the image
+    void setRegion(int x0, int y0, int x1, int y1);
+    void clearRegion();
+
+    bool hasRegion() const { return _hasRegion; }
+
+    // Per band statistics of the selected region
+    const std::vector<float> &regionMean() const { return _regionMean; }
+    const std::vector<float> &regionStdDev() const { return _regionStdDev; }
+
+    // Summed-area tables are built when the image is uploaded and fit in
+    // this budget, regions are summed directly otherwise
+    static const size_t REGION_TABLES_MAX_BYTES = size_t(1) << 30;
+
+    // ------------------------------------------------------------------------
+    // Band analysis
+    // ------------------------------------------------------------------------
+
+    // Band to band covariance of the resident cube, on request since it
+    // costs nBands^2 / 2 products per pixel
+    void computeBandCovariance();
+
+    const BandCovariance &bandCovariance() const { return _bandCovariance; }
+
+    // ------------------------------------------------------------------------
+    // Colorimetry
+    // ------------------------------------------------------------------------
+
+    // Results of previous combinations are reused when still cached
+    void setColorimetry(size_t observer, size_t illuminant);
+
+    void addObserver(const Colorimetry::Observer &observer);
+    void addIlluminant(const Colorimetry::Illuminant &illuminant);
+
+    // ------------------------------------------------------------------------
+    // False color
+    // ------------------------------------------------------------------------
+
+    void setDisplayMode(DisplayMode mode);
+    void setFalseColorBand(int band);
+    void setFalseColorWindow(float wavelengthMin, float wavelengthMax);
+    void setFalseColorRange(float valueMin, float valueMax);
+
+    // Range of the displayed values, evaluated on the CPU copy
+    void fitFalseColorRange();
+
+    // ------------------------------------------------------------------------
+    // PCA compression
+    // ------------------------------------------------------------------------
+
+    // Number of principal components stored on the GPU instead of the bands,
+    // 0 disables the compression. Takes effect when the image is uploaded.
+    void setPCAComponents(size_t nComponents) { _pcaComponents = nComponents; }
+
+    bool isPCACompressed() const { return _usePCA; }
+
+    const SpectralPCA &pca() const { return _pca; }
+
   protected:
+    // Uploads the cube to _tex_imageViewerSpectralIn, as PCA coefficients
+    // when the compression is enabled
+    void uploadSpectralImage(const float *spectra);
+
+    // Bands stored in the spectral texture
+    unsigned int textureBands() const;
+
+    // Exposure and false color range from the band statistics
+    void seedDisplayDefaults();
+
+    // The background build reads the spectral data: to call before the data
+    // it reads is released or replaced
+    void waitPyramidBuild();
+
     GLuint _tex_imageViewerSpectralIn;
 
     unsigned int       _nSpectralBands;
@@ -38,42 +266,279 @@ class ImageViewerSpectral: public ImageViewer
     bool _hasEmissive;
     bool _hasReflective;
 
+    SpectralConverter _converter;
+
+    std::vector<Colorimetry::Observer>   _observers;
+    std::vector<Colorimetry::Illuminant> _illuminants;
+    size_t                               _observerIdx;
+    size_t                               _illuminantIdx;
+
+    SpectralTextureCache _textureCache;
+    int                  _cacheCapacityMB;
+
+    // PCA compression
+    size_t      _pcaComponents;
+    SpectralPCA _pca;
+    bool        _usePCA;
+    std::string _pcaError;
+
+    // False color
+    DisplayMode _displayMode;
+    int         _falseColorBand;
+    float       _falseColorWindow[2];
+    float       _falseColorRange[2];
+    size_t      _colormapIdx;
+
+    // GUI
+    bool _showRenderingControl;
+    bool _showColorimetryControl;
+    bool _showFalseColorControl;
+    bool _showCPUReference;
+
+    bool        _useComputeShader;
+    std::string _computeError;
+
+    // Progressive conversion
+    bool  _progressive;
+    float _frameBudgetMs;
+
+    // Viewport resolution
+    ResolutionMode _resolutionMode;
+    int            _footprintSamples;
+
+    virtual GLuint displayTexture() const;
+    virtual bool   isDisplayTextureWindowAligned() const { return _viewportActive; }
+
   private:
+    struct SpectralTile {
+        unsigned int x, y;
+        unsigned int width, height;
+    };
+
+    struct SpectralUniforms {
+        GLint spectralImage;
+        GLint bandWeights;
+        GLint weightsOffset;
+        GLint nSpectralBands;
+        GLint bandBegin, bandEnd;
+        GLint tileOffset, tileSize;
+        GLint zoomMatrix, aspectMatrix, translateMatrix;
+        GLint footprintSamples;
+    };
+
+    void getUniforms(GLuint program, SpectralUniforms &uniforms) const;
+    void setUniforms(const SpectralUniforms &uniforms) const;
+
+    void applyColorimetry();
+    void uploadBandWeights();
+    void uploadColormap();
+
+    // Bands [begin, end) contributing to the current display mode
+    void activeBands(size_t &begin, size_t &end) const;
+
+    // Empty for results that are not cached
+    std::string resultKey() const;
+
+    GLuint createSpectralTexture() const;
+    size_t spectralTextureBytes() const;
+
+    void startConversion();
+    void continueConversion();
+
+    void convertFragment(const SpectralTile &tile);
+    void convertCompute(const SpectralTile &tile);
+
+    // Reads the tile timings that are available, never waits for the GPU
+    void collectTileTimings();
+
+    // Results are outdated after any change of the conversion settings
+    void invalidateResults();
+
+    void allocateImageResult();
+    void renderViewport();
+
+    // Collects the last spectrum read back and queues a read of the cube
+    // at the mouse position, unless the spectra are resident in memory
+    void updateSpectrumReadback();
+
+    // XYZ, linear RGB and Lab of a spectrum
+    void gui_spectrumColors(const float *spectrum);
+
+    // Pixels of the image shown in the window, as x, y, width, height
+    void visibleImageRegion(int region[4]) const;
+
+    // Identifies the values displayed by the current mode, regardless of
+    // the false color range
+    std::string displayedValuesKey() const;
+
+    // Starts building the pyramid of the displayed values on a worker
+    // thread, from a copy of the display parameters
+    void startPyramidBuild();
+
+    // Pyramid of the values identified by key, null when not built yet
+    const StatisticsPyramid *findPyramid(const std::string &key) const;
+
+    // Fits the exposure or false color range when the view or the values
+    // changed
+    void updateAutoContrast();
+
+    // Meters the displayed result again when its content or the metered
+    // region changed
+    void updateAutoExposure();
+
+    // Sets the exposure from the last metering
+    void applyAutoExposure();
+
+    // Bins the displayed result again when its content changed, on the GPU
+    // or from a CPU conversion
+    void updateScopes();
+
+    // Luminance or RGB histograms over the exposure window
+    void drawHistograms(ImDrawList *drawList, const glm::vec2 &position, const glm::vec2 &size) const;
+
+    // Uploads the waveform over the exposure window to _tex_waveformDisplay
+    void updateWaveformDisplay();
+
+    // Uploads the displayed band matrix as a heatmap to _tex_bandMatrix
+    void updateBandMatrixDisplay();
+
+    // Region corners from a drag in window coordinates
+    void selectRegion(const glm::vec2 &windowStart, const glm::vec2 &windowEnd);
+
+    // Statistics from the tables, or summed from the spectra when final
+    // (direct sums are too slow to follow the mouse)
+    void updateRegionStatistics(bool final);
+
+    // Mean spectrum of the resident copy over a size x size kernel
+    // centered on the pixel, clipped to the image
+    void kernelSpectrum(int x, int y, int size, std::vector<float> &spectrum) const;
+
     std::unique_ptr<Shader> _shaderProgram;
+    std::unique_ptr<Shader> _computeProgram;
+    std::unique_ptr<Shader> _viewportProgram;
     GLuint  _fbo_imageViewerSpectral;
 
     // Spectral conversion
-    // GLuint _cmfXYZ[3];
-    GLuint _tex_cmfXYZ;
-    GLuint _tex_imageWavelengths;
-    GLuint _tex_imageWlBoundsWidths;
-    GLuint _tex_illuminant;
+    GLuint _tex_bandWeights;
+    GLuint _tex_colormap;
+    float  _weightsOffset[3];
 
     // Shader locations
-    GLuint _loc_spectralImage;
+    SpectralUniforms _loc_fragment;
+    SpectralUniforms _loc_compute;
+    SpectralUniforms _loc_viewport;
+
+    // The previous result stays displayed while the back texture is filled
+    GLuint _tex_spectralBack;
+    GLuint _tex_spectralTarget;
+    bool   _hasSpectralResult;
 
-    GLuint _loc_imageWavelengths;
-    GLuint _loc_imageWlBoundsWidths;
+    // Image sized results are only allocated once needed
+    bool _imageResultAllocated;
 
-    GLuint _loc_width, _loc_height, _loc_nSpectralBands, _loc_isReflective;
+    // Window sized result of the viewport resolution mode
+    GLuint       _fbo_viewport;
+    GLuint       _tex_viewport;
+    unsigned int _viewportWidth, _viewportHeight;
+    glm::mat3    _viewportTransform;
+    bool         _viewportActive;
+    bool         _viewportNeedsUpdate;
 
-    GLuint _loc_cmfXYZ;
-    GLuint _loc_cmfFirstWavelength;
-    GLuint _loc_cmfSize;
+    // Colorimetry of the displayed and of the in progress results
+    std::string _frontKey;
+    std::string _targetKey;
 
-    GLuint _loc_illuminant;
-    GLuint _loc_illuminantFirstWavelength;
-    GLuint _loc_illuminantSize;
+    std::string _colorimetryError;
 
-    GLuint _loc_xyzToRgb;
+    // Tiles left to convert, the next one is at the back
+    std::vector<SpectralTile> _pendingTiles;
+    size_t                    _nTiles;
 
-    unsigned int _cmfFirstWavelength;
-    size_t       _cmfSize;
+    // GPU time of the tiles converted by the previous frames, from timestamp
+    // queries read a few frames later. Sets the number of tiles per frame.
+    struct TileTiming {
+        GLuint queries[2];   // Begin and end timestamps
+        size_t nTiles;
+        bool   pending;
+    };
 
-    unsigned int _illuminantFirstWavelength;
-    size_t       _illuminantSize;
+    static const size_t TILE_QUERY_FRAMES = 3;
 
-    glm::mat3 _xyzToRgb;
+    TileTiming _tileTimings[TILE_QUERY_FRAMES];
+    size_t     _tileTimingIdx;
+    double     _tileGpuMs;   // Per tile, negative until measured
 
     bool _spectralNeedsUpdate;
-};
\ No newline at end of file
+
+    // Spectrum under the mouse, read back from the spectral texture and
+    // reconstructed from the coefficients with the PCA compression
+    PixelReadback      _spectrumReadback;
+    std::vector<float> _spectrumAtMousePosition;
+    int                _xSpectrumMouseOver, _ySpectrumMouseOver;
+    int                _spectrumRequestX, _spectrumRequestY;
+
+    // Inspector
+    int                _inspectorKernel;
+    std::vector<float> _inspectorSpectrum;
+    BandStatistics     _bandStatistics;
+
+    // Region statistics
+    SpectralIntegralImage _integralImage;
+    bool                  _showRegionTool;
+    bool                  _regionSelecting;
+    bool                  _regionDragging;
+    bool                  _hasRegion;
+    bool                  _regionFinal;
+    int                   _region[4];   // x0, y0, x1, y1
+    glm::vec2             _regionDragStart;
+    glm::vec2             _regionPressPos;
+    std::vector<float>    _regionMean;
+    std::vector<float>    _regionStdDev;
+
+    // Automatic exposure
+    ExposureMeter _exposureMeter;
+    AutoExposure  _autoExposure;
+    float         _autoExposurePercentile;
+    bool          _autoExposureVisibleOnly;
+    bool          _exposureMetered;
+    uint64_t      _meteredGeneration;
+    int           _meteredRegion[4];
+
+    // Automatic contrast
+    std::vector<std::pair<std::string, std::shared_ptr<StatisticsPyramid>>> _pyramids;   // Most recent first
+
+    std::future<std::shared_ptr<StatisticsPyramid>> _pyramidBuild;
+    std::string                                     _pyramidBuildKey;
+
+    bool        _autoContrast;
+    bool        _contrastFitted;
+    std::string _contrastKey;
+    int         _contrastRegion[4];
+
+    // Scopes
+    ImageScopes   _scopes;
+    PixelReadback _scopesReadback;   // Displayed texture, binned by the CPU
+    bool          _showScopes;
+    bool          _scopesOnGPU;
+    int           _scopesChannels;   // 0: luminance, 1: RGB
+    bool          _scopesComputed;
+    uint64_t      _scopesGeneration;
+    GLuint        _tex_waveformDisplay;
+    bool          _waveformDisplayDirty;
+    float         _waveformDisplayExposure;
+
+    // Band analysis
+    BandCovariance      _bandCovariance;
+    bool                _showBandAnalysis;
+    int                 _bandMatrixType;   // 0: correlation, 1: covariance
+    std::vector<double> _bandMatrix;
+    double              _bandMatrixScale;
+    GLuint              _tex_bandMatrix;
+    bool                _bandMatrixDirty;
+    double              _bandCovarianceTime;
+
+    // CPU reference
+    double _cpuConversionTime;
+    float  _cpuMaxAbsError;
+    bool   _cpuCompared;
+};
@@ -2,6 +2,8 @@
 
 #include <imgui.h>
 
+#include "Trace.h"
+
 
 ImageViewerSpectralEXR::ImageViewerSpectralEXR(
     const std::string &filepath)
@@ -33,60 +35,42 @@ ImageViewerSpectralEXR::ImageViewerSpectralEXR(
 }
 
 
+ImageViewerSpectralEXR::~ImageViewerSpectralEXR()
+{
+    // The cube is released before the base class
+    waitPyramidBuild();
+}
+
+
 void ImageViewerSpectralEXR::gui_inspectorTool()
 {
     ImGui::Text("File format: Spectral EXR");
     ImageViewerSpectral::gui_inspectorTool();
 }
 
+
+const float *ImageViewerSpectralEXR::spectralData() const
+{
+    if (_spectralImage.isEmissive()) {
+        return &_spectralImage.emissive(0, 0, 0, 0);
+    } else {
+        return &_spectralImage.reflective(0, 0, 0);
+    }
+}
+
 // ----------------------------------------------------------------------------
 // OpenGL
 // ----------------------------------------------------------------------------
 
 void ImageViewerSpectralEXR::initGL()
 {
-    ImageViewerSpectral::initGL();
+    TRACE_SCOPE("ImageViewerSpectralEXR::initGL", "load");
 
-    glActiveTexture(GL_TEXTURE0);
-    glBindTexture(GL_TEXTURE_3D, _tex_imageViewerSpectralIn);
+    ImageViewerSpectral::initGL();
 
     // The organization of the spectral layer is as follows:
     // for image of dimensions width, height and n_bands, the corresponding
     // memory location for x, y, band is at:
-    // _spectralImage.emissive(0, 0, 0, 0)[width * h * band + width * y + x]
-
-    if (_spectralImage.isEmissive()) {
-        glTexImage3D(
-            GL_TEXTURE_3D,
-            0,
-            GL_R32F,
-            _spectralImage.nSpectralBands(),
-            _spectralImage.width(),
-            _spectralImage.height(),
-            0,
-            GL_RED,
-            GL_FLOAT,
-            &_spectralImage.emissive(0, 0, 0, 0));
-    } else {
-        glTexImage3D(
-            GL_TEXTURE_3D,
-            0,
-            GL_R32F,
-            _spectralImage.nSpectralBands(),
-            _spectralImage.width(),
-            _spectralImage.height(),
-            0,
-            GL_RED,
-            GL_FLOAT,
-            &_spectralImage.reflective(0, 0, 0));
-    }
-
-    // glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
-    glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
-    glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
-
-    glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_BORDER);
-    glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_BORDER);
-
-    glBindTexture(GL_TEXTURE_3D, 0);
+    // spectralData()[n_bands * (width * y + x) + band]
+    uploadSpectralImage(spectralData());
 }
\ No newline at end of file
@@ -12,10 +12,14 @@ class ImageViewerSpectralEXR: public ImageViewerSpectral
   public:
     ImageViewerSpectralEXR(const std::string &filepath);
 
+    virtual ~ImageViewerSpectralEXR();
+
     virtual void gui_inspectorTool();
 
     virtual void initGL();
 
+    virtual const float *spectralData() const;
+
   private:
     SEXR::EXRSpectralImage _spectralImage;
 };
\ No newline at end of file
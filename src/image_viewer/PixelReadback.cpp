@@ -0,0 +1,161 @@
+#include "PixelReadback.h"
+
+#include <algorithm>
+
+
+PixelReadback::PixelReadback(size_t nBuffers)
+    : _slots(std::max(size_t(1), nBuffers))
+    , _fbo(0)
+    , _sequence(0)
+    , _frame(0)
+    , _resultTag(0)
+    , _resultSequence(0)
+    , _resultLatency(0)
+    , _hasResult(false)
+{
+    for (Slot &slot : _slots) {
+        slot.buffer  = 0;
+        slot.fence   = 0;
+        slot.nFloats = 0;
+    }
+}
+
+
+PixelReadback::~PixelReadback()
+{
+    for (Slot &slot : _slots) {
+        if (slot.fence) {
+            glDeleteSync(slot.fence);
+        }
+
+        glDeleteBuffers(1, &slot.buffer);
+    }
+
+    glDeleteFramebuffers(1, &_fbo);
+}
+
+
+void PixelReadback::initGL()
+{
+    glGenFramebuffers(1, &_fbo);
+
+    for (Slot &slot : _slots) {
+        glGenBuffers(1, &slot.buffer);
+    }
+}
+
+
+bool PixelReadback::request(
+    GLuint   texture,
+    GLint    layer,
+    GLint    x,
+    GLint    y,
+    GLsizei  width,
+    GLsizei  height,
+    size_t   nChannels,
+    uint64_t tag,
+    GLint    level)
+{
+    auto free = std::find_if(_slots.begin(), _slots.end(), [](const Slot &slot) {
+        return slot.fence == 0;
+    });
+
+    if (free == _slots.end() || texture == 0 || width <= 0 || height <= 0) {
+        return false;
+    }
+
+    Slot &slot = *free;
+
+    slot.nFloats  = nChannels * size_t(width) * size_t(height);
+    slot.tag      = tag;
+    slot.sequence = ++_sequence;
+    slot.frame    = _frame;
+
+    glBindFramebuffer(GL_READ_FRAMEBUFFER, _fbo);
+
+    if (layer < 0) {
+        glFramebufferTexture2D(GL_READ_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, texture, level);
+    } else {
+        glFramebufferTextureLayer(GL_READ_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, texture, level, layer);
+    }
+
+    glReadBuffer(GL_COLOR_ATTACHMENT0);
+
+    // The buffer is reallocated so a previous mapping cannot stall the copy
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, slot.buffer);
+    glBufferData(GL_PIXEL_PACK_BUFFER, slot.nFloats * sizeof(float), nullptr, GL_STREAM_READ);
+
+    const GLenum format = nChannels == 1 ? GL_RED : (nChannels == 2 ? GL_RG : GL_RGBA);
+
+    glReadPixels(x, y, width, height, format, GL_FLOAT, (void *)0);
+
+    slot.fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+    glBindFramebuffer(GL_READ_FRAMEBUFFER, 0);
+
+    return true;
+}
+
+
+bool PixelReadback::poll()
+{
+    bool updated = false;
+
+    _frame++;
+
+    for (Slot &slot : _slots) {
+        if (slot.fence == 0) {
+            continue;
+        }
+
+        // A zero timeout only queries the fence status, the flush makes
+        // sure the fence eventually gets signaled
+        const GLenum status = glClientWaitSync(slot.fence, GL_SYNC_FLUSH_COMMANDS_BIT, 0);
+
+        if (status != GL_ALREADY_SIGNALED && status != GL_CONDITION_SATISFIED) {
+            continue;
+        }
+
+        glDeleteSync(slot.fence);
+        slot.fence = 0;
+
+        // Reads complete in order, an older one may still be collected
+        // after a newer one
+        if (slot.sequence < _resultSequence) {
+            continue;
+        }
+
+        glBindBuffer(GL_PIXEL_PACK_BUFFER, slot.buffer);
+
+        const float *values = (const float *)glMapBufferRange(
+            GL_PIXEL_PACK_BUFFER,
+            0,
+            slot.nFloats * sizeof(float),
+            GL_MAP_READ_BIT);
+
+        if (values) {
+            _result.assign(values, values + slot.nFloats);
+            glUnmapBuffer(GL_PIXEL_PACK_BUFFER);
+
+            _resultTag      = slot.tag;
+            _resultSequence = slot.sequence;
+            _resultLatency  = (unsigned int)(_frame - slot.frame);
+            _hasResult      = true;
+
+            updated = true;
+        }
+
+        glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+    }
+
+    return updated;
+}
+
+
+bool PixelReadback::isPending() const
+{
+    return std::any_of(_slots.begin(), _slots.end(), [](const Slot &slot) {
+        return slot.fence != 0;
+    });
+}
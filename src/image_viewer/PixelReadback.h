@@ -0,0 +1,76 @@
+#pragma once
+
+#include <GL/glew.h>
+
+#include <cstdint>
+#include <vector>
+
+
+// Asynchronous readback of small texture regions through a ring of pixel
+// buffer objects. Each read is queued in a free buffer followed by a fence,
+// and the buffer is only mapped once the fence is signaled: the CPU never
+// waits for the GPU, results come one or two frames after their request.
+class PixelReadback
+{
+  public:
+    PixelReadback(size_t nBuffers = 3);
+
+    virtual ~PixelReadback();
+
+    void initGL();
+
+    // Queues the read of a width x height region of a 2D texture, or of a
+    // layer of a 3D texture when layer is not negative. nChannels is 1 (red),
+    // 2 (red, green) or 4 (RGBA), values are read as floats. The tag is
+    // handed back with the result. Returns false, without queuing anything,
+    // when all the buffers are in flight.
+    bool request(
+        GLuint   texture,
+        GLint    layer,
+        GLint    x,
+        GLint    y,
+        GLsizei  width,
+        GLsizei  height,
+        size_t   nChannels,
+        uint64_t tag,
+        GLint    level = 0);
+
+    // Collects the completed reads without blocking, to be called once per
+    // frame. Returns true when a newer result is available.
+    bool poll();
+
+    bool isPending() const;
+
+    bool                      hasResult() const { return _hasResult; }
+    const std::vector<float> &result() const { return _result; }
+    uint64_t                  resultTag() const { return _resultTag; }
+
+    // Frames between the request of the result and its availability
+    unsigned int resultLatency() const { return _resultLatency; }
+
+    static uint64_t pixelTag(int x, int y) { return (uint64_t(uint32_t(y)) << 32) | uint32_t(x); }
+    static int      tagX(uint64_t tag) { return int(uint32_t(tag)); }
+    static int      tagY(uint64_t tag) { return int(uint32_t(tag >> 32)); }
+
+  private:
+    struct Slot {
+        GLuint   buffer;
+        GLsync   fence;
+        size_t   nFloats;
+        uint64_t tag;
+        uint64_t sequence;
+        uint64_t frame;
+    };
+
+    std::vector<Slot> _slots;
+    GLuint            _fbo;
+
+    uint64_t _sequence;
+    uint64_t _frame;
+
+    std::vector<float> _result;
+    uint64_t           _resultTag;
+    uint64_t           _resultSequence;
+    unsigned int       _resultLatency;
+    bool               _hasResult;
+};
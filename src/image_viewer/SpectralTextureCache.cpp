@@ -0,0 +1,76 @@
+#include "SpectralTextureCache.h"
+
+
+SpectralTextureCache::SpectralTextureCache(size_t capacityBytes)
+    : _capacityBytes(capacityBytes)
+    , _bytesUsed(0)
+{
+}
+
+
+SpectralTextureCache::~SpectralTextureCache()
+{
+    clear();
+}
+
+
+GLuint SpectralTextureCache::take(const std::string &key)
+{
+    for (auto it = _entries.begin(); it != _entries.end(); it++) {
+        if (it->key == key) {
+            const GLuint texture = it->texture;
+
+            _bytesUsed -= it->bytes;
+            _entries.erase(it);
+
+            return texture;
+        }
+    }
+
+    return 0;
+}
+
+
+void SpectralTextureCache::put(const std::string &key, GLuint texture, size_t bytes)
+{
+    // Replace a stale entry for the same key
+    const GLuint previous = take(key);
+    glDeleteTextures(1, &previous);
+
+    _entries.push_front({key, texture, bytes});
+    _bytesUsed += bytes;
+
+    evict();
+}
+
+
+void SpectralTextureCache::clear()
+{
+    for (const Entry &e : _entries) {
+        glDeleteTextures(1, &e.texture);
+    }
+
+    _entries.clear();
+    _bytesUsed = 0;
+}
+
+
+void SpectralTextureCache::setCapacity(size_t capacityBytes)
+{
+    _capacityBytes = capacityBytes;
+
+    evict();
+}
+
+
+void SpectralTextureCache::evict()
+{
+    while (_bytesUsed > _capacityBytes && !_entries.empty()) {
+        const Entry &e = _entries.back();
+
+        glDeleteTextures(1, &e.texture);
+        _bytesUsed -= e.bytes;
+
+        _entries.pop_back();
+    }
+}
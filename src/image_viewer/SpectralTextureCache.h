@@ -0,0 +1,49 @@
+#pragma once
+
+#include <GL/glew.h>
+
+#include <list>
+#include <string>
+
+
+// Least recently used cache of converted RGB textures. The cache owns the
+// textures it holds and deletes them when they are evicted.
+class SpectralTextureCache
+{
+  public:
+    SpectralTextureCache(size_t capacityBytes);
+
+    virtual ~SpectralTextureCache();
+
+    // Removes the texture from the cache and hands it over to the caller.
+    // Returns 0 if the key is not cached.
+    GLuint take(const std::string &key);
+
+    // Stores the texture, evicting the least recently used ones when the
+    // capacity is exceeded
+    void put(const std::string &key, GLuint texture, size_t bytes);
+
+    void clear();
+
+    void   setCapacity(size_t capacityBytes);
+    size_t capacity() const { return _capacityBytes; }
+
+    size_t size() const { return _entries.size(); }
+    size_t bytesUsed() const { return _bytesUsed; }
+
+  protected:
+    void evict();
+
+  private:
+    struct Entry {
+        std::string key;
+        GLuint      texture;
+        size_t      bytes;
+    };
+
+    // Most recently used first
+    std::list<Entry> _entries;
+
+    size_t _capacityBytes;
+    size_t _bytesUsed;
+};
@@ -1,7 +1,20 @@
 #include "App.h"
 
+#ifdef TIRESIAS_HEADLESS
+#include "HeadlessContext.h"
+#include "HeadlessRenderer.h"
+
+#include "image_viewer/ImageViewerLDR.h"
+#include "image_viewer/ImageViewerSpectralEXR.h"
+#endif
+
 #include <iostream>
 #include <exception>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <memory>
+#include <string>
 
 
 static void glfw_error_callback(int error, const char *description)
@@ -11,15 +24,100 @@ static void glfw_error_callback(int error, const char *description)
               << description << std::endl;
 }
 
+
+#ifdef TIRESIAS_HEADLESS
+// Renders the image as displayed in a window of the given size and writes
+// it as a PNG, without any window nor display server:
+//   tiresias --headless [--size WxH] [--exposure EV] <input> <output.png>
+static int runHeadless(int argc, char *argv[])
+{
+    std::string  input, output;
+    unsigned int width = 1280, height = 720;
+    float        exposure    = 0.f;
+    bool         hasExposure = false;
+
+    for (int i = 1; i < argc; i++) {
+        const std::string arg = argv[i];
+
+        if (arg == "--headless") {
+            continue;
+        } else if (arg == "--size" && i + 1 < argc) {
+            if (std::sscanf(argv[++i], "%ux%u", &width, &height) != 2) {
+                throw std::runtime_error("Invalid size, expected WxH");
+            }
+        } else if (arg == "--exposure" && i + 1 < argc) {
+            exposure    = std::strtof(argv[++i], NULL);
+            hasExposure = true;
+        } else if (input.empty()) {
+            input = arg;
+        } else {
+            output = arg;
+        }
+    }
+
+    if (input.empty() || output.empty()) {
+        std::cerr << "Usage: " << argv[0]
+                  << " --headless [--size WxH] [--exposure EV] <input> <output.png>" << std::endl;
+        return 1;
+    }
+
+    HeadlessContext context;
+
+    std::cout << "Renderer: " << context.renderer() << " (" << context.version() << ")" << std::endl;
+
+    std::unique_ptr<ImageViewer> viewer;
+
+    const std::string ext = input.substr(input.find_last_of(".") + 1);
+
+    if (ext == "exr" || ext == "EXR") {
+        viewer.reset(new ImageViewerSpectralEXR(input));
+    } else if (ext == "png" || ext == "PNG") {
+        viewer.reset(new ImageViewerLDR(input));
+    } else {
+        throw std::runtime_error("Unsupported image type");
+    }
+
+    viewer->initGL();
+
+    // Otherwise the exposure seeded from the image statistics is kept
+    if (hasExposure) {
+        viewer->setExposure(exposure);
+    }
+
+    HeadlessRenderer renderer(width, height);
+    renderer.render(*viewer);
+    renderer.writePNG(output);
+
+    return 0;
+}
+#endif
+
+
 int main(int argc, char *argv[])
 {
+    bool headless = false;
+
+    for (int i = 1; i < argc; i++) {
+        headless = headless || std::strcmp(argv[i], "--headless") == 0;
+    }
+
     try {
+        if (headless) {
+#ifdef TIRESIAS_HEADLESS
+            return runHeadless(argc, argv);
+#else
+            std::cerr << "Headless rendering is not available, build with TIRESIAS_HEADLESS" << std::endl;
+            return 1;
+#endif
+        }
+
         App app(argc, argv);
 
         app.exec();
     } catch (std::exception &e) {
         std::cerr << e.what() << std::endl;
+        return 1;
     }
 
     return 0;
-}
\ No newline at end of file
+}
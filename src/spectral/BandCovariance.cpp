@@ -0,0 +1,232 @@
+#include "BandCovariance.h"
+
+#include "SpectralConverter.h"
+
+#include <algorithm>
+#include <cmath>
+
+
+BandCovariance::BandCovariance()
+    : _count(0)
+{
+}
+
+
+void BandCovariance::reset(size_t nBands)
+{
+    _count = 0;
+    _mean.assign(nBands, 0.);
+    _comoment.assign(nBands * nBands, 0.);
+}
+
+
+void BandCovariance::add(const float *spectra, size_t nPixels, int nThreads)
+{
+    if (nThreads <= 0) {
+        nThreads = SpectralConverter::maxThreads();
+    }
+
+    const size_t nBands  = this->nBands();
+    const long   nBlocks = (long)((nPixels + BLOCK_PIXELS - 1) / BLOCK_PIXELS);
+
+#pragma omp parallel num_threads(nThreads)
+    {
+        BandCovariance local;
+        local.reset(nBands);
+
+        std::vector<double> block(BLOCK_PIXELS * nBands);
+
+#pragma omp for schedule(dynamic, 16) nowait
+        for (long k = 0; k < nBlocks; k++) {
+            const size_t first = k * BLOCK_PIXELS;
+
+            local.addBlock(&spectra[nBands * first], std::min(BLOCK_PIXELS, nPixels - first), block);
+        }
+
+#pragma omp critical
+        merge(local);
+    }
+}
+
+
+void BandCovariance::merge(const BandCovariance &other)
+{
+    if (other.nBands() != nBands()) {
+        reset(other.nBands());
+    }
+
+    mergeMoments(other._count, other._mean.data(), other._comoment.data());
+}
+
+
+void BandCovariance::addBlock(const float *spectra, size_t nPixels, std::vector<double> &block)
+{
+    const size_t nBands = this->nBands();
+
+    // ------------------------------------------------------------------------
+    // Finite spectra, centered on their mean
+    // ------------------------------------------------------------------------
+
+    std::vector<double> blockMean(nBands, 0.);
+    size_t              m = 0;
+
+    for (size_t px = 0; px < nPixels; px++) {
+        const float *spectrum = &spectra[nBands * px];
+
+        bool finite = true;
+
+        for (size_t b = 0; b < nBands && finite; b++) {
+            finite = std::isfinite(spectrum[b]);
+        }
+
+        if (!finite) {
+            continue;
+        }
+
+        double *row = &block[nBands * m];
+
+        for (size_t b = 0; b < nBands; b++) {
+            row[b] = spectrum[b];
+            blockMean[b] += row[b];
+        }
+
+        m++;
+    }
+
+    if (m == 0) {
+        return;
+    }
+
+    for (size_t b = 0; b < nBands; b++) {
+        blockMean[b] /= m;
+    }
+
+    for (size_t p = 0; p < m; p++) {
+        double *row = &block[nBands * p];
+
+        for (size_t b = 0; b < nBands; b++) {
+            row[b] -= blockMean[b];
+        }
+    }
+
+    // ------------------------------------------------------------------------
+    // Pairwise update, the block co-moment is summed in place
+    // ------------------------------------------------------------------------
+
+    mergeMoments(m, blockMean.data(), nullptr);
+
+    // Tiles of the upper triangle stay in cache over the block
+    for (size_t i0 = 0; i0 < nBands; i0 += TILE_BANDS) {
+        const size_t i1 = std::min(nBands, i0 + TILE_BANDS);
+
+        for (size_t j0 = i0; j0 < nBands; j0 += TILE_BANDS) {
+            const size_t j1 = std::min(nBands, j0 + TILE_BANDS);
+
+            for (size_t p = 0; p < m; p++) {
+                const double *row = &block[nBands * p];
+
+                for (size_t i = i0; i < i1; i++) {
+                    const double xi      = row[i];
+                    double      *comoment = &_comoment[nBands * i];
+
+#pragma omp simd
+                    for (size_t j = std::max(i, j0); j < j1; j++) {
+                        comoment[j] += xi * row[j];
+                    }
+                }
+            }
+        }
+    }
+}
+
+
+void BandCovariance::mergeMoments(uint64_t count, const double *mean, const double *comoment)
+{
+    if (count == 0) {
+        return;
+    }
+
+    const size_t   nBands = this->nBands();
+    const uint64_t total  = _count + count;
+
+    // Co-moment of the union: both co-moments plus the spread of the means
+    const double weight = double(_count) * double(count) / double(total);
+
+    std::vector<double> delta(nBands);
+
+    for (size_t b = 0; b < nBands; b++) {
+        delta[b] = mean[b] - _mean[b];
+    }
+
+    for (size_t i = 0; i < nBands; i++) {
+        double      *row      = &_comoment[nBands * i];
+        const double weighted = weight * delta[i];
+
+        if (comoment) {
+            const double *otherRow = &comoment[nBands * i];
+
+#pragma omp simd
+            for (size_t j = i; j < nBands; j++) {
+                row[j] += otherRow[j] + weighted * delta[j];
+            }
+        } else {
+#pragma omp simd
+            for (size_t j = i; j < nBands; j++) {
+                row[j] += weighted * delta[j];
+            }
+        }
+    }
+
+    for (size_t b = 0; b < nBands; b++) {
+        _mean[b] += delta[b] * double(count) / double(total);
+    }
+
+    _count = total;
+}
+
+
+void BandCovariance::covariance(std::vector<double> &matrix) const
+{
+    const size_t nBands = this->nBands();
+
+    matrix.assign(nBands * nBands, 0.);
+
+    if (_count < 2) {
+        return;
+    }
+
+    for (size_t i = 0; i < nBands; i++) {
+        for (size_t j = i; j < nBands; j++) {
+            const double c = _comoment[nBands * i + j] / double(_count - 1);
+
+            matrix[nBands * i + j] = c;
+            matrix[nBands * j + i] = c;
+        }
+    }
+}
+
+
+void BandCovariance::correlation(std::vector<double> &matrix) const
+{
+    const size_t nBands = this->nBands();
+
+    covariance(matrix);
+
+    std::vector<double> stdDev(nBands);
+
+    for (size_t b = 0; b < nBands; b++) {
+        stdDev[b] = std::sqrt(matrix[nBands * b + b]);
+    }
+
+    for (size_t i = 0; i < nBands; i++) {
+        for (size_t j = 0; j < nBands; j++) {
+            const double s = stdDev[i] * stdDev[j];
+
+            if (i == j) {
+                matrix[nBands * i + j] = 1.;
+            } else {
+                matrix[nBands * i + j] = s > 0. ? matrix[nBands * i + j] / s : 0.;
+            }
+        }
+    }
+}
@@ -0,0 +1,62 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+
+// Band to band covariance and correlation of a spectral cube, in a single
+// pass over the pixels so cubes larger than the memory can be streamed by
+// tiles.
+//
+// Pixels are processed by blocks of BLOCK_PIXELS: the co-moment of a block
+// is summed from its spectra centered on the block mean, by tiles of
+// TILE_BANDS x TILE_BANDS bands of the outer products, and added with the
+// pairwise update of Chan et al. Blocks, threads and tiles are merged the
+// same way, which is as accurate as a two pass evaluation. Pixels with a
+// non finite value are skipped.
+class BandCovariance
+{
+  public:
+    BandCovariance();
+
+    // Empties the statistics of an image of nBands bands
+    void reset(size_t nBands);
+
+    // Adds the pixels of spectra[nBands() * pixel + band]. When nThreads is
+    // 0, all the available cores are used.
+    void add(const float *spectra, size_t nPixels, int nThreads = 0);
+
+    // Adds the pixels accounted for by another instance
+    void merge(const BandCovariance &other);
+
+    bool empty() const { return _count == 0; }
+
+    size_t   nBands() const { return _mean.size(); }
+    uint64_t count() const { return _count; }
+
+    const std::vector<double> &mean() const { return _mean; }
+
+    // Unbiased estimates, nBands x nBands row ordered matrices. Correlations
+    // involving a constant band are 0, except with itself.
+    void covariance(std::vector<double> &matrix) const;
+    void correlation(std::vector<double> &matrix) const;
+
+    static const size_t BLOCK_PIXELS = 256;
+    static const size_t TILE_BANDS   = 64;
+
+  private:
+    // Adds nPixels spectra, block is a BLOCK_PIXELS x nBands buffer
+    void addBlock(const float *spectra, size_t nPixels, std::vector<double> &block);
+
+    // Pairwise update with count pixels of the given mean and co-moment,
+    // of which only the upper triangle is read
+    void mergeMoments(uint64_t count, const double *mean, const double *comoment);
+
+    uint64_t _count;
+
+    std::vector<double> _mean;
+
+    // Sums of the products of the centered values, upper triangle only
+    std::vector<double> _comoment;
+};
@@ -0,0 +1,274 @@
+#include "BandStatistics.h"
+
+#include "SpectralConverter.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <istream>
+#include <limits>
+#include <ostream>
+#include <stdexcept>
+
+
+// Guards the allocations of read() against corrupted files, in histogram
+// entries as DerivedDataCache bounds its vectors
+static const uint64_t MAX_ELEMENTS = uint64_t(1) << 28;
+
+
+// Unsigned integer in the same order as the float: negative values have all
+// their bits flipped, positive values only their sign
+static uint32_t orderedBits(float value)
+{
+    uint32_t bits;
+    std::memcpy(&bits, &value, sizeof(bits));
+
+    return (bits & 0x80000000u) ? ~bits : (bits | 0x80000000u);
+}
+
+
+static float fromOrderedBits(uint32_t key)
+{
+    const uint32_t bits = (key & 0x80000000u) ? (key & 0x7fffffffu) : ~key;
+
+    float value;
+    std::memcpy(&value, &bits, sizeof(value));
+
+    return value;
+}
+
+
+static const unsigned int BIN_SHIFT = 32 - BandStatistics::HISTOGRAM_BITS;
+
+// ----------------------------------------------------------------------------
+// Accumulator
+// ----------------------------------------------------------------------------
+
+BandStatistics::Accumulator::Accumulator(size_t nBands)
+    : _nBands(nBands)
+    , _nPixels(0)
+    , _min(nBands, std::numeric_limits<float>::infinity())
+    , _max(nBands, -std::numeric_limits<float>::infinity())
+    , _sum(nBands, 0.)
+    , _nFinite(nBands, 0)
+    , _nNaN(nBands, 0)
+    , _nInf(nBands, 0)
+    , _firstNonFinite(nBands, std::numeric_limits<uint64_t>::max())
+    , _histograms(nBands * BINS, 0)
+{
+}
+
+
+void BandStatistics::Accumulator::add(const float *spectra, size_t firstPixel, size_t nPixels)
+{
+    for (size_t px = 0; px < nPixels; px++) {
+        const float *spectrum = &spectra[_nBands * px];
+
+        for (size_t b = 0; b < _nBands; b++) {
+            const float v = spectrum[b];
+
+            if (std::isfinite(v)) {
+                _min[b] = std::min(_min[b], v);
+                _max[b] = std::max(_max[b], v);
+                _sum[b] += v;
+                _nFinite[b]++;
+                _histograms[b * BINS + (orderedBits(v) >> BIN_SHIFT)]++;
+            } else {
+                if (std::isnan(v)) {
+                    _nNaN[b]++;
+                } else {
+                    _nInf[b]++;
+                }
+
+                _firstNonFinite[b] = std::min(_firstNonFinite[b], uint64_t(firstPixel + px));
+            }
+        }
+    }
+
+    _nPixels += nPixels;
+}
+
+// ----------------------------------------------------------------------------
+// Merged statistics
+// ----------------------------------------------------------------------------
+
+BandStatistics::BandStatistics()
+    : _nPixels(0)
+{
+}
+
+
+void BandStatistics::reset(size_t nBands)
+{
+    const Band emptyBand = {
+        std::numeric_limits<float>::infinity(),
+        -std::numeric_limits<float>::infinity(),
+        0.,
+        0,
+        0,
+        0,
+        std::numeric_limits<uint64_t>::max()};
+
+    _nPixels = 0;
+    _bands.assign(nBands, emptyBand);
+    _sums.assign(nBands, 0.);
+    _histograms.assign(nBands * BINS, 0);
+}
+
+
+void BandStatistics::merge(const Accumulator &accumulator)
+{
+    if (accumulator._nBands != nBands()) {
+        reset(accumulator._nBands);
+    }
+
+    _nPixels += accumulator._nPixels;
+
+    for (size_t b = 0; b < nBands(); b++) {
+        Band &band = _bands[b];
+
+        band.min = std::min(band.min, accumulator._min[b]);
+        band.max = std::max(band.max, accumulator._max[b]);
+        band.nFinite += accumulator._nFinite[b];
+        band.nNaN += accumulator._nNaN[b];
+        band.nInf += accumulator._nInf[b];
+        band.firstNonFinite = std::min(band.firstNonFinite, accumulator._firstNonFinite[b]);
+
+        _sums[b] += accumulator._sum[b];
+        band.mean = band.nFinite > 0 ? _sums[b] / band.nFinite : 0.;
+    }
+
+    for (size_t i = 0; i < _histograms.size(); i++) {
+        _histograms[i] += accumulator._histograms[i];
+    }
+}
+
+
+void BandStatistics::compute(const float *spectra, size_t nPixels, size_t nBands, int nThreads)
+{
+    nThreads = threadCount(nBands, nThreads);
+
+    reset(nBands);
+
+    // Chunks of consecutive pixels, balanced between the threads
+    const size_t CHUNK   = 4096;
+    const long   nChunks = (long)((nPixels + CHUNK - 1) / CHUNK);
+
+#pragma omp parallel num_threads(nThreads)
+    {
+        Accumulator accumulator(nBands);
+
+#pragma omp for schedule(dynamic) nowait
+        for (long c = 0; c < nChunks; c++) {
+            const size_t first = c * CHUNK;
+
+            accumulator.add(&spectra[nBands * first], first, std::min(CHUNK, nPixels - first));
+        }
+
+#pragma omp critical
+        merge(accumulator);
+    }
+}
+
+
+float BandStatistics::percentile(size_t b, float fraction) const
+{
+    const Band &band = _bands[b];
+
+    if (band.nFinite == 0) {
+        return std::numeric_limits<float>::quiet_NaN();
+    }
+
+    const uint64_t *histogram = &_histograms[b * BINS];
+    const double    target    = std::min(std::max(double(fraction), 0.), 1.) * band.nFinite;
+
+    double cumulated = 0.;
+
+    for (size_t bin = 0; bin < BINS; bin++) {
+        const double next = cumulated + histogram[bin];
+
+        if (histogram[bin] > 0 && next >= target) {
+            // Linear interpolation of the bits within the bin, which is
+            // piecewise linear in the values
+            const double   t   = (target - cumulated) / histogram[bin];
+            const uint64_t key = (uint64_t(bin) << BIN_SHIFT) + uint64_t(t * ((uint64_t(1) << BIN_SHIFT) - 1));
+
+            return std::min(std::max(fromOrderedBits(uint32_t(key)), band.min), band.max);
+        }
+
+        cumulated = next;
+    }
+
+    return band.max;
+}
+
+
+uint64_t BandStatistics::nNaN() const
+{
+    uint64_t n = 0;
+
+    for (const Band &band : _bands) {
+        n += band.nNaN;
+    }
+
+    return n;
+}
+
+
+uint64_t BandStatistics::nInf() const
+{
+    uint64_t n = 0;
+
+    for (const Band &band : _bands) {
+        n += band.nInf;
+    }
+
+    return n;
+}
+
+
+void BandStatistics::write(std::ostream &os) const
+{
+    const uint64_t header[2] = {_nPixels, _bands.size()};
+
+    os.write((const char *)header, sizeof(header));
+    os.write((const char *)_bands.data(), _bands.size() * sizeof(Band));
+    os.write((const char *)_sums.data(), _sums.size() * sizeof(double));
+    os.write((const char *)_histograms.data(), _histograms.size() * sizeof(uint64_t));
+}
+
+
+void BandStatistics::read(std::istream &is)
+{
+    uint64_t header[2];
+    is.read((char *)header, sizeof(header));
+
+    if (!is || header[1] > MAX_ELEMENTS / BINS) {
+        throw std::runtime_error("Malformed band statistics");
+    }
+
+    reset(header[1]);
+
+    is.read((char *)_bands.data(), _bands.size() * sizeof(Band));
+    is.read((char *)_sums.data(), _sums.size() * sizeof(double));
+    is.read((char *)_histograms.data(), _histograms.size() * sizeof(uint64_t));
+
+    if (!is) {
+        clear();
+        throw std::runtime_error("Truncated band statistics");
+    }
+
+    _nPixels = header[0];
+}
+
+
+int BandStatistics::threadCount(size_t nBands, int nThreads)
+{
+    if (nThreads <= 0) {
+        nThreads = SpectralConverter::maxThreads();
+    }
+
+    const size_t bytes = std::max(accumulatorBytes(nBands), size_t(1));
+
+    return std::max(1, std::min(nThreads, int(ACCUMULATORS_MAX_BYTES / bytes)));
+}
@@ -0,0 +1,108 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <iosfwd>
+#include <vector>
+
+
+// Per band range, mean, non finite values and percentiles of a spectral
+// cube, in a single pass. Each thread fills its own Accumulator, for
+// instance while it decodes part of a file, which are merged afterwards.
+//
+// Percentiles come from histograms of the float bits: the sign, exponent and
+// the first mantissa bits of a value select its bin, so the bins are evenly
+// spread over the octaves whatever the range of the data. Values are
+// interpolated within a bin.
+class BandStatistics
+{
+  public:
+    struct Band {
+        float    min;
+        float    max;
+        double   mean;
+        uint64_t nFinite;
+        uint64_t nNaN;
+        uint64_t nInf;
+
+        // Index of the first pixel with a non finite value, only meaningful
+        // when nNaN + nInf > 0
+        uint64_t firstNonFinite;
+    };
+
+    // Statistics of a subset of the pixels, filled by a single thread
+    class Accumulator
+    {
+      public:
+        Accumulator(size_t nBands);
+
+        // Band first spectra of nPixels consecutive pixels, the first one
+        // being pixel firstPixel of the image
+        void add(const float *spectra, size_t firstPixel, size_t nPixels);
+
+      private:
+        friend class BandStatistics;
+
+        size_t _nBands;
+        size_t _nPixels;
+
+        std::vector<float>    _min, _max;
+        std::vector<double>   _sum;
+        std::vector<uint64_t> _nFinite, _nNaN, _nInf;
+        std::vector<uint64_t> _firstNonFinite;
+        std::vector<uint32_t> _histograms;   // BINS per band
+    };
+
+    BandStatistics();
+
+    // Empties the statistics of an image of nBands bands
+    void reset(size_t nBands);
+
+    // Adds the pixels of an accumulator, not thread safe
+    void merge(const Accumulator &accumulator);
+
+    // Single pass over spectra[nBands * pixel + band]. When nThreads is 0,
+    // all the available cores are used.
+    void compute(const float *spectra, size_t nPixels, size_t nBands, int nThreads = 0);
+
+    void clear() { reset(0); }
+
+    bool empty() const { return _nPixels == 0; }
+
+    size_t nBands() const { return _bands.size(); }
+    size_t nPixels() const { return _nPixels; }
+
+    const Band &band(size_t b) const { return _bands[b]; }
+
+    // Value under which the given fraction of the finite values of the band
+    // is, NaN when the band has no finite value
+    float percentile(size_t b, float fraction) const;
+
+    // Over all the bands
+    uint64_t nNaN() const;
+    uint64_t nInf() const;
+
+    // Binary serialization in the native byte order, read() throws on I/O
+    // errors and malformed data
+    void write(std::ostream &os) const;
+    void read(std::istream &is);
+
+    // Threads to use so their accumulators stay within ACCUMULATORS_MAX_BYTES
+    static int threadCount(size_t nBands, int nThreads = 0);
+
+    // Bins are selected by the HISTOGRAM_BITS most significant bits of the
+    // values: 3 mantissa bits, or 8 bins per octave
+    static const unsigned int HISTOGRAM_BITS = 12;
+    static const size_t       BINS           = size_t(1) << HISTOGRAM_BITS;
+
+    static const size_t ACCUMULATORS_MAX_BYTES = size_t(1) << 30;
+
+    static size_t accumulatorBytes(size_t nBands) { return nBands * BINS * sizeof(uint32_t); }
+
+  private:
+    size_t _nPixels;
+
+    std::vector<Band>     _bands;
+    std::vector<double>   _sums;
+    std::vector<uint64_t> _histograms;
+};
@@ -0,0 +1,286 @@
+#include "Colorimetry.h"
+
+#include <spectrum_data.h>
+
+#include <cmath>
+#include <exception>
+#include <fstream>
+#include <sstream>
+#include <algorithm>
+
+
+// CIE daylight components S0, S1, S2 from 300nm to 830nm by 10nm steps
+// (CIE 015:2018, table 6)
+// clang-format off
+static const double DAYLIGHT_FIRST_WAVELENGTH_NM = 300;
+static const size_t DAYLIGHT_SIZE                = 54;
+
+static const double DAYLIGHT_S0[DAYLIGHT_SIZE] = {
+      0.04,   6.00,  29.60,  55.30,  57.30,  61.80,  61.50,  68.80,  63.40,  65.80,
+     94.80, 104.80, 105.90,  96.80, 113.90, 125.60, 125.50, 121.30, 121.30, 113.50,
+    113.10, 110.80, 106.50, 108.80, 105.30, 104.40, 100.00,  96.00,  95.10,  89.10,
+     90.50,  90.30,  88.40,  84.00,  85.10,  81.90,  82.60,  84.90,  81.30,  71.90,
+     74.30,  76.40,  63.30,  71.70,  77.00,  65.20,  47.70,  68.60,  65.00,  66.00,
+     61.00,  53.30,  58.90,  61.90
+};
+
+static const double DAYLIGHT_S1[DAYLIGHT_SIZE] = {
+      0.02,   4.50,  22.40,  42.00,  40.60,  41.60,  38.00,  42.40,  38.50,  35.00,
+     43.40,  46.30,  43.90,  37.10,  36.70,  35.90,  32.60,  27.90,  24.30,  20.10,
+     16.20,  13.20,   8.60,   6.10,   4.20,   1.90,   0.00,  -1.60,  -3.50,  -3.50,
+     -5.80,  -7.20,  -8.60,  -9.50, -10.90, -10.70, -12.00, -14.00, -13.60, -12.00,
+    -13.30, -12.90, -10.60, -11.60, -12.20, -10.20,  -7.80, -11.20, -10.40, -10.60,
+     -9.70,  -8.30,  -9.30,  -9.80
+};
+
+static const double DAYLIGHT_S2[DAYLIGHT_SIZE] = {
+      0.00,   2.00,   4.00,   8.50,   7.80,   6.70,   5.30,   6.10,   3.00,   1.20,
+     -1.10,  -0.50,  -0.70,  -1.20,  -2.60,  -2.90,  -2.80,  -2.60,  -2.60,  -1.80,
+     -1.50,  -1.30,  -1.20,  -1.00,  -0.50,  -0.30,   0.00,   0.20,   0.50,   2.10,
+      3.20,   4.10,   4.70,   5.10,   6.70,   7.30,   8.60,   9.80,  10.20,   8.30,
+      9.60,   8.50,   7.00,   7.60,   8.00,   6.70,   5.20,   7.40,   6.80,   7.00,
+      6.40,   5.50,   6.10,   6.50
+};
+// clang-format on
+
+
+std::vector<Colorimetry::Observer> Colorimetry::builtinObservers()
+{
+    const size_t cmfSize = sizeof(SEXR::CIE1931_2DEG_X) / sizeof(SEXR::CIE1931_2DEG_X[0]);
+
+    Observer cie1931;
+    cie1931.name            = "CIE 1931 2 deg.";
+    cie1931.firstWavelength = SEXR::CIE1931_2DEG_FIRST_WAVELENGTH_NM;
+    cie1931.xyz.resize(3 * cmfSize);
+
+    for (size_t i = 0; i < cmfSize; i++) {
+        cie1931.xyz[3 * i + 0] = SEXR::CIE1931_2DEG_X[i];
+        cie1931.xyz[3 * i + 1] = SEXR::CIE1931_2DEG_Y[i];
+        cie1931.xyz[3 * i + 2] = SEXR::CIE1931_2DEG_Z[i];
+    }
+
+    return {cie1931};
+}
+
+
+std::vector<Colorimetry::Illuminant> Colorimetry::builtinIlluminants()
+{
+    const size_t d65Size = sizeof(SEXR::D_65_SPD) / sizeof(SEXR::D_65_SPD[0]);
+
+    Illuminant d65;
+    d65.name            = "D65";
+    d65.firstWavelength = SEXR::D_65_FIRST_WAVELENGTH_NM;
+    d65.spd             = std::vector<float>(SEXR::D_65_SPD, SEXR::D_65_SPD + d65Size);
+
+    // Nominal temperatures are defined with former values of c2
+    const float c2RatioD = 1.4388f / 1.4380f;
+    const float c2RatioA = 1.4388f / 1.4350f;
+
+    Illuminant e;
+    e.name            = "E";
+    e.firstWavelength = DAYLIGHT_FIRST_WAVELENGTH_NM;
+    e.spd             = std::vector<float>(10 * (DAYLIGHT_SIZE - 1) + 1, 100.f);
+
+    return {
+        d65,
+        daylight("D50", 5000.f * c2RatioD),
+        daylight("D55", 5500.f * c2RatioD),
+        daylight("D75", 7500.f * c2RatioD),
+        blackbody("A", 2848.f * c2RatioA),
+        e};
+}
+
+
+Colorimetry::Illuminant Colorimetry::daylight(const std::string &name, float cct)
+{
+    const double t = cct;
+
+    // Chromaticity of the daylight locus
+    double xD;
+
+    if (t <= 7000.) {
+        xD = -4.6070e9 / (t * t * t) + 2.9678e6 / (t * t) + 0.09911e3 / t + 0.244063;
+    } else {
+        xD = -2.0064e9 / (t * t * t) + 1.9018e6 / (t * t) + 0.24748e3 / t + 0.237040;
+    }
+
+    const double yD = -3.000 * xD * xD + 2.870 * xD - 0.275;
+
+    // Weights of the components, rounded as specified by the CIE
+    const double M  = 0.0241 + 0.2562 * xD - 0.7341 * yD;
+    const double M1 = std::round(1000. * (-1.3515 - 1.7703 * xD + 5.9114 * yD) / M) / 1000.;
+    const double M2 = std::round(1000. * (0.0300 - 31.4424 * xD + 30.0717 * yD) / M) / 1000.;
+
+    std::vector<double> wavelengths(DAYLIGHT_SIZE);
+    std::vector<double> values(DAYLIGHT_SIZE);
+
+    for (size_t i = 0; i < DAYLIGHT_SIZE; i++) {
+        wavelengths[i] = DAYLIGHT_FIRST_WAVELENGTH_NM + 10. * i;
+        values[i]      = DAYLIGHT_S0[i] + M1 * DAYLIGHT_S1[i] + M2 * DAYLIGHT_S2[i];
+    }
+
+    Illuminant illuminant;
+    illuminant.name = name;
+    illuminant.spd  = resample(wavelengths, values, illuminant.firstWavelength);
+
+    return illuminant;
+}
+
+
+Colorimetry::Illuminant Colorimetry::blackbody(const std::string &name, float temperature)
+{
+    const double c2 = 1.4388e7;   // nm.K
+
+    auto planck = [&](double wl) {
+        return 1. / (std::pow(wl, 5.) * (std::exp(c2 / (wl * temperature)) - 1.));
+    };
+
+    const double normalization = 100. / planck(560.);
+
+    Illuminant illuminant;
+    illuminant.name            = name;
+    illuminant.firstWavelength = DAYLIGHT_FIRST_WAVELENGTH_NM;
+    illuminant.spd.resize(10 * (DAYLIGHT_SIZE - 1) + 1);
+
+    for (size_t i = 0; i < illuminant.spd.size(); i++) {
+        illuminant.spd[i] = float(normalization * planck(DAYLIGHT_FIRST_WAVELENGTH_NM + i));
+    }
+
+    return illuminant;
+}
+
+
+Colorimetry::Illuminant Colorimetry::loadIlluminant(const std::string &path)
+{
+    std::vector<std::vector<double>> rows;
+    readColumns(path, 2, rows);
+
+    std::vector<double> wavelengths(rows.size()), values(rows.size());
+
+    for (size_t i = 0; i < rows.size(); i++) {
+        wavelengths[i] = rows[i][0];
+        values[i]      = rows[i][1];
+    }
+
+    Illuminant illuminant;
+    illuminant.name = path.substr(path.find_last_of("/\\") + 1);
+    illuminant.spd  = resample(wavelengths, values, illuminant.firstWavelength);
+
+    return illuminant;
+}
+
+
+Colorimetry::Observer Colorimetry::loadObserver(const std::string &path)
+{
+    std::vector<std::vector<double>> rows;
+    readColumns(path, 4, rows);
+
+    std::vector<double> wavelengths(rows.size());
+    std::vector<double> values[3];
+
+    for (size_t c = 0; c < 3; c++) {
+        values[c].resize(rows.size());
+    }
+
+    for (size_t i = 0; i < rows.size(); i++) {
+        wavelengths[i] = rows[i][0];
+
+        for (size_t c = 0; c < 3; c++) {
+            values[c][i] = rows[i][c + 1];
+        }
+    }
+
+    Observer observer;
+    observer.name = path.substr(path.find_last_of("/\\") + 1);
+
+    std::vector<float> xyz[3];
+    for (size_t c = 0; c < 3; c++) {
+        xyz[c] = resample(wavelengths, values[c], observer.firstWavelength);
+    }
+
+    observer.xyz.resize(3 * xyz[0].size());
+
+    for (size_t i = 0; i < xyz[0].size(); i++) {
+        for (size_t c = 0; c < 3; c++) {
+            observer.xyz[3 * i + c] = xyz[c][i];
+        }
+    }
+
+    return observer;
+}
+
+
+void Colorimetry::readColumns(
+    const std::string                &path,
+    size_t                            nColumns,
+    std::vector<std::vector<double>> &rows)
+{
+    std::ifstream ifs(path);
+
+    if (!ifs.is_open()) {
+        throw std::runtime_error("Cannot open " + path);
+    }
+
+    std::string line;
+
+    while (std::getline(ifs, line)) {
+        if (line.empty() || line[0] == '#') {
+            continue;
+        }
+
+        std::replace(line.begin(), line.end(), ',', ' ');
+        std::replace(line.begin(), line.end(), ';', ' ');
+
+        std::stringstream   ss(line);
+        std::vector<double> row(nColumns);
+        size_t              c = 0;
+
+        while (c < nColumns && ss >> row[c]) {
+            c++;
+        }
+
+        // Skip headers and incomplete lines
+        if (c == nColumns) {
+            rows.push_back(row);
+        }
+    }
+
+    if (rows.size() < 2) {
+        throw std::runtime_error("Not enough samples in " + path);
+    }
+
+    std::sort(
+        rows.begin(),
+        rows.end(),
+        [](const std::vector<double> &a, const std::vector<double> &b) {
+            return a[0] < b[0];
+        });
+}
+
+
+std::vector<float> Colorimetry::resample(
+    const std::vector<double> &wavelengths,
+    const std::vector<double> &values,
+    float                     &firstWavelength)
+{
+    const double first = std::ceil(wavelengths.front());
+    const double last  = std::floor(wavelengths.back());
+
+    firstWavelength = float(first);
+
+    std::vector<float> resampled;
+    size_t             i = 0;
+
+    for (double wl = first; wl <= last; wl += 1.) {
+        while (i + 2 < wavelengths.size() && wavelengths[i + 1] < wl) {
+            i++;
+        }
+
+        const double span = wavelengths[i + 1] - wavelengths[i];
+        const double t    = span > 0. ? (wl - wavelengths[i]) / span : 0.;
+
+        resampled.push_back(float((1. - t) * values[i] + t * values[i + 1]));
+    }
+
+    return resampled;
+}
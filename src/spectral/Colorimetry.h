@@ -0,0 +1,53 @@
+#pragma once
+
+#include <string>
+#include <vector>
+
+
+// Observers and illuminants available for the spectral conversion. All
+// spectra are resampled every nanometer, as expected by SpectralConverter.
+class Colorimetry
+{
+  public:
+    struct Observer {
+        std::string        name;
+        float              firstWavelength;
+        std::vector<float> xyz;   // Interleaved X, Y, Z
+    };
+
+    struct Illuminant {
+        std::string        name;
+        float              firstWavelength;
+        std::vector<float> spd;
+    };
+
+    // CIE 1931 2 deg.
+    static std::vector<Observer> builtinObservers();
+
+    // D65, D50, D55, D75, A and E
+    static std::vector<Illuminant> builtinIlluminants();
+
+    // CIE daylight from its correlated color temperature
+    static Illuminant daylight(const std::string &name, float cct);
+
+    // Planckian radiator normalized to 100 at 560nm
+    static Illuminant blackbody(const std::string &name, float temperature);
+
+    // Text files, one sample per line: "wavelength value" for illuminants
+    // and "wavelength x y z" for observers. Values can be separated by
+    // spaces, tabs or commas, lines starting with '#' are ignored.
+    static Illuminant loadIlluminant(const std::string &path);
+    static Observer   loadObserver(const std::string &path);
+
+  protected:
+    static void readColumns(
+        const std::string                &path,
+        size_t                            nColumns,
+        std::vector<std::vector<double>> &rows);
+
+    // Linear resampling every nanometer of a tabulated spectrum
+    static std::vector<float> resample(
+        const std::vector<double> &wavelengths,
+        const std::vector<double> &values,
+        float                     &firstWavelength);
+};
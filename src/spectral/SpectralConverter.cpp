@@ -0,0 +1,303 @@
+#include "SpectralConverter.h"
+
+#include <spectrum_data.h>
+
+#include <algorithm>
+#include <cmath>
+
+#ifdef _OPENMP
+#    include <omp.h>
+#endif
+
+
+SpectralConverter::SpectralConverter()
+    : _cmfFirstWavelength(0.f)
+    , _illuminantFirstWavelength(0.f)
+    , _isReflective(false)
+{
+    // Defaults: CIE 1931 2 deg. observer, D65 illuminant and sRGB primaries
+    const size_t cmfSize = sizeof(SEXR::CIE1931_2DEG_X) / sizeof(SEXR::CIE1931_2DEG_X[0]);
+
+    std::vector<float> cmfValues(3 * cmfSize);
+    for (size_t i = 0; i < cmfSize; i++) {
+        cmfValues[3 * i + 0] = SEXR::CIE1931_2DEG_X[i];
+        cmfValues[3 * i + 1] = SEXR::CIE1931_2DEG_Y[i];
+        cmfValues[3 * i + 2] = SEXR::CIE1931_2DEG_Z[i];
+    }
+
+    const size_t illuminantSize = sizeof(SEXR::D_65_SPD) / sizeof(SEXR::D_65_SPD[0]);
+
+    _cmf                       = cmfValues;
+    _cmfFirstWavelength        = SEXR::CIE1931_2DEG_FIRST_WAVELENGTH_NM;
+    _illuminant                = std::vector<float>(SEXR::D_65_SPD, SEXR::D_65_SPD + illuminantSize);
+    _illuminantFirstWavelength = SEXR::D_65_FIRST_WAVELENGTH_NM;
+
+    // clang-format off
+    _xyzToRgb = glm::mat3(
+         3.2406, -0.9689,  0.0557,
+        -1.5372,  1.8758, -0.2040,
+        -0.4986,  0.0415,  1.0570);
+    // clang-format on
+}
+
+
+// ----------------------------------------------------------------------------
+// Colorimetry
+// ----------------------------------------------------------------------------
+
+void SpectralConverter::setCMF(float firstWavelength, const std::vector<float> &xyz)
+{
+    _cmfFirstWavelength = firstWavelength;
+    _cmf                = xyz;
+
+    updateWeights();
+}
+
+
+void SpectralConverter::setIlluminant(float firstWavelength, const std::vector<float> &spd)
+{
+    _illuminantFirstWavelength = firstWavelength;
+    _illuminant                = spd;
+
+    updateWeights();
+}
+
+
+void SpectralConverter::setXYZToRGB(const glm::mat3 &xyzToRgb)
+{
+    _xyzToRgb = xyzToRgb;
+
+    updateWeights();
+}
+
+
+// ----------------------------------------------------------------------------
+// Image bands
+// ----------------------------------------------------------------------------
+
+void SpectralConverter::setBands(
+    const std::vector<float> &wavelengths,
+    const std::vector<float> &boundsWidths,
+    bool                      isReflective)
+{
+    _wavelengths  = wavelengths;
+    _boundsWidths = boundsWidths;
+    _isReflective = isReflective;
+
+    updateWeights();
+}
+
+
+void SpectralConverter::updateWeights()
+{
+    const size_t nBands = _wavelengths.size();
+
+    _weightsXYZ.assign(3 * nBands, 0.f);
+
+    if (!_isReflective) {
+        // Radiance is integrated against the CMFs over the band width
+        for (size_t i = 0; i < nBands; i++) {
+            for (size_t c = 0; c < 3; c++) {
+                _weightsXYZ[3 * i + c] = sampleCMF(_wavelengths[i], c) * _boundsWidths[i];
+            }
+        }
+    } else {
+        // Reflectance is lit by the illuminant, integrated in 1nm steps over
+        // the band width and normalized so a perfect white has Y = 1
+        double normalizationFactor = 0;
+
+        for (size_t i = 0; i < nBands; i++) {
+            for (int j = 0; j < _boundsWidths[i]; j++) {
+                const float wl   = _wavelengths[i] + j;
+                const float illu = sampleIlluminant(wl);
+
+                for (size_t c = 0; c < 3; c++) {
+                    _weightsXYZ[3 * i + c] += illu * sampleCMF(wl, c);
+                }
+
+                normalizationFactor += illu * sampleCMF(wl, 1);
+            }
+        }
+
+        if (normalizationFactor > 0) {
+            for (float &w : _weightsXYZ) {
+                w = float(w / normalizationFactor);
+            }
+        }
+    }
+
+    _weightsRGB.resize(3 * nBands);
+    _weightsR.resize(nBands);
+    _weightsG.resize(nBands);
+    _weightsB.resize(nBands);
+
+    for (size_t i = 0; i < nBands; i++) {
+        const glm::vec3 rgb = _xyzToRgb * glm::vec3(_weightsXYZ[3 * i + 0], _weightsXYZ[3 * i + 1], _weightsXYZ[3 * i + 2]);
+
+        _weightsRGB[3 * i + 0] = rgb.r;
+        _weightsRGB[3 * i + 1] = rgb.g;
+        _weightsRGB[3 * i + 2] = rgb.b;
+
+        _weightsR[i] = rgb.r;
+        _weightsG[i] = rgb.g;
+        _weightsB[i] = rgb.b;
+    }
+}
+
+
+float SpectralConverter::sampleCMF(float wavelength, size_t component) const
+{
+    const size_t size = _cmf.size() / 3;
+    const float  idx  = wavelength - _cmfFirstWavelength;
+
+    if (size == 0 || idx < 0.f || idx > float(size - 1)) {
+        return 0.f;
+    }
+
+    const size_t i0 = std::min((size_t)idx, size - 1);
+    const size_t i1 = std::min(i0 + 1, size - 1);
+    const float  t  = idx - float(i0);
+
+    return (1.f - t) * _cmf[3 * i0 + component] + t * _cmf[3 * i1 + component];
+}
+
+
+float SpectralConverter::sampleIlluminant(float wavelength) const
+{
+    const size_t size = _illuminant.size();
+    const float  idx  = wavelength - _illuminantFirstWavelength;
+
+    if (size == 0 || idx < 0.f || idx > float(size - 1)) {
+        return 0.f;
+    }
+
+    const size_t i0 = std::min((size_t)idx, size - 1);
+    const size_t i1 = std::min(i0 + 1, size - 1);
+    const float  t  = idx - float(i0);
+
+    return (1.f - t) * _illuminant[i0] + t * _illuminant[i1];
+}
+
+
+// ----------------------------------------------------------------------------
+// Conversion
+// ----------------------------------------------------------------------------
+
+glm::vec3 SpectralConverter::convertPixel(const float *spectrum) const
+{
+    const size_t nBands = _wavelengths.size();
+
+    const float *wR = _weightsR.data();
+    const float *wG = _weightsG.data();
+    const float *wB = _weightsB.data();
+
+    float r = 0.f, g = 0.f, b = 0.f;
+
+#pragma omp simd reduction(+ : r, g, b)
+    for (size_t i = 0; i < nBands; i++) {
+        r += spectrum[i] * wR[i];
+        g += spectrum[i] * wG[i];
+        b += spectrum[i] * wB[i];
+    }
+
+    return glm::vec3(r, g, b);
+}
+
+
+glm::vec3 SpectralConverter::convertPixelXYZ(const float *spectrum) const
+{
+    const size_t nBands = _wavelengths.size();
+
+    glm::vec3 xyz(0.f);
+
+    for (size_t i = 0; i < nBands; i++) {
+        xyz += spectrum[i] * glm::vec3(_weightsXYZ[3 * i + 0], _weightsXYZ[3 * i + 1], _weightsXYZ[3 * i + 2]);
+    }
+
+    return xyz;
+}
+
+
+glm::vec3 SpectralConverter::whitePointXYZ() const
+{
+    if (!_isReflective) {
+        return glm::inverse(_xyzToRgb) * glm::vec3(1.f);
+    }
+
+    glm::vec3 white(0.f);
+
+    for (size_t i = 0; i < _wavelengths.size(); i++) {
+        white += glm::vec3(_weightsXYZ[3 * i + 0], _weightsXYZ[3 * i + 1], _weightsXYZ[3 * i + 2]);
+    }
+
+    return white;
+}
+
+
+glm::vec3 SpectralConverter::xyzToLab(const glm::vec3 &xyz, const glm::vec3 &white)
+{
+    auto f = [](float t) {
+        const float delta = 6.f / 29.f;
+
+        return t > delta * delta * delta
+                   ? std::cbrt(t)
+                   : t / (3.f * delta * delta) + 4.f / 29.f;
+    };
+
+    const float fx = f(xyz.x / white.x);
+    const float fy = f(xyz.y / white.y);
+    const float fz = f(xyz.z / white.z);
+
+    return glm::vec3(116.f * fy - 16.f, 500.f * (fx - fy), 200.f * (fy - fz));
+}
+
+
+void SpectralConverter::convert(
+    const float *spectra,
+    size_t       width,
+    size_t       height,
+    float       *rgba,
+    int          nThreads) const
+{
+    const size_t nBands = _wavelengths.size();
+
+    const size_t nTilesX = (width + TILE_SIZE - 1) / TILE_SIZE;
+    const size_t nTilesY = (height + TILE_SIZE - 1) / TILE_SIZE;
+    const long   nTiles  = (long)(nTilesX * nTilesY);
+
+    if (nThreads <= 0) {
+        nThreads = maxThreads();
+    }
+
+    // Tiles keep each worker on a compact region of the cube, spectra of a
+    // pixel being contiguous in memory the band loop vectorizes
+#pragma omp parallel for schedule(dynamic) num_threads(nThreads)
+    for (long tile = 0; tile < nTiles; tile++) {
+        const size_t x0 = (tile % nTilesX) * TILE_SIZE;
+        const size_t y0 = (tile / nTilesX) * TILE_SIZE;
+        const size_t x1 = std::min(x0 + TILE_SIZE, width);
+        const size_t y1 = std::min(y0 + TILE_SIZE, height);
+
+        for (size_t y = y0; y < y1; y++) {
+            for (size_t x = x0; x < x1; x++) {
+                const size_t    px  = y * width + x;
+                const glm::vec3 rgb = convertPixel(&spectra[nBands * px]);
+
+                rgba[4 * px + 0] = rgb.r;
+                rgba[4 * px + 1] = rgb.g;
+                rgba[4 * px + 2] = rgb.b;
+                rgba[4 * px + 3] = 1.f;
+            }
+        }
+    }
+}
+
+
+int SpectralConverter::maxThreads()
+{
+#ifdef _OPENMP
+    return omp_get_max_threads();
+#else
+    return 1;
+#endif
+}
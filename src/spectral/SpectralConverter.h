@@ -0,0 +1,100 @@
+#pragma once
+
+#include <glm/glm.hpp>
+
+#include <vector>
+#include <cstddef>
+
+
+// CPU implementation of the spectral to RGB conversion. Each band of the
+// image is reduced to an RGB weight (CMF, illuminant and band width with the
+// XYZ to RGB matrix folded in) so converting a pixel boils down to three dot
+// products over its bands. The same weights are uploaded to the GPU, which
+// keeps both paths in agreement.
+class SpectralConverter
+{
+  public:
+    SpectralConverter();
+
+    // ------------------------------------------------------------------------
+    // Colorimetry
+    // ------------------------------------------------------------------------
+
+    // CMFs sampled every nanometer, interleaved as X, Y, Z
+    void setCMF(float firstWavelength, const std::vector<float> &xyz);
+
+    // Illuminant SPD sampled every nanometer
+    void setIlluminant(float firstWavelength, const std::vector<float> &spd);
+
+    void setXYZToRGB(const glm::mat3 &xyzToRgb);
+
+    const glm::mat3 &xyzToRgb() const { return _xyzToRgb; }
+
+    // ------------------------------------------------------------------------
+    // Image bands
+    // ------------------------------------------------------------------------
+
+    void setBands(
+        const std::vector<float> &wavelengths,
+        const std::vector<float> &boundsWidths,
+        bool                      isReflective);
+
+    size_t nBands() const { return _wavelengths.size(); }
+
+    // Per band weights, interleaved as R, G, B (resp. X, Y, Z)
+    const std::vector<float> &bandWeightsRGB() const { return _weightsRGB; }
+    const std::vector<float> &bandWeightsXYZ() const { return _weightsXYZ; }
+
+    // ------------------------------------------------------------------------
+    // Conversion
+    // ------------------------------------------------------------------------
+
+    glm::vec3 convertPixel(const float *spectrum) const;
+    glm::vec3 convertPixelXYZ(const float *spectrum) const;
+
+    // Reference white of the Lab values: the perfect reflector for
+    // reflective images, the white of the RGB space with Y = 1 otherwise
+    glm::vec3 whitePointXYZ() const;
+
+    // CIE 1976 L*a*b* relative to the given white
+    static glm::vec3 xyzToLab(const glm::vec3 &xyz, const glm::vec3 &white);
+
+    // Spectra are stored band first: spectra[nBands * (y * width + x) + band]
+    // The output is RGBA, row ordered as the input. When nThreads is 0, all
+    // the available cores are used.
+    void convert(
+        const float *spectra,
+        size_t       width,
+        size_t       height,
+        float       *rgba,
+        int          nThreads = 0) const;
+
+    static int maxThreads();
+
+    static const size_t TILE_SIZE = 64;
+
+  protected:
+    void updateWeights();
+
+    float sampleCMF(float wavelength, size_t component) const;
+    float sampleIlluminant(float wavelength) const;
+
+  private:
+    std::vector<float> _cmf;
+    float              _cmfFirstWavelength;
+
+    std::vector<float> _illuminant;
+    float              _illuminantFirstWavelength;
+
+    glm::mat3 _xyzToRgb;
+
+    std::vector<float> _wavelengths;
+    std::vector<float> _boundsWidths;
+    bool               _isReflective;
+
+    std::vector<float> _weightsXYZ;
+    std::vector<float> _weightsRGB;
+
+    // Planar copy of the RGB weights for vectorized accumulation
+    std::vector<float> _weightsR, _weightsG, _weightsB;
+};
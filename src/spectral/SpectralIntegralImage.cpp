@@ -0,0 +1,266 @@
+#include "SpectralIntegralImage.h"
+
+#include "SpectralConverter.h"
+
+#include <algorithm>
+#include <cmath>
+
+
+SpectralIntegralImage::SpectralIntegralImage()
+    : _width(0)
+    , _height(0)
+{
+}
+
+
+void SpectralIntegralImage::compute(
+    const float *spectra,
+    size_t       width,
+    size_t       height,
+    size_t       nBands,
+    int          nThreads)
+{
+    if (nThreads <= 0) {
+        nThreads = SpectralConverter::maxThreads();
+    }
+
+    _width  = width;
+    _height = height;
+
+    // ------------------------------------------------------------------------
+    // Per band mean, used as shift
+    // ------------------------------------------------------------------------
+
+    _shift.assign(nBands, 0.);
+
+    std::vector<size_t> nFinite(nBands, 0);
+
+#pragma omp parallel num_threads(nThreads)
+    {
+        std::vector<double> localSum(nBands, 0.);
+        std::vector<size_t> localFinite(nBands, 0);
+
+#pragma omp for schedule(static) nowait
+        for (long y = 0; y < (long)height; y++) {
+            for (size_t x = 0; x < width; x++) {
+                const float *spectrum = &spectra[nBands * (y * width + x)];
+
+                for (size_t b = 0; b < nBands; b++) {
+                    if (std::isfinite(spectrum[b])) {
+                        localSum[b] += spectrum[b];
+                        localFinite[b]++;
+                    }
+                }
+            }
+        }
+
+#pragma omp critical
+        {
+            for (size_t b = 0; b < nBands; b++) {
+                _shift[b] += localSum[b];
+                nFinite[b] += localFinite[b];
+            }
+        }
+    }
+
+    for (size_t b = 0; b < nBands; b++) {
+        _shift[b] = nFinite[b] > 0 ? _shift[b] / (double)nFinite[b] : 0.;
+    }
+
+    // ------------------------------------------------------------------------
+    // Tables
+    // ------------------------------------------------------------------------
+
+    const size_t nEntries = nBands * (width + 1) * (height + 1);
+
+    _sums.assign(nEntries, 0.);
+    _squaredSums.assign(nEntries, 0.);
+
+    // Prefix sums along the rows, rows are independent
+#pragma omp parallel num_threads(nThreads)
+    {
+        std::vector<double> sum(nBands), squaredSum(nBands);
+
+#pragma omp for schedule(static)
+        for (long y = 0; y < (long)height; y++) {
+            std::fill(sum.begin(), sum.end(), 0.);
+            std::fill(squaredSum.begin(), squaredSum.end(), 0.);
+
+            for (size_t x = 0; x < width; x++) {
+                const float *spectrum = &spectra[nBands * (y * width + x)];
+                const size_t entry    = index(x + 1, y + 1);
+
+                for (size_t b = 0; b < nBands; b++) {
+                    const double v = std::isfinite(spectrum[b]) ? spectrum[b] - _shift[b] : 0.;
+
+                    sum[b] += v;
+                    squaredSum[b] += v * v;
+
+                    _sums[entry + b]        = sum[b];
+                    _squaredSums[entry + b] = squaredSum[b];
+                }
+            }
+        }
+    }
+
+    // Prefix sums along the columns, by blocks of columns so each thread
+    // walks contiguous memory
+    const size_t rowEntries = nBands * (width + 1);
+    const size_t blockSize  = 64 * nBands;
+    const long   nColBlocks = (long)((rowEntries + blockSize - 1) / blockSize);
+
+#pragma omp parallel for schedule(static) num_threads(nThreads)
+    for (long block = 0; block < nColBlocks; block++) {
+        const size_t begin = block * blockSize;
+        const size_t end   = std::min(rowEntries, begin + blockSize);
+
+        for (size_t y = 2; y <= height; y++) {
+            double       *sums        = &_sums[y * rowEntries];
+            double       *squaredSums = &_squaredSums[y * rowEntries];
+            const double *prevSums    = &_sums[(y - 1) * rowEntries];
+            const double *prevSquared = &_squaredSums[(y - 1) * rowEntries];
+
+            for (size_t i = begin; i < end; i++) {
+                sums[i] += prevSums[i];
+                squaredSums[i] += prevSquared[i];
+            }
+        }
+    }
+}
+
+
+void SpectralIntegralImage::clear()
+{
+    _width  = 0;
+    _height = 0;
+
+    _shift.clear();
+    _sums.clear();
+    _sums.shrink_to_fit();
+    _squaredSums.clear();
+    _squaredSums.shrink_to_fit();
+}
+
+
+void SpectralIntegralImage::regionStatistics(
+    size_t              x0,
+    size_t              y0,
+    size_t              x1,
+    size_t              y1,
+    std::vector<float> &mean,
+    std::vector<float> &stdDev) const
+{
+    const size_t nBands = this->nBands();
+
+    x1 = std::min(x1, _width);
+    y1 = std::min(y1, _height);
+
+    mean.assign(nBands, 0.f);
+    stdDev.assign(nBands, 0.f);
+
+    if (x0 >= x1 || y0 >= y1) {
+        return;
+    }
+
+    const double n = double(x1 - x0) * double(y1 - y0);
+
+    const size_t a = index(x0, y0);
+    const size_t b = index(x1, y0);
+    const size_t c = index(x0, y1);
+    const size_t d = index(x1, y1);
+
+    for (size_t i = 0; i < nBands; i++) {
+        const double sum        = _sums[d + i] - _sums[b + i] - _sums[c + i] + _sums[a + i];
+        const double squaredSum = _squaredSums[d + i] - _squaredSums[b + i] - _squaredSums[c + i] + _squaredSums[a + i];
+
+        const double m = sum / n;
+
+        mean[i]   = float(_shift[i] + m);
+        stdDev[i] = float(std::sqrt(std::max(0., squaredSum / n - m * m)));
+    }
+}
+
+
+void SpectralIntegralImage::regionStatistics(
+    const float        *spectra,
+    size_t              width,
+    size_t              nBands,
+    size_t              x0,
+    size_t              y0,
+    size_t              x1,
+    size_t              y1,
+    std::vector<float> &mean,
+    std::vector<float> &stdDev,
+    int                 nThreads)
+{
+    if (nThreads <= 0) {
+        nThreads = SpectralConverter::maxThreads();
+    }
+
+    x1 = std::min(x1, width);
+
+    mean.assign(nBands, 0.f);
+    stdDev.assign(nBands, 0.f);
+
+    if (x0 >= x1 || y0 >= y1) {
+        return;
+    }
+
+    // Shifted by the first pixel of the region against cancellation
+    std::vector<double> shift(nBands, 0.);
+    std::vector<double> sum(nBands, 0.), squaredSum(nBands, 0.);
+    std::vector<size_t> nFinite(nBands, 0);
+
+    for (size_t b = 0; b < nBands; b++) {
+        const float v = spectra[nBands * (y0 * width + x0) + b];
+        shift[b]      = std::isfinite(v) ? v : 0.;
+    }
+
+#pragma omp parallel num_threads(nThreads)
+    {
+        std::vector<double> localSum(nBands, 0.), localSquared(nBands, 0.);
+        std::vector<size_t> localFinite(nBands, 0);
+
+#pragma omp for schedule(static) nowait
+        for (long y = (long)y0; y < (long)y1; y++) {
+            for (size_t x = x0; x < x1; x++) {
+                const float *spectrum = &spectra[nBands * (y * width + x)];
+
+                for (size_t b = 0; b < nBands; b++) {
+                    if (std::isfinite(spectrum[b])) {
+                        const double v = spectrum[b] - shift[b];
+
+                        localSum[b] += v;
+                        localSquared[b] += v * v;
+                        localFinite[b]++;
+                    }
+                }
+            }
+        }
+
+#pragma omp critical
+        {
+            for (size_t b = 0; b < nBands; b++) {
+                sum[b] += localSum[b];
+                squaredSum[b] += localSquared[b];
+                nFinite[b] += localFinite[b];
+            }
+        }
+    }
+
+    for (size_t b = 0; b < nBands; b++) {
+        if (nFinite[b] > 0) {
+            const double n = (double)nFinite[b];
+            const double m = sum[b] / n;
+
+            mean[b]   = float(shift[b] + m);
+            stdDev[b] = float(std::sqrt(std::max(0., squaredSum[b] / n - m * m)));
+        }
+    }
+}
+
+
+size_t SpectralIntegralImage::bytes(size_t width, size_t height, size_t nBands)
+{
+    return 2 * sizeof(double) * nBands * (width + 1) * (height + 1);
+}
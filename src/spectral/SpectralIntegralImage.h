@@ -0,0 +1,74 @@
+#pragma once
+
+#include <cstddef>
+#include <vector>
+
+
+// Per band summed-area tables of the values and of their squares, so the
+// mean and standard deviation of any rectangle are evaluated in O(nBands)
+// whatever its size.
+//
+// Sums are accumulated in double precision on values shifted by the mean of
+// each band, which keeps the variance of small regions of large images from
+// being lost to cancellation.
+class SpectralIntegralImage
+{
+  public:
+    SpectralIntegralImage();
+
+    // Spectra are stored band first: spectra[nBands * (y * width + x) + band]
+    // Non finite values are accounted for as the mean of their band. When
+    // nThreads is 0, all the available cores are used.
+    void compute(
+        const float *spectra,
+        size_t       width,
+        size_t       height,
+        size_t       nBands,
+        int          nThreads = 0);
+
+    void clear();
+
+    bool empty() const { return _sums.empty(); }
+
+    size_t width() const { return _width; }
+    size_t height() const { return _height; }
+    size_t nBands() const { return _shift.size(); }
+
+    // Mean and standard deviation of each band over [x0, x1) x [y0, y1)
+    void regionStatistics(
+        size_t              x0,
+        size_t              y0,
+        size_t              x1,
+        size_t              y1,
+        std::vector<float> &mean,
+        std::vector<float> &stdDev) const;
+
+    // Same statistics summed directly from the spectra, in O(nBands * area),
+    // for images whose tables would not fit in memory. Non finite values are
+    // skipped.
+    static void regionStatistics(
+        const float        *spectra,
+        size_t              width,
+        size_t              nBands,
+        size_t              x0,
+        size_t              y0,
+        size_t              x1,
+        size_t              y1,
+        std::vector<float> &mean,
+        std::vector<float> &stdDev,
+        int                 nThreads = 0);
+
+    // Memory used by the tables of an image
+    static size_t bytes(size_t width, size_t height, size_t nBands);
+
+  private:
+    // Entry of the tables, (width + 1) x (height + 1) with a zero first row
+    // and column, band first
+    size_t index(size_t x, size_t y) const { return nBands() * (y * (_width + 1) + x); }
+
+    size_t _width, _height;
+
+    std::vector<double> _shift;
+    std::vector<double> _sums;
+    std::vector<double> _squaredSums;
+};
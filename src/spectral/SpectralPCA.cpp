@@ -0,0 +1,371 @@
+#include "SpectralPCA.h"
+
+#include "SpectralConverter.h"
+
+#include <algorithm>
+#include <cmath>
+#include <numeric>
+#include <stdexcept>
+
+
+SpectralPCA::SpectralPCA()
+    : _nComponents(0)
+    , _nPixels(0)
+    , _rmsError(0.)
+    , _maxAbsError(0.f)
+{
+}
+
+
+void SpectralPCA::compute(
+    const float *spectra,
+    size_t       nPixels,
+    size_t       nBands,
+    size_t       nComponents,
+    int          nThreads)
+{
+    if (nBands == 0 || nPixels == 0) {
+        throw std::runtime_error("Cannot compute the PCA of an empty image");
+    }
+
+    if (nThreads <= 0) {
+        nThreads = SpectralConverter::maxThreads();
+    }
+
+    _nComponents = std::max(size_t(1), std::min(nComponents, nBands));
+    _nPixels     = nPixels;
+
+    const size_t stride   = (nPixels + MAX_FIT_SAMPLES - 1) / MAX_FIT_SAMPLES;
+    const long   nSamples = (long)((nPixels + stride - 1) / stride);
+
+    // ------------------------------------------------------------------------
+    // Mean spectrum
+    // ------------------------------------------------------------------------
+
+    // Spectra with non finite values would spoil the whole basis
+    auto isFinite = [nBands](const float *spectrum) {
+        for (size_t i = 0; i < nBands; i++) {
+            if (!std::isfinite(spectrum[i])) {
+                return false;
+            }
+        }
+
+        return true;
+    };
+
+    std::vector<double> mean(nBands, 0.);
+    size_t              nValid = 0;
+
+#pragma omp parallel num_threads(nThreads)
+    {
+        std::vector<double> localMean(nBands, 0.);
+        size_t              localValid = 0;
+
+#pragma omp for schedule(static) nowait
+        for (long s = 0; s < nSamples; s++) {
+            const float *spectrum = &spectra[nBands * stride * s];
+
+            if (isFinite(spectrum)) {
+                for (size_t i = 0; i < nBands; i++) {
+                    localMean[i] += spectrum[i];
+                }
+
+                localValid++;
+            }
+        }
+
+#pragma omp critical
+        {
+            for (size_t i = 0; i < nBands; i++) {
+                mean[i] += localMean[i];
+            }
+
+            nValid += localValid;
+        }
+    }
+
+    if (nValid == 0) {
+        throw std::runtime_error("Cannot compute the PCA: no finite spectrum in the image");
+    }
+
+    for (size_t i = 0; i < nBands; i++) {
+        mean[i] /= (double)nValid;
+    }
+
+    // ------------------------------------------------------------------------
+    // Band covariance
+    // ------------------------------------------------------------------------
+
+    // Each worker accumulates the upper triangle of its own matrix
+    std::vector<double> covariance(nBands * nBands, 0.);
+
+#pragma omp parallel num_threads(nThreads)
+    {
+        std::vector<double> localCovariance(nBands * nBands, 0.);
+        std::vector<double> centered(nBands);
+
+#pragma omp for schedule(static) nowait
+        for (long s = 0; s < nSamples; s++) {
+            const float *spectrum = &spectra[nBands * stride * s];
+
+            if (!isFinite(spectrum)) {
+                continue;
+            }
+
+            for (size_t i = 0; i < nBands; i++) {
+                centered[i] = spectrum[i] - mean[i];
+            }
+
+            for (size_t i = 0; i < nBands; i++) {
+                const double ci  = centered[i];
+                double      *row = &localCovariance[nBands * i];
+
+#pragma omp simd
+                for (size_t j = i; j < nBands; j++) {
+                    row[j] += ci * centered[j];
+                }
+            }
+        }
+
+#pragma omp critical
+        {
+            for (size_t i = 0; i < nBands * nBands; i++) {
+                covariance[i] += localCovariance[i];
+            }
+        }
+    }
+
+    for (size_t i = 0; i < nBands; i++) {
+        for (size_t j = i; j < nBands; j++) {
+            covariance[nBands * i + j] /= (double)nValid;
+            covariance[nBands * j + i] = covariance[nBands * i + j];
+        }
+    }
+
+    // ------------------------------------------------------------------------
+    // Basis
+    // ------------------------------------------------------------------------
+
+    std::vector<double> values, vectors;
+    eigenSymmetric(covariance, nBands, values, vectors);
+
+    std::vector<size_t> order(nBands);
+    std::iota(order.begin(), order.end(), 0);
+    std::sort(order.begin(), order.end(), [&values](size_t a, size_t b) {
+        return values[a] > values[b];
+    });
+
+    _eigenvalues.resize(nBands);
+    for (size_t i = 0; i < nBands; i++) {
+        // Negative values are rounding errors of a semi definite matrix
+        _eigenvalues[i] = std::max(0., values[order[i]]);
+    }
+
+    _mean.assign(mean.begin(), mean.end());
+    _basis.resize(nBands * _nComponents);
+
+    for (size_t band = 0; band < nBands; band++) {
+        for (size_t k = 0; k < _nComponents; k++) {
+            _basis[_nComponents * band + k] = (float)vectors[nBands * band + order[k]];
+        }
+    }
+
+    // ------------------------------------------------------------------------
+    // Projection
+    // ------------------------------------------------------------------------
+
+    const size_t nK = _nComponents;
+
+    _coefficients.resize(nK * nPixels);
+
+    double squaredError = 0.;
+    float  maxAbsError  = 0.f;
+    size_t nFinite      = 0;
+
+#pragma omp parallel num_threads(nThreads)
+    {
+        std::vector<float> reconstructed(nBands);
+
+#pragma omp for schedule(static) reduction(+ : squaredError, nFinite) reduction(max : maxAbsError)
+        for (long px = 0; px < (long)nPixels; px++) {
+            const float *spectrum     = &spectra[nBands * px];
+            float       *coefficients = &_coefficients[nK * px];
+
+            std::fill(coefficients, coefficients + nK, 0.f);
+
+            for (size_t band = 0; band < nBands; band++) {
+                const float  centered = spectrum[band] - _mean[band];
+                const float *b        = &_basis[nK * band];
+
+                for (size_t k = 0; k < nK; k++) {
+                    coefficients[k] += centered * b[k];
+                }
+            }
+
+            reconstruct(coefficients, reconstructed.data());
+
+            double pixelError = 0.;
+            float  pixelMax   = 0.f;
+
+            for (size_t band = 0; band < nBands; band++) {
+                const float e = std::abs(reconstructed[band] - spectrum[band]);
+
+                pixelError += (double)e * (double)e;
+                pixelMax = std::max(pixelMax, e);
+            }
+
+            if (std::isfinite(pixelError)) {
+                squaredError += pixelError;
+                maxAbsError = std::max(maxAbsError, pixelMax);
+                nFinite++;
+            }
+        }
+    }
+
+    _rmsError    = (nFinite > 0) ? std::sqrt(squaredError / (double)(nFinite * nBands)) : 0.;
+    _maxAbsError = maxAbsError;
+}
+
+
+void SpectralPCA::releaseCoefficients()
+{
+    std::vector<float>().swap(_coefficients);
+}
+
+
+double SpectralPCA::explainedVariance() const
+{
+    const double total = std::accumulate(_eigenvalues.begin(), _eigenvalues.end(), 0.);
+
+    if (total <= 0.) {
+        return 1.;
+    }
+
+    const double retained = std::accumulate(
+        _eigenvalues.begin(),
+        _eigenvalues.begin() + std::min(_nComponents, _eigenvalues.size()),
+        0.);
+
+    return retained / total;
+}
+
+
+void SpectralPCA::projectWeights(
+    const std::vector<float> &weights,
+    size_t                    nChannels,
+    std::vector<float>       &projected,
+    std::vector<float>       &offset) const
+{
+    const size_t nBands = _mean.size();
+
+    projected.assign(_nComponents * nChannels, 0.f);
+    offset.assign(nChannels, 0.f);
+
+    for (size_t band = 0; band < nBands; band++) {
+        const float *w = &weights[nChannels * band];
+
+        for (size_t c = 0; c < nChannels; c++) {
+            offset[c] += w[c] * _mean[band];
+        }
+
+        for (size_t k = 0; k < _nComponents; k++) {
+            for (size_t c = 0; c < nChannels; c++) {
+                projected[nChannels * k + c] += w[c] * _basis[_nComponents * band + k];
+            }
+        }
+    }
+}
+
+
+void SpectralPCA::reconstruct(const float *coefficients, float *spectrum) const
+{
+    const size_t nBands = _mean.size();
+
+    for (size_t band = 0; band < nBands; band++) {
+        const float *b     = &_basis[_nComponents * band];
+        float        value = _mean[band];
+
+        for (size_t k = 0; k < _nComponents; k++) {
+            value += coefficients[k] * b[k];
+        }
+
+        spectrum[band] = value;
+    }
+}
+
+
+void SpectralPCA::eigenSymmetric(
+    std::vector<double> &a,
+    size_t               n,
+    std::vector<double> &values,
+    std::vector<double> &vectors)
+{
+    vectors.assign(n * n, 0.);
+    for (size_t i = 0; i < n; i++) {
+        vectors[n * i + i] = 1.;
+    }
+
+    double diagonal = 0.;
+    for (size_t i = 0; i < n; i++) {
+        diagonal += a[n * i + i] * a[n * i + i];
+    }
+
+    for (int sweep = 0; sweep < 100; sweep++) {
+        double off = 0.;
+
+        for (size_t p = 0; p < n; p++) {
+            for (size_t q = p + 1; q < n; q++) {
+                off += a[n * p + q] * a[n * p + q];
+            }
+        }
+
+        if (off <= 1e-24 * diagonal || off == 0.) {
+            break;
+        }
+
+        for (size_t p = 0; p + 1 < n; p++) {
+            for (size_t q = p + 1; q < n; q++) {
+                const double apq = a[n * p + q];
+
+                if (apq == 0.) {
+                    continue;
+                }
+
+                // Rotation zeroing a[p][q]
+                const double theta = (a[n * q + q] - a[n * p + p]) / (2. * apq);
+                const double t     = (theta >= 0. ? 1. : -1.) / (std::abs(theta) + std::sqrt(theta * theta + 1.));
+                const double c     = 1. / std::sqrt(t * t + 1.);
+                const double s     = t * c;
+
+                for (size_t k = 0; k < n; k++) {
+                    const double akp = a[n * k + p];
+                    const double akq = a[n * k + q];
+
+                    a[n * k + p] = c * akp - s * akq;
+                    a[n * k + q] = s * akp + c * akq;
+                }
+
+                for (size_t k = 0; k < n; k++) {
+                    const double apk = a[n * p + k];
+                    const double aqk = a[n * q + k];
+
+                    a[n * p + k] = c * apk - s * aqk;
+                    a[n * q + k] = s * apk + c * aqk;
+                }
+
+                for (size_t k = 0; k < n; k++) {
+                    const double vkp = vectors[n * k + p];
+                    const double vkq = vectors[n * k + q];
+
+                    vectors[n * k + p] = c * vkp - s * vkq;
+                    vectors[n * k + q] = s * vkp + c * vkq;
+                }
+            }
+        }
+    }
+
+    values.resize(n);
+    for (size_t i = 0; i < n; i++) {
+        values[i] = a[n * i + i];
+    }
+}
@@ -0,0 +1,88 @@
+#pragma once
+
+#include <vector>
+#include <cstddef>
+
+
+// Principal component analysis of a spectral image. Spectra are approximated
+// as the mean spectrum plus a linear combination of a few basis vectors:
+//
+//   spectrum[band] ~ mean[band] + sum_k coefficients[k] * basis[k][band]
+//
+// Since the spectral to RGB conversion is linear, the per band weights can be
+// projected on the basis once, so converting a pixel only costs nComponents
+// products instead of nBands.
+class SpectralPCA
+{
+  public:
+    SpectralPCA();
+
+    // Spectra are stored band first: spectra[nBands * pixel + band]. The basis
+    // is fitted on at most MAX_FIT_SAMPLES evenly spaced pixels, all pixels
+    // are then projected. When nThreads is 0, all the available cores are
+    // used.
+    void compute(
+        const float *spectra,
+        size_t       nPixels,
+        size_t       nBands,
+        size_t       nComponents,
+        int          nThreads = 0);
+
+    size_t nBands() const { return _mean.size(); }
+    size_t nComponents() const { return _nComponents; }
+    size_t nPixels() const { return _nPixels; }
+
+    const std::vector<float> &mean() const { return _mean; }
+
+    // Basis vectors, band first: basis[nComponents * band + component]
+    const std::vector<float> &basis() const { return _basis; }
+
+    // Projected image: coefficients[nComponents * pixel + component]
+    const std::vector<float> &coefficients() const { return _coefficients; }
+
+    // Frees the projected image once uploaded, statistics are kept
+    void releaseCoefficients();
+
+    // Eigenvalues of the band covariance, in decreasing order
+    const std::vector<double> &eigenvalues() const { return _eigenvalues; }
+
+    // Fraction of the variance retained by the components
+    double explainedVariance() const;
+
+    // Reconstruction error over all the pixels
+    double rmsError() const { return _rmsError; }
+    float  maxAbsError() const { return _maxAbsError; }
+
+    // Projects per band weights with nChannels interleaved channels on the
+    // basis. The contribution of the mean spectrum is returned in offset.
+    void projectWeights(
+        const std::vector<float> &weights,
+        size_t                    nChannels,
+        std::vector<float>       &projected,
+        std::vector<float>       &offset) const;
+
+    void reconstruct(const float *coefficients, float *spectrum) const;
+
+    static const size_t MAX_FIT_SAMPLES = size_t(1) << 20;
+
+  protected:
+    // Cyclic Jacobi eigen decomposition of a symmetric n x n matrix, row
+    // ordered. Eigenvectors are returned as columns of vectors.
+    static void eigenSymmetric(
+        std::vector<double> &a,
+        size_t               n,
+        std::vector<double> &values,
+        std::vector<double> &vectors);
+
+  private:
+    size_t _nComponents;
+    size_t _nPixels;
+
+    std::vector<float>  _mean;
+    std::vector<float>  _basis;
+    std::vector<float>  _coefficients;
+    std::vector<double> _eigenvalues;
+
+    double _rmsError;
+    float  _maxAbsError;
+};
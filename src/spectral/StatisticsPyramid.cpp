@@ -0,0 +1,174 @@
+#include "StatisticsPyramid.h"
+
+#include "SpectralConverter.h"
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+
+
+StatisticsPyramid::StatisticsPyramid()
+    : _width(0)
+    , _height(0)
+{
+}
+
+
+void StatisticsPyramid::build(size_t width, size_t height, const RowFunction &row, int nThreads)
+{
+    if (nThreads <= 0) {
+        nThreads = SpectralConverter::maxThreads();
+    }
+
+    _width  = width;
+    _height = height;
+    _levels.clear();
+
+    if (width == 0 || height == 0) {
+        return;
+    }
+
+    const Node emptyNode = {
+        std::numeric_limits<float>::infinity(),
+        -std::numeric_limits<float>::infinity(),
+        0.,
+        0};
+
+    // ------------------------------------------------------------------------
+    // Blocks of pixels
+    // ------------------------------------------------------------------------
+
+    Level base;
+    base.blockSize = BLOCK_SIZE;
+    base.width     = (width + BLOCK_SIZE - 1) / BLOCK_SIZE;
+    base.height    = (height + BLOCK_SIZE - 1) / BLOCK_SIZE;
+    base.nodes.assign(base.width * base.height, emptyNode);
+
+    // A row of blocks per iteration, so no two threads write the same node
+#pragma omp parallel num_threads(nThreads)
+    {
+        std::vector<float> values(width);
+
+#pragma omp for schedule(dynamic)
+        for (long by = 0; by < (long)base.height; by++) {
+            Node *nodes = &base.nodes[by * base.width];
+
+            const size_t yEnd = std::min(height, (by + 1) * BLOCK_SIZE);
+
+            for (size_t y = by * BLOCK_SIZE; y < yEnd; y++) {
+                row(y, values.data());
+
+                for (size_t x = 0; x < width; x++) {
+                    const float v = values[x];
+
+                    if (std::isfinite(v)) {
+                        Node &node = nodes[x / BLOCK_SIZE];
+
+                        node.min = std::min(node.min, v);
+                        node.max = std::max(node.max, v);
+                        node.sum += v;
+                        node.count++;
+                    }
+                }
+            }
+        }
+    }
+
+    _levels.push_back(std::move(base));
+
+    // ------------------------------------------------------------------------
+    // Reduction down to a single node
+    // ------------------------------------------------------------------------
+
+    while (_levels.back().width > 1 || _levels.back().height > 1) {
+        const Level &fine = _levels.back();
+
+        Level coarse;
+        coarse.blockSize = 2 * fine.blockSize;
+        coarse.width     = (fine.width + 1) / 2;
+        coarse.height    = (fine.height + 1) / 2;
+        coarse.nodes.assign(coarse.width * coarse.height, emptyNode);
+
+#pragma omp parallel for schedule(static) num_threads(nThreads)
+        for (long y = 0; y < (long)coarse.height; y++) {
+            for (size_t x = 0; x < coarse.width; x++) {
+                Node &node = coarse.nodes[y * coarse.width + x];
+
+                for (size_t j = 2 * y; j < std::min(fine.height, 2 * size_t(y) + 2); j++) {
+                    for (size_t i = 2 * x; i < std::min(fine.width, 2 * x + 2); i++) {
+                        const Node &child = fine.nodes[j * fine.width + i];
+
+                        node.min = std::min(node.min, child.min);
+                        node.max = std::max(node.max, child.max);
+                        node.sum += child.sum;
+                        node.count += child.count;
+                    }
+                }
+            }
+        }
+
+        _levels.push_back(std::move(coarse));
+    }
+}
+
+
+void StatisticsPyramid::clear()
+{
+    _width  = 0;
+    _height = 0;
+    _levels.clear();
+}
+
+
+StatisticsPyramid::Range StatisticsPyramid::query(size_t x0, size_t y0, size_t x1, size_t y1) const
+{
+    Range range = {0.f, 0.f, 0.f, 0};
+
+    x1 = std::min(x1, _width);
+    y1 = std::min(y1, _height);
+
+    if (_levels.empty() || x0 >= x1 || y0 >= y1) {
+        return range;
+    }
+
+    // Finest level where the rectangle spans at most QUERY_NODES blocks
+    const size_t extent = std::max(x1 - x0, y1 - y0);
+
+    size_t l = 0;
+
+    while (l + 1 < _levels.size() && extent > QUERY_NODES * _levels[l].blockSize) {
+        l++;
+    }
+
+    const Level &level = _levels[l];
+
+    const size_t nx0 = x0 / level.blockSize;
+    const size_t ny0 = y0 / level.blockSize;
+    const size_t nx1 = (x1 + level.blockSize - 1) / level.blockSize;
+    const size_t ny1 = (y1 + level.blockSize - 1) / level.blockSize;
+
+    float  vMin  = std::numeric_limits<float>::infinity();
+    float  vMax  = -std::numeric_limits<float>::infinity();
+    double sum   = 0.;
+    size_t count = 0;
+
+    for (size_t y = ny0; y < ny1; y++) {
+        for (size_t x = nx0; x < nx1; x++) {
+            const Node &node = level.nodes[y * level.width + x];
+
+            vMin = std::min(vMin, node.min);
+            vMax = std::max(vMax, node.max);
+            sum += node.sum;
+            count += node.count;
+        }
+    }
+
+    if (count > 0) {
+        range.min   = vMin;
+        range.max   = vMax;
+        range.mean  = float(sum / count);
+        range.count = count;
+    }
+
+    return range;
+}
@@ -0,0 +1,66 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <vector>
+
+
+// Min, max and mean of a scalar image over a pyramid of square blocks, for
+// range queries in logarithmic time. The first level holds blocks of
+// BLOCK_SIZE pixels, each next level halves the resolution.
+//
+// A query reads the level where the rectangle spans at most QUERY_NODES
+// blocks per side, partially covered blocks being accounted for entirely:
+// the answer covers the rectangle grown by less than a block of that level
+// on each side. Non finite values are ignored.
+class StatisticsPyramid
+{
+  public:
+    struct Range {
+        float  min;
+        float  max;
+        float  mean;
+        size_t count;   // Finite values accounted for
+    };
+
+    StatisticsPyramid();
+
+    // Fills the values of row y, called once per row from multiple threads
+    typedef std::function<void(size_t y, float *values)> RowFunction;
+
+    // When nThreads is 0, all the available cores are used
+    void build(size_t width, size_t height, const RowFunction &row, int nThreads = 0);
+
+    void clear();
+
+    bool empty() const { return _levels.empty(); }
+
+    size_t width() const { return _width; }
+    size_t height() const { return _height; }
+    size_t nLevels() const { return _levels.size(); }
+
+    // Statistics over [x0, x1) x [y0, y1), count is 0 when the rectangle
+    // holds no finite value
+    Range query(size_t x0, size_t y0, size_t x1, size_t y1) const;
+
+    static const size_t BLOCK_SIZE  = 4;
+    static const size_t QUERY_NODES = 16;
+
+  private:
+    struct Node {
+        float    min, max;
+        double   sum;
+        uint32_t count;
+    };
+
+    struct Level {
+        size_t            width, height;
+        size_t            blockSize;   // In pixels
+        std::vector<Node> nodes;
+    };
+
+    size_t _width, _height;
+
+    std::vector<Level> _levels;
+};
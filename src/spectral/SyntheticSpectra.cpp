@@ -0,0 +1,165 @@
+#include "SyntheticSpectra.h"
+
+#include <algorithm>
+#include <cmath>
+
+
+// Integer hash (lowbias32), uniform in [0, 1)
+static float hash(uint32_t a, uint32_t b = 0, uint32_t c = 0)
+{
+    uint32_t h = a * 0x9e3779b9u ^ (b + 0x7f4a7c15u) * 0x85ebca6bu ^ (c + 0x165667b1u) * 0xc2b2ae35u;
+
+    h ^= h >> 16;
+    h *= 0x7feb352du;
+    h ^= h >> 15;
+    h *= 0x846ca68bu;
+    h ^= h >> 16;
+
+    return float(h >> 8) / float(1u << 24);
+}
+
+
+SyntheticSpectra::SyntheticSpectra(
+    const std::vector<float> &wavelengths,
+    size_t                    width,
+    size_t                    height,
+    uint32_t                  seed,
+    bool                      isReflective)
+    : _wavelengths(wavelengths)
+    , _width(std::max(size_t(1), width))
+    , _height(std::max(size_t(1), height))
+    , _seed(seed)
+    , _isReflective(isReflective)
+{
+    const size_t nBands = _wavelengths.size();
+
+    _patchSpectra.resize(PATCHES * PATCHES * nBands);
+
+    for (uint32_t p = 0; p < PATCHES * PATCHES; p++) {
+        // 1 to 3 lobes over the visible range
+        const uint32_t nLobes = 1 + uint32_t(3.f * hash(_seed, p, 0));
+
+        float *spectrum = &_patchSpectra[nBands * p];
+
+        for (uint32_t l = 0; l < nLobes; l++) {
+            const float center    = 380.f + 400.f * hash(_seed, p, 3 * l + 1);
+            const float sigma     = 10.f + 90.f * hash(_seed, p, 3 * l + 2);
+            const float amplitude = 0.2f + 0.8f * hash(_seed, p, 3 * l + 3);
+
+            for (size_t b = 0; b < nBands; b++) {
+                const float d = (_wavelengths[b] - center) / sigma;
+                spectrum[b] += amplitude * std::exp(-0.5f * d * d);
+            }
+        }
+
+        // Some flat contribution, so no patch is black
+        for (size_t b = 0; b < nBands; b++) {
+            spectrum[b] += 0.05f;
+        }
+    }
+}
+
+
+float SyntheticSpectra::value(size_t x, size_t y, size_t band) const
+{
+    const size_t nBands = _wavelengths.size();
+
+    const size_t px = std::min(PATCHES - 1, x * PATCHES / _width);
+    const size_t py = std::min(PATCHES - 1, y * PATCHES / _height);
+
+    const float u = (x + 0.5f) / _width;
+    const float v = (y + 0.5f) / _height;
+
+    const float gradient = 0.25f + 0.75f * u * (1.f - 0.5f * v);
+    const float noise    = 0.98f + 0.04f * hash(_seed ^ 0x5bd1e995u, uint32_t(y * _width + x), uint32_t(band));
+
+    const float s = _patchSpectra[nBands * (py * PATCHES + px) + band] * gradient * noise;
+
+    return _isReflective ? std::min(s, 1.f) : s;
+}
+
+
+void SyntheticSpectra::row(size_t y, float *spectra) const
+{
+    const size_t nBands = _wavelengths.size();
+
+    for (size_t x = 0; x < _width; x++) {
+        for (size_t b = 0; b < nBands; b++) {
+            spectra[nBands * x + b] = value(x, y, b);
+        }
+    }
+}
+
+
+void SyntheticSpectra::polarisedRow(size_t y, float *stokes) const
+{
+    const size_t nBands = _wavelengths.size();
+
+    const float angle = 3.14159265f * (y + 0.5f) / _height;
+
+    for (size_t x = 0; x < _width; x++) {
+        const float degree = (x + 0.5f) / _width;
+
+        float *s = &stokes[4 * nBands * x];
+
+        for (size_t b = 0; b < nBands; b++) {
+            const float s0 = value(x, y, b);
+
+            s[b]              = s0;
+            s[nBands + b]     = s0 * degree * std::cos(2.f * angle);
+            s[2 * nBands + b] = s0 * degree * std::sin(2.f * angle);
+            s[3 * nBands + b] = s0 * degree * 0.1f;
+        }
+    }
+}
+
+
+std::vector<float> SyntheticSpectra::uniformWavelengths(float first, float last, size_t nBands)
+{
+    std::vector<float> wavelengths(nBands);
+
+    for (size_t b = 0; b < nBands; b++) {
+        wavelengths[b] = nBands > 1 ? first + (last - first) * b / (nBands - 1) : (first + last) / 2.f;
+    }
+
+    return wavelengths;
+}
+
+
+std::vector<float> SyntheticSpectra::boundsWidths(const std::vector<float> &wavelengths)
+{
+    const std::vector<double> b = bounds(wavelengths);
+
+    std::vector<float> widths(wavelengths.size());
+
+    for (size_t i = 0; i < widths.size(); i++) {
+        widths[i] = float(b[i + 1] - b[i]);
+    }
+
+    return widths;
+}
+
+
+std::vector<double> SyntheticSpectra::bounds(const std::vector<float> &wavelengths)
+{
+    const size_t n = wavelengths.size();
+
+    std::vector<double> b(n + 1);
+
+    if (n == 0) {
+        return b;
+    } else if (n == 1) {
+        b[0] = wavelengths[0] - 5.;
+        b[1] = wavelengths[0] + 5.;
+        return b;
+    }
+
+    for (size_t i = 1; i < n; i++) {
+        b[i] = 0.5 * (wavelengths[i - 1] + wavelengths[i]);
+    }
+
+    b[0] = wavelengths[0] - (b[1] - wavelengths[0]);
+    b[n] = wavelengths[n - 1] + (wavelengths[n - 1] - b[n - 1]);
+
+    return b;
+}
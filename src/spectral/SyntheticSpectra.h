@@ -0,0 +1,56 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+
+// Procedural spectral content for tests and benchmarks. Every value is a
+// pure function of the seed, the pixel coordinates and the wavelength, so
+// images are identical whatever the order they are generated in, and any
+// size can be produced scanline by scanline.
+//
+// The image is split in patches, each with its own spectrum (a sum of
+// Gaussian lobes), modulated by a smooth gradient and a small per sample
+// noise.
+class SyntheticSpectra
+{
+  public:
+    SyntheticSpectra(
+        const std::vector<float> &wavelengths,
+        size_t                    width,
+        size_t                    height,
+        uint32_t                  seed         = 0,
+        bool                      isReflective = false);
+
+    // Spectra of row y, band first: spectra[nBands * x + band]
+    void row(size_t y, float *spectra) const;
+
+    // Stokes vectors of row y, per pixel then per component:
+    // stokes[(4 * x + s) * nBands + band], the first component being the
+    // spectra of row(). The polarisation degree increases from left to right
+    // and the angle from top to bottom.
+    void polarisedRow(size_t y, float *stokes) const;
+
+    // Band centers evenly spaced over [first, last]
+    static std::vector<float> uniformWavelengths(float first, float last, size_t nBands);
+
+    // Band widths, half way to the neighbouring bands
+    static std::vector<float> boundsWidths(const std::vector<float> &wavelengths);
+
+    // Band bounds, nBands + 1 values half way between the centers
+    static std::vector<double> bounds(const std::vector<float> &wavelengths);
+
+    static const size_t PATCHES = 8;
+
+  private:
+    float value(size_t x, size_t y, size_t band) const;
+
+    std::vector<float> _wavelengths;
+    size_t             _width, _height;
+    uint32_t           _seed;
+    bool               _isReflective;
+
+    // Per patch spectra, patch major
+    std::vector<float> _patchSpectra;
+};
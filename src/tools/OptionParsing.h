@@ -0,0 +1,61 @@
+#pragma once
+
+#include <cctype>
+#include <cmath>
+#include <limits>
+#include <stdexcept>
+#include <string>
+
+
+// Numeric values of the command line options of the tools. The whole value
+// must be consumed: signs, spaces and trailing characters std::stoul or
+// std::stof would accept are rejected, the error naming the option.
+
+// Integer in [minValue, maxValue]
+inline unsigned int parseCount(
+    const std::string &arg,
+    const std::string &value,
+    unsigned int       minValue,
+    unsigned int       maxValue = std::numeric_limits<unsigned int>::max())
+{
+    unsigned long long count = 0;
+    size_t             end   = 0;
+
+    if (!value.empty() && std::isdigit((unsigned char)value[0])) {
+        try {
+            count = std::stoull(value, &end);
+        } catch (const std::out_of_range &) {
+            end = 0;
+        }
+    }
+
+    if (end == 0 || end != value.size() || count < minValue || count > maxValue) {
+        throw std::runtime_error(
+            "Invalid value for " + arg + ", expected an integer in ["
+            + std::to_string(minValue) + ", " + std::to_string(maxValue) + "]");
+    }
+
+    return (unsigned int)count;
+}
+
+
+// Finite number
+inline float parseFloat(const std::string &arg, const std::string &value)
+{
+    float  number = 0.f;
+    size_t end    = 0;
+
+    if (!value.empty() && !std::isspace((unsigned char)value[0])) {
+        try {
+            number = std::stof(value, &end);
+        } catch (const std::exception &) {
+            end = 0;
+        }
+    }
+
+    if (end == 0 || end != value.size() || !std::isfinite(number)) {
+        throw std::runtime_error("Invalid value for " + arg + ", expected a number");
+    }
+
+    return number;
+}
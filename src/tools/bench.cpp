@@ -0,0 +1,509 @@
+// Timings of the loading, conversion and display stages:
+//
+//   tiresias_bench [options] [input]...
+//
+// Synthetic images (see SyntheticSpectra) of the requested size and band
+// count are always measured, the inputs (spectral EXR, ArtRaw, PNG) are measured as well.
+// Results are written as JSON, one object per measured stage, so runs of
+// different versions can be compared by scripts.
+
+#include "OptionParsing.h"
+#include "Trace.h"
+
+#include <image_format/SpectralImageFile.h>
+#include <image_format/artraw.h>
+#include <spectral/SpectralConverter.h>
+#include <spectral/SyntheticSpectra.h>
+
+#ifdef TIRESIAS_HEADLESS
+#    include "HeadlessContext.h"
+#    include "HeadlessRenderer.h"
+#    include <image_viewer/ImageViewerSpectralEXR.h>
+#endif
+
+#include <EXRSpectralImage.h>
+#include <lodepng.h>
+
+#include <algorithm>
+#include <cctype>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <exception>
+#include <fstream>
+#include <functional>
+#include <iostream>
+#include <limits>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+
+struct Options {
+    std::vector<std::string> inputs;
+
+    unsigned int width   = 2048;
+    unsigned int height  = 2048;
+    unsigned int nBands  = 32;
+    int          threads = 0;
+    unsigned int repeat  = 5;
+
+    unsigned int displayWidth  = 1920;
+    unsigned int displayHeight = 1080;
+
+    bool        gpu     = true;
+    std::string workDir = ".";
+    std::string output;
+};
+
+
+struct Result {
+    std::string stage;
+    std::string dataset;
+
+    size_t width, height, nBands;
+
+    std::vector<double> ms;
+};
+
+
+static void usage(const char *program)
+{
+    std::cerr
+        << "Usage: " << program << " [options] [input.exr|input.artraw|input.png]..." << std::endl
+        << std::endl
+        << "Options:" << std::endl
+        << "  -s, --size WxH          Synthetic image size (2048x2048)" << std::endl
+        << "  -b, --bands N           Synthetic image band count (32)" << std::endl
+        << "  -t, --threads N         CPU conversion threads (all cores)" << std::endl
+        << "  -r, --repeat N          Runs per stage (5)" << std::endl
+        << "      --display WxH       Display pass output size (1920x1080)" << std::endl
+        << "      --no-gpu            Skip the OpenGL stages" << std::endl
+        << "      --work-dir DIR      Where the synthetic files are written (.)" << std::endl
+        << "  -o, --output FILE       JSON results, standard output by default" << std::endl
+        << "      --trace FILE        Write a Chrome trace of the runs" << std::endl;
+}
+
+
+// Best, median and mean of the runs, the first one is kept: cold caches are
+// part of what is measured
+static void writeJSON(std::ostream &os, const Options &options, const std::string &renderer, const std::vector<Result> &results)
+{
+    os << "{\n"
+       << "  \"threads\": " << (options.threads > 0 ? options.threads : SpectralConverter::maxThreads()) << ",\n"
+       << "  \"repeat\": " << options.repeat << ",\n"
+       << "  \"renderer\": \"" << renderer << "\",\n"
+       << "  \"results\": [";
+
+    for (size_t i = 0; i < results.size(); i++) {
+        const Result &r = results[i];
+
+        std::vector<double> sorted = r.ms;
+        std::sort(sorted.begin(), sorted.end());
+
+        double sum = 0.;
+
+        for (double v : sorted) {
+            sum += v;
+        }
+
+        const double median = sorted[sorted.size() / 2];
+        const double mpix   = double(r.width) * r.height * 1e-6;
+
+        os << (i > 0 ? ",\n" : "\n")
+           << "    {\"stage\": \"" << r.stage << "\""
+           << ", \"dataset\": \"" << r.dataset << "\""
+           << ", \"width\": " << r.width
+           << ", \"height\": " << r.height
+           << ", \"bands\": " << r.nBands
+           << ", \"ms_min\": " << sorted.front()
+           << ", \"ms_median\": " << median
+           << ", \"ms_mean\": " << sum / sorted.size()
+           << ", \"mpix_per_s\": " << (median > 0. ? mpix / (median * 1e-3) : 0.)
+           << "}";
+    }
+
+    os << "\n  ]\n}\n";
+}
+
+
+static std::vector<double> measure(unsigned int repeat, const std::function<void()> &run)
+{
+    std::vector<double> ms;
+
+    for (unsigned int i = 0; i < repeat; i++) {
+        const auto start = std::chrono::steady_clock::now();
+        run();
+        ms.push_back(std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count());
+    }
+
+    return ms;
+}
+
+
+static std::string extension(const std::string &path)
+{
+    std::string ext = path.substr(path.find_last_of('.') + 1);
+    std::transform(ext.begin(), ext.end(), ext.begin(), ::tolower);
+
+    return ext;
+}
+
+
+static std::string baseName(const std::string &path)
+{
+    return path.substr(path.find_last_of("/\\") + 1);
+}
+
+
+static bool parseSize(const std::string &str, unsigned int &width, unsigned int &height)
+{
+    return std::sscanf(str.c_str(), "%ux%u", &width, &height) == 2 && width > 0 && height > 0;
+}
+
+
+static bool parseOptions(int argc, char *argv[], Options &options, std::string &tracePath)
+{
+    for (int i = 1; i < argc; i++) {
+        const std::string arg = argv[i];
+
+        auto value = [&]() -> std::string {
+            if (i + 1 >= argc) {
+                throw std::runtime_error("Missing value for " + arg);
+            }
+
+            return argv[++i];
+        };
+
+        if (arg == "-h" || arg == "--help") {
+            return false;
+        } else if (arg == "-s" || arg == "--size") {
+            if (!parseSize(value(), options.width, options.height)) {
+                throw std::runtime_error("Invalid size, expected WxH");
+            }
+        } else if (arg == "-b" || arg == "--bands") {
+            options.nBands = parseCount(arg, value(), 1);
+        } else if (arg == "-t" || arg == "--threads") {
+            options.threads = (int)parseCount(arg, value(), 0, std::numeric_limits<int>::max());
+        } else if (arg == "-r" || arg == "--repeat") {
+            options.repeat = parseCount(arg, value(), 1);
+        } else if (arg == "--display") {
+            if (!parseSize(value(), options.displayWidth, options.displayHeight)) {
+                throw std::runtime_error("Invalid display size, expected WxH");
+            }
+        } else if (arg == "--no-gpu") {
+            options.gpu = false;
+        } else if (arg == "--work-dir") {
+            options.workDir = value();
+        } else if (arg == "-o" || arg == "--output") {
+            options.output = value();
+        } else if (arg == "--trace") {
+            tracePath = value();
+        } else if (!arg.empty() && arg[0] == '-') {
+            throw std::runtime_error("Unknown option " + arg);
+        } else {
+            options.inputs.push_back(arg);
+        }
+    }
+
+    return true;
+}
+
+
+// ----------------------------------------------------------------------------
+// Synthetic data
+// ----------------------------------------------------------------------------
+
+static std::string writeSyntheticEXR(const Options &options)
+{
+    const std::vector<float> wavelengths = SyntheticSpectra::uniformWavelengths(380.f, 780.f, options.nBands);
+    const SyntheticSpectra   spectra(wavelengths, options.width, options.height);
+
+    SEXR::EXRSpectralImage image(options.width, options.height, wavelengths, SEXR::EMISSIVE);
+
+    std::vector<float> row(options.nBands * options.width);
+
+    for (size_t y = 0; y < options.height; y++) {
+        spectra.row(y, row.data());
+
+        for (size_t x = 0; x < options.width; x++) {
+            for (size_t b = 0; b < options.nBands; b++) {
+                image.emissive(x, y, b, 0) = row[options.nBands * x + b];
+            }
+        }
+    }
+
+    const std::string path = options.workDir + "/tiresias_bench_synthetic.exr";
+    image.save(path);
+
+    return path;
+}
+
+
+static std::string writeSyntheticArtRaw(const Options &options)
+{
+    const std::vector<float> wavelengths = SyntheticSpectra::uniformWavelengths(380.f, 780.f, options.nBands);
+    const SyntheticSpectra   spectra(wavelengths, options.width, options.height);
+
+    const std::string path = options.workDir + "/tiresias_bench_synthetic.artraw";
+
+    ArtRawWriter writer(path, options.width, options.height, SyntheticSpectra::bounds(wavelengths));
+
+    std::vector<float> row(options.nBands * options.width);
+
+    for (size_t y = 0; y < options.height; y++) {
+        spectra.row(y, row.data());
+        writer.writeRow(row.data());
+    }
+
+    writer.close();
+
+    return path;
+}
+
+
+static std::string writeSyntheticPNG(const Options &options)
+{
+    std::vector<unsigned char> rgba(4 * size_t(options.width) * options.height);
+
+    for (size_t i = 0; i < rgba.size(); i++) {
+        // Some structure, so the compression is not trivial
+        rgba[i] = (unsigned char)((i * 2654435761u) >> 24);
+    }
+
+    const std::string path = options.workDir + "/tiresias_bench_synthetic.png";
+
+    if (lodepng::encode(path, rgba, options.width, options.height)) {
+        throw std::runtime_error("Could not write " + path);
+    }
+
+    return path;
+}
+
+
+// ----------------------------------------------------------------------------
+// Stages
+// ----------------------------------------------------------------------------
+
+static void benchPNG(const Options &options, const std::string &path, std::vector<Result> &results)
+{
+    std::vector<unsigned char> rgba;
+    unsigned int               width = 0, height = 0;
+
+    Result r;
+    r.stage   = "png_decode";
+    r.dataset = baseName(path);
+    r.ms      = measure(options.repeat, [&]() {
+        TRACE_SCOPE("PNG decode", "bench");
+
+        if (lodepng::decode(rgba, width, height, path)) {
+            throw std::runtime_error("Could not decode " + path);
+        }
+    });
+    r.width  = width;
+    r.height = height;
+    r.nBands = 4;
+
+    results.push_back(r);
+}
+
+
+static void benchSpectral(const Options &options, const std::string &path, std::vector<Result> &results)
+{
+    const std::string dataset = baseName(path);
+
+    // Load
+    std::unique_ptr<SpectralImageFile> image;
+
+    Result load;
+    load.stage   = extension(path) == "exr" ? "exr_load" : "artraw_decode";
+    load.dataset = dataset;
+    load.ms      = measure(options.repeat, [&]() {
+        TRACE_SCOPE("Load", "bench");
+
+        image.reset();
+        image.reset(new SpectralImageFile(path));
+    });
+
+    const size_t width  = image->width();
+    const size_t height = image->height();
+    const size_t nBands = image->nSpectralBands();
+
+    load.width  = width;
+    load.height = height;
+    load.nBands = nBands;
+    results.push_back(load);
+
+    // CPU reference conversion
+    SpectralConverter converter;
+    converter.setBands(image->wavelengths(), image->boundsWidths(), image->isReflective());
+
+    std::vector<float> rgba(4 * width * height);
+
+    Result cpu = load;
+    cpu.stage  = "convert_cpu";
+    cpu.ms     = measure(options.repeat, [&]() {
+        TRACE_SCOPE("CPU conversion", "bench");
+
+        converter.convert(image->data(), width, height, rgba.data(), options.threads);
+    });
+
+    results.push_back(cpu);
+
+#ifdef TIRESIAS_HEADLESS
+    if (!options.gpu || extension(path) != "exr") {
+        return;
+    }
+
+    // Same texture format and layout as ImageViewerSpectral
+    GLuint texture;
+    glGenTextures(1, &texture);
+    glBindTexture(GL_TEXTURE_3D, texture);
+
+    Result upload = load;
+    upload.stage  = "texture_upload";
+    upload.ms     = measure(options.repeat, [&]() {
+        TRACE_SCOPE("Texture upload", "bench");
+
+        glTexImage3D(GL_TEXTURE_3D, 0, GL_R32F, nBands, width, height, 0, GL_RED, GL_FLOAT, image->data());
+        glFinish();
+    });
+
+    glBindTexture(GL_TEXTURE_3D, 0);
+    glDeleteTextures(1, &texture);
+
+    results.push_back(upload);
+
+    image.reset();
+
+    // The viewer converts a full image in a single render() when the
+    // window matches the image and the conversion is not progressive
+    ImageViewerSpectralEXR viewer(path);
+    viewer.initGL();
+    viewer.resizeWindow(width, height);
+    viewer.setResolutionMode(ImageViewerSpectral::RESOLUTION_IMAGE);
+    viewer.setProgressive(false);
+
+    const bool hasCompute = viewer.computeShaderAvailable();
+
+    for (int compute = hasCompute ? 1 : 0; compute >= 0; compute--) {
+        viewer.setComputeShader(compute);
+
+        Result gpu = load;
+        gpu.stage  = compute ? "convert_gpu_compute" : "convert_gpu_fragment";
+        gpu.ms     = measure(options.repeat, [&]() {
+            TRACE_SCOPE("GPU conversion", "bench");
+
+            viewer.reconvert();
+
+            do {
+                viewer.render();
+            } while (viewer.isConverting());
+
+            glFinish();
+        });
+
+        results.push_back(gpu);
+    }
+
+    // Display pass at the requested output size
+    HeadlessRenderer renderer(options.displayWidth, options.displayHeight);
+    renderer.render(viewer);
+
+    Result display = load;
+    display.stage  = "display";
+    display.width  = options.displayWidth;
+    display.height = options.displayHeight;
+    display.ms     = measure(options.repeat, [&]() {
+        TRACE_SCOPE("Display pass", "bench");
+
+        renderer.render(viewer);
+        glFinish();
+    });
+
+    results.push_back(display);
+#endif
+}
+
+
+int main(int argc, char *argv[])
+{
+    Options     options;
+    std::string tracePath;
+
+    try {
+        if (!parseOptions(argc, argv, options, tracePath)) {
+            usage(argv[0]);
+            return 1;
+        }
+    } catch (const std::exception &e) {
+        std::cerr << e.what() << std::endl;
+        usage(argv[0]);
+        return 1;
+    }
+
+    if (!tracePath.empty()) {
+        Trace::start(tracePath);
+    }
+
+    std::vector<Result> results;
+    std::string         renderer = "none";
+
+    try {
+#ifdef TIRESIAS_HEADLESS
+        std::unique_ptr<HeadlessContext> context;
+
+        if (options.gpu) {
+            context.reset(new HeadlessContext());
+            renderer = context->renderer();
+        }
+#else
+        options.gpu = false;
+#endif
+
+        const std::string syntheticEXR    = writeSyntheticEXR(options);
+        const std::string syntheticArtRaw = writeSyntheticArtRaw(options);
+        const std::string syntheticPNG    = writeSyntheticPNG(options);
+
+        benchSpectral(options, syntheticEXR, results);
+        benchSpectral(options, syntheticArtRaw, results);
+        benchPNG(options, syntheticPNG, results);
+
+        std::remove(syntheticEXR.c_str());
+        std::remove(syntheticArtRaw.c_str());
+        std::remove(syntheticPNG.c_str());
+
+        for (const std::string &input : options.inputs) {
+            if (extension(input) == "png") {
+                benchPNG(options, input, results);
+            } else {
+                benchSpectral(options, input, results);
+            }
+        }
+    } catch (const std::exception &e) {
+        std::cerr << e.what() << std::endl;
+        return 1;
+    }
+
+    if (options.output.empty()) {
+        writeJSON(std::cout, options, renderer, results);
+    } else {
+        std::ofstream file(options.output);
+
+        if (!file) {
+            std::cerr << "Could not open \"" << options.output << "\" for writing" << std::endl;
+            return 1;
+        }
+
+        writeJSON(file, options, renderer, results);
+    }
+
+    try {
+        Trace::stop();
+    } catch (const std::exception &e) {
+        std::cerr << e.what() << std::endl;
+    }
+
+    return 0;
+}
@@ -0,0 +1,495 @@
+// Batch conversion of spectral images to RGB, without any window:
+//
+//   tiresias_convert [options] <input>...
+//
+// Each file goes through three stages running on their own threads: read
+// (I/O bound), convert (SpectralConverter, CPU bound) and encode & write
+// (I/O bound). Stages are connected by bounded queues so at most
+// readers + 2 * queue + jobs + writers images are held in memory.
+
+#include "BoundedQueue.h"
+#include "OptionParsing.h"
+#include "Trace.h"
+
+#include <image_format/RGBImageWriter.h>
+#include <image_format/SpectralImageFile.h>
+#include <spectral/BandStatistics.h>
+#include <spectral/Colorimetry.h>
+#include <spectral/SpectralConverter.h>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <exception>
+#include <filesystem>
+#include <iostream>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+
+
+struct Options {
+    std::vector<std::string> inputs;
+
+    std::string outputDir;
+    std::string format = "png";
+
+    // Display transformation, as in the viewer
+    float exposure  = 0.f;
+    bool  sRGBGamma = true;
+    float gamma     = 2.2f;
+
+    std::string observer   = "CIE 1931 2 deg.";
+    std::string illuminant = "D65";
+
+    unsigned int jobs    = 0;
+    unsigned int readers = 2;
+    unsigned int writers = 2;
+    unsigned int queue   = 0;
+    bool         quiet   = false;
+    bool         stats   = false;
+};
+
+
+struct Job {
+    std::string input;
+    std::string output;
+
+    std::unique_ptr<SpectralImageFile> image;
+    BandStatistics                     statistics;
+
+    size_t             width, height;
+    std::vector<float> rgba;
+};
+
+
+static void usage(const char *program)
+{
+    std::cerr
+        << "Usage: " << program << " [options] <input.exr|input.artraw>..." << std::endl
+        << std::endl
+        << "Options:" << std::endl
+        << "  -o, --output-dir DIR    Output directory, next to the inputs by default" << std::endl
+        << "  -f, --format png|exr    Display referred PNG or linear RGB EXR (png)" << std::endl
+        << "  -e, --exposure EV       Exposure compensation (0)" << std::endl
+        << "  -g, --gamma G           Power law instead of the sRGB transfer function" << std::endl
+        << "      --observer NAME     Built-in observer or CMF file (CIE 1931 2 deg.)" << std::endl
+        << "      --illuminant NAME   Built-in illuminant or SPD file, for reflective images (D65)" << std::endl
+        << "  -j, --jobs N            Conversion threads (all cores)" << std::endl
+        << "      --readers N         Reading threads (2)" << std::endl
+        << "      --writers N         Encoding & writing threads (2)" << std::endl
+        << "      --queue N           Images waiting between two stages (jobs)" << std::endl
+        << "      --trace FILE        Write a Chrome trace of the stages" << std::endl
+        << "      --stats             Report per band statistics and non finite values" << std::endl
+        << "  -q, --quiet             Only report errors" << std::endl;
+}
+
+
+static void printStatistics(const std::string &input, const SpectralImageFile &image, const BandStatistics &statistics)
+{
+    std::cout << input << ": " << statistics.nNaN() << " NaN, " << statistics.nInf() << " Inf" << std::endl;
+
+    char line[256];
+
+    std::snprintf(
+        line,
+        sizeof(line),
+        "  %8s %12s %12s %12s %12s %12s %12s %10s %10s  %s",
+        "band",
+        "min",
+        "max",
+        "mean",
+        "p1",
+        "p50",
+        "p99",
+        "NaN",
+        "Inf",
+        "first non finite");
+
+    std::cout << line << std::endl;
+
+    for (size_t b = 0; b < statistics.nBands(); b++) {
+        const BandStatistics::Band &band = statistics.band(b);
+
+        std::snprintf(
+            line,
+            sizeof(line),
+            "  %6.1fnm %12g %12g %12g %12g %12g %12g %10llu %10llu",
+            image.wavelengths()[b],
+            band.min,
+            band.max,
+            band.mean,
+            statistics.percentile(b, 0.01f),
+            statistics.percentile(b, 0.5f),
+            statistics.percentile(b, 0.99f),
+            (unsigned long long)band.nNaN,
+            (unsigned long long)band.nInf);
+
+        std::cout << line;
+
+        if (band.nNaN + band.nInf > 0) {
+            std::cout << "  (" << band.firstNonFinite % image.width() << ", " << band.firstNonFinite / image.width() << ")";
+        }
+
+        std::cout << std::endl;
+    }
+}
+
+
+static std::string outputPath(const Options &options, const std::string &input)
+{
+    const size_t slash     = input.find_last_of("/\\");
+    const size_t nameStart = (slash == std::string::npos) ? 0 : slash + 1;
+
+    const std::string name = input.substr(nameStart);
+    const std::string stem = name.substr(0, name.find_last_of('.'));
+    const std::string out  = options.outputDir.empty() ? input.substr(0, nameStart) : options.outputDir + "/";
+
+    // Do not overwrite an EXR input with its own RGB conversion
+    const std::string ext  = "." + options.format;
+    const std::string path = out + stem + ext;
+
+    return (path == input) ? out + stem + "_rgb" + ext : path;
+}
+
+
+static Colorimetry::Observer findObserver(const std::string &name)
+{
+    for (const Colorimetry::Observer &o : Colorimetry::builtinObservers()) {
+        if (o.name == name) {
+            return o;
+        }
+    }
+
+    return Colorimetry::loadObserver(name);
+}
+
+
+static Colorimetry::Illuminant findIlluminant(const std::string &name)
+{
+    for (const Colorimetry::Illuminant &i : Colorimetry::builtinIlluminants()) {
+        if (i.name == name) {
+            return i;
+        }
+    }
+
+    return Colorimetry::loadIlluminant(name);
+}
+
+
+static unsigned char toDisplay(float value, const Options &options)
+{
+    // Same transfer functions as the display pass (fragment.frag)
+    float c = std::max(0.f, value);
+
+    if (options.sRGBGamma) {
+        c = (c < 0.0031308f) ? 12.92f * c : 1.055f * std::pow(c, 1.f / 2.4f) - 0.055f;
+    } else {
+        c = std::pow(c, 1.f / options.gamma);
+    }
+
+    return (unsigned char)std::round(255.f * std::min(1.f, c));
+}
+
+
+static bool parseOptions(int argc, char *argv[], Options &options, std::string &tracePath)
+{
+    for (int i = 1; i < argc; i++) {
+        const std::string arg = argv[i];
+
+        auto value = [&]() -> std::string {
+            if (i + 1 >= argc) {
+                throw std::runtime_error("Missing value for " + arg);
+            }
+
+            return argv[++i];
+        };
+
+        if (arg == "-h" || arg == "--help") {
+            return false;
+        } else if (arg == "-o" || arg == "--output-dir") {
+            options.outputDir = value();
+        } else if (arg == "-f" || arg == "--format") {
+            options.format = value();
+
+            if (options.format != "png" && options.format != "exr") {
+                throw std::runtime_error("Unsupported output format " + options.format);
+            }
+        } else if (arg == "-e" || arg == "--exposure") {
+            options.exposure = parseFloat(arg, value());
+        } else if (arg == "-g" || arg == "--gamma") {
+            options.gamma     = parseFloat(arg, value());
+            options.sRGBGamma = false;
+
+            if (!(options.gamma > 0.f)) {
+                throw std::runtime_error("Gamma must be positive");
+            }
+        } else if (arg == "--observer") {
+            options.observer = value();
+        } else if (arg == "--illuminant") {
+            options.illuminant = value();
+        } else if (arg == "-j" || arg == "--jobs") {
+            options.jobs = parseCount(arg, value(), 0);
+        } else if (arg == "--readers") {
+            options.readers = parseCount(arg, value(), 1);
+        } else if (arg == "--writers") {
+            options.writers = parseCount(arg, value(), 1);
+        } else if (arg == "--queue") {
+            options.queue = parseCount(arg, value(), 0);
+        } else if (arg == "--trace") {
+            tracePath = value();
+        } else if (arg == "--stats") {
+            options.stats = true;
+        } else if (arg == "-q" || arg == "--quiet") {
+            options.quiet = true;
+        } else if (!arg.empty() && arg[0] == '-') {
+            throw std::runtime_error("Unknown option " + arg);
+        } else {
+            options.inputs.push_back(arg);
+        }
+    }
+
+    return !options.inputs.empty();
+}
+
+
+int main(int argc, char *argv[])
+{
+    Options     options;
+    std::string tracePath;
+
+    try {
+        if (!parseOptions(argc, argv, options, tracePath)) {
+            usage(argv[0]);
+            return 1;
+        }
+    } catch (const std::exception &e) {
+        std::cerr << e.what() << std::endl;
+        usage(argv[0]);
+        return 1;
+    }
+
+    // Inputs sharing a stem, in the same directory or with --output-dir,
+    // would be written to the same file, possibly concurrently
+    std::vector<std::string>      outputs(options.inputs.size());
+    std::map<std::string, size_t> outputInputs;
+    bool                          hasCollisions = false;
+
+    for (size_t i = 0; i < options.inputs.size(); i++) {
+        outputs[i] = outputPath(options, options.inputs[i]);
+
+        const std::string key = std::filesystem::path(outputs[i]).lexically_normal().generic_string();
+        const auto        it  = outputInputs.emplace(key, i);
+
+        if (!it.second) {
+            std::cerr << "[ERROR] " << options.inputs[i] << ": same output as "
+                      << options.inputs[it.first->second] << " (" << outputs[i] << ")" << std::endl;
+            hasCollisions = true;
+        }
+    }
+
+    if (hasCollisions) {
+        return 1;
+    }
+
+    if (!tracePath.empty()) {
+        Trace::start(tracePath);
+    }
+
+    Colorimetry::Observer   observer;
+    Colorimetry::Illuminant illuminant;
+
+    try {
+        observer   = findObserver(options.observer);
+        illuminant = findIlluminant(options.illuminant);
+    } catch (const std::exception &e) {
+        std::cerr << e.what() << std::endl;
+        return 1;
+    }
+
+    // Many files: one file per conversion thread. Few files: the cores left
+    // are used within each conversion.
+    const unsigned int nCores = std::max(1u, std::thread::hardware_concurrency());
+    const size_t       nFiles = options.inputs.size();
+
+    if (options.jobs == 0) {
+        options.jobs = (unsigned int)std::min<size_t>(nCores, nFiles);
+    }
+
+    if (options.queue == 0) {
+        options.queue = options.jobs;
+    }
+
+    const int convertThreads = (int)std::max(1u, nCores / options.jobs);
+
+    BoundedQueue<std::unique_ptr<Job>> loaded(options.queue);
+    BoundedQueue<std::unique_ptr<Job>> converted(options.queue);
+
+    std::atomic<size_t> nextInput(0);
+    std::atomic<size_t> nFailed(0);
+    std::atomic<size_t> bytesRead(0);
+    std::atomic<int>    activeReaders(options.readers);
+    std::atomic<int>    activeConverters(options.jobs);
+
+    std::mutex logMutex;
+
+    auto fail = [&](const std::string &input, const std::exception &e) {
+        std::lock_guard<std::mutex> lock(logMutex);
+        std::cerr << "[ERROR] " << input << ": " << e.what() << std::endl;
+        nFailed++;
+    };
+
+    // ------------------------------------------------------------------------
+    // Stages
+    // ------------------------------------------------------------------------
+
+    auto read = [&]() {
+        for (size_t i = nextInput++; i < nFiles; i = nextInput++) {
+            std::unique_ptr<Job> job(new Job);
+            job->input  = options.inputs[i];
+            job->output = outputs[i];
+
+            try {
+                TRACE_SCOPE("Read", "io");
+
+                job->image.reset(new SpectralImageFile(job->input, options.stats ? &job->statistics : nullptr));
+                bytesRead += job->image->dataBytes();
+            } catch (const std::exception &e) {
+                fail(job->input, e);
+                continue;
+            }
+
+            if (options.stats) {
+                std::lock_guard<std::mutex> lock(logMutex);
+                printStatistics(job->input, *job->image, job->statistics);
+            }
+
+            loaded.push(job);
+        }
+
+        if (--activeReaders == 0) {
+            loaded.close();
+        }
+    };
+
+    auto convert = [&]() {
+        std::unique_ptr<Job> job;
+
+        while (loaded.pop(job)) {
+            try {
+                TRACE_SCOPE("Convert", "convert");
+
+                const SpectralImageFile &image = *job->image;
+
+                SpectralConverter converter;
+                converter.setCMF(observer.firstWavelength, observer.xyz);
+                converter.setIlluminant(illuminant.firstWavelength, illuminant.spd);
+                converter.setBands(image.wavelengths(), image.boundsWidths(), image.isReflective());
+
+                job->width  = image.width();
+                job->height = image.height();
+                job->rgba.resize(4 * job->width * job->height);
+
+                converter.convert(image.data(), job->width, job->height, job->rgba.data(), convertThreads);
+            } catch (const std::exception &e) {
+                fail(job->input, e);
+                continue;
+            }
+
+            // The cube is no longer needed
+            job->image.reset();
+
+            converted.push(job);
+        }
+
+        if (--activeConverters == 0) {
+            converted.close();
+        }
+    };
+
+    auto write = [&]() {
+        std::unique_ptr<Job> job;
+
+        while (converted.pop(job)) {
+            try {
+                const float  scale   = std::pow(2.f, options.exposure);
+                const size_t nPixels = job->width * job->height;
+
+                if (options.format == "exr") {
+                    for (float &v : job->rgba) {
+                        v *= scale;
+                    }
+
+                    RGBImageWriter::writeEXR(job->output, job->width, job->height, job->rgba.data());
+                } else {
+                    std::vector<unsigned char> display(4 * nPixels);
+
+                    for (size_t px = 0; px < nPixels; px++) {
+                        for (size_t c = 0; c < 3; c++) {
+                            display[4 * px + c] = toDisplay(scale * job->rgba[4 * px + c], options);
+                        }
+
+                        display[4 * px + 3] = 255;
+                    }
+
+                    RGBImageWriter::writePNG(job->output, job->width, job->height, display);
+                }
+            } catch (const std::exception &e) {
+                fail(job->input, e);
+                continue;
+            }
+
+            if (!options.quiet) {
+                std::lock_guard<std::mutex> lock(logMutex);
+                std::cout << job->input << " -> " << job->output << std::endl;
+            }
+        }
+    };
+
+    // ------------------------------------------------------------------------
+    // Run
+    // ------------------------------------------------------------------------
+
+    const auto start = std::chrono::steady_clock::now();
+
+    std::vector<std::thread> threads;
+
+    for (unsigned int i = 0; i < options.readers; i++) {
+        threads.emplace_back(read);
+    }
+
+    for (unsigned int i = 0; i < options.jobs; i++) {
+        threads.emplace_back(convert);
+    }
+
+    for (unsigned int i = 0; i < options.writers; i++) {
+        threads.emplace_back(write);
+    }
+
+    for (std::thread &t : threads) {
+        t.join();
+    }
+
+    const double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+    if (!options.quiet) {
+        std::cout << (nFiles - nFailed) << "/" << nFiles << " images converted in " << seconds << " s ("
+                  << (bytesRead / (1024. * 1024.)) / std::max(seconds, 1e-9) << " MB/s of spectral data)"
+                  << std::endl;
+    }
+
+    try {
+        Trace::stop();
+    } catch (const std::exception &e) {
+        std::cerr << e.what() << std::endl;
+    }
+
+    return nFailed > 0 ? 1 : 0;
+}
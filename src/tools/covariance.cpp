@@ -0,0 +1,234 @@
+// Band to band covariance or correlation matrix of spectral images:
+//
+//   tiresias_covariance [options] <input.exr|input.artraw>
+//
+// ArtRaw files are streamed a tile of rows at a time, so their size is not
+// bound by the memory. Spectral EXRs are decoded in memory by the EXR
+// library, then processed by tiles as well. The matrix is written as CSV,
+// the band centers in the first row and column.
+
+#include "OptionParsing.h"
+#include "Trace.h"
+
+#include <image_format/SpectralImageFile.h>
+#include <image_format/artraw.h>
+#include <spectral/BandCovariance.h>
+
+#include <algorithm>
+#include <cctype>
+#include <chrono>
+#include <exception>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <limits>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+
+struct Options {
+    std::string input;
+    std::string output;
+
+    bool         correlation = false;
+    unsigned int tileRows    = 64;
+    int          jobs        = 0;
+};
+
+
+static void usage(const char *program)
+{
+    std::cerr
+        << "Usage: " << program << " [options] <input.exr|input.artraw>" << std::endl
+        << std::endl
+        << "Options:" << std::endl
+        << "  -o, --output FILE       CSV file, standard output by default" << std::endl
+        << "  -c, --correlation       Correlation instead of covariance" << std::endl
+        << "      --tile-rows N       Rows read and processed at once (64)" << std::endl
+        << "  -j, --jobs N            Threads (all cores)" << std::endl
+        << "      --trace FILE        Write a Chrome trace of the stages" << std::endl;
+}
+
+
+static std::string extension(const std::string &path)
+{
+    std::string ext = path.substr(path.find_last_of('.') + 1);
+    std::transform(ext.begin(), ext.end(), ext.begin(), ::tolower);
+
+    return ext;
+}
+
+
+static bool parseOptions(int argc, char *argv[], Options &options, std::string &tracePath)
+{
+    for (int i = 1; i < argc; i++) {
+        const std::string arg = argv[i];
+
+        auto value = [&]() -> std::string {
+            if (i + 1 >= argc) {
+                throw std::runtime_error("Missing value for " + arg);
+            }
+
+            return argv[++i];
+        };
+
+        if (arg == "-h" || arg == "--help") {
+            return false;
+        } else if (arg == "-o" || arg == "--output") {
+            options.output = value();
+        } else if (arg == "-c" || arg == "--correlation") {
+            options.correlation = true;
+        } else if (arg == "--tile-rows") {
+            options.tileRows = parseCount(arg, value(), 1);
+        } else if (arg == "-j" || arg == "--jobs") {
+            options.jobs = (int)parseCount(arg, value(), 0, std::numeric_limits<int>::max());
+        } else if (arg == "--trace") {
+            tracePath = value();
+        } else if (!arg.empty() && arg[0] == '-') {
+            throw std::runtime_error("Unknown option " + arg);
+        } else if (options.input.empty()) {
+            options.input = arg;
+        } else {
+            throw std::runtime_error("A single input is expected");
+        }
+    }
+
+    return !options.input.empty();
+}
+
+
+// Accumulates the whole image, returns the band centers
+static std::vector<float> accumulate(const Options &options, BandCovariance &covariance)
+{
+    std::vector<float> wavelengths;
+
+    if (extension(options.input) == "artraw") {
+        ArtRawReader reader(options.input);
+
+        if (!reader.isSpectral()) {
+            throw std::runtime_error("\"" + options.input + "\" is not a spectral image");
+        }
+
+        wavelengths.assign(reader.wavelengths().begin(), reader.wavelengths().end());
+        covariance.reset(reader.nSpectralBands());
+
+        std::vector<float> tile(options.tileRows * reader.width() * reader.nSpectralBands());
+
+        for (size_t nRows; (nRows = reader.readRows(options.tileRows, tile.data())) > 0;) {
+            TRACE_SCOPE("Covariance tile", "stats");
+
+            covariance.add(tile.data(), nRows * reader.width(), options.jobs);
+        }
+    } else {
+        const SpectralImageFile image(options.input);
+
+        wavelengths = image.wavelengths();
+        covariance.reset(image.nSpectralBands());
+
+        const size_t tilePixels = options.tileRows * image.width();
+        const size_t nPixels    = image.width() * image.height();
+
+        for (size_t first = 0; first < nPixels; first += tilePixels) {
+            TRACE_SCOPE("Covariance tile", "stats");
+
+            covariance.add(
+                &image.data()[image.nSpectralBands() * first],
+                std::min(tilePixels, nPixels - first),
+                options.jobs);
+        }
+    }
+
+    return wavelengths;
+}
+
+
+static void writeCSV(std::ostream &os, const std::vector<float> &wavelengths, const std::vector<double> &matrix)
+{
+    const size_t nBands = wavelengths.size();
+
+    os << std::setprecision(9);
+
+    for (size_t j = 0; j < nBands; j++) {
+        os << "," << wavelengths[j];
+    }
+
+    os << "\n";
+
+    for (size_t i = 0; i < nBands; i++) {
+        os << wavelengths[i];
+
+        for (size_t j = 0; j < nBands; j++) {
+            os << "," << matrix[nBands * i + j];
+        }
+
+        os << "\n";
+    }
+}
+
+
+int main(int argc, char *argv[])
+{
+    Options     options;
+    std::string tracePath;
+
+    try {
+        if (!parseOptions(argc, argv, options, tracePath)) {
+            usage(argv[0]);
+            return 1;
+        }
+    } catch (const std::exception &e) {
+        std::cerr << e.what() << std::endl;
+        usage(argv[0]);
+        return 1;
+    }
+
+    if (!tracePath.empty()) {
+        Trace::start(tracePath);
+    }
+
+    int status = 0;
+
+    try {
+        const auto start = std::chrono::steady_clock::now();
+
+        BandCovariance           covariance;
+        const std::vector<float> wavelengths = accumulate(options, covariance);
+
+        const double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+        std::vector<double> matrix;
+
+        if (options.correlation) {
+            covariance.correlation(matrix);
+        } else {
+            covariance.covariance(matrix);
+        }
+
+        if (options.output.empty()) {
+            writeCSV(std::cout, wavelengths, matrix);
+        } else {
+            std::ofstream os(options.output);
+
+            if (!os) {
+                throw std::runtime_error("Could not open \"" + options.output + "\" for writing");
+            }
+
+            writeCSV(os, wavelengths, matrix);
+        }
+
+        std::cerr << options.input << ": " << covariance.count() << " finite pixels, "
+                  << wavelengths.size() << " bands in " << seconds << " s" << std::endl;
+    } catch (const std::exception &e) {
+        std::cerr << "[ERROR] " << options.input << ": " << e.what() << std::endl;
+        status = 1;
+    }
+
+    try {
+        Trace::stop();
+    } catch (const std::exception &e) {
+        std::cerr << e.what() << std::endl;
+    }
+
+    return status;
+}
@@ -0,0 +1,273 @@
+// Procedural spectral images for scaling and benchmark runs:
+//
+//   tiresias_generate [options] <output.exr|output.artraw>...
+//
+// The content only depends on the options (see SyntheticSpectra): the same
+// command always produces the same image. ArtRaw files are written
+// scanline by scanline and can be larger than the memory, spectral EXRs are
+// built in memory before being written.
+
+#include "OptionParsing.h"
+
+#include <image_format/artraw.h>
+#include <spectral/SyntheticSpectra.h>
+
+#include <EXRSpectralImage.h>
+
+#include <algorithm>
+#include <cctype>
+#include <cstdio>
+#include <cstdint>
+#include <exception>
+#include <iostream>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+
+struct Options {
+    std::vector<std::string> outputs;
+
+    unsigned int width  = 1024;
+    unsigned int height = 1024;
+
+    // Uniform grid, unless explicit wavelengths are given
+    unsigned int       nBands        = 32;
+    float              wavelengthMin = 380.f;
+    float              wavelengthMax = 780.f;
+    std::vector<float> wavelengths;
+
+    bool emissive   = true;
+    bool reflective = false;
+    bool polarised  = false;
+
+    uint32_t seed = 0;
+};
+
+
+static void usage(const char *program)
+{
+    std::cerr
+        << "Usage: " << program << " [options] <output.exr|output.artraw>..." << std::endl
+        << std::endl
+        << "Options:" << std::endl
+        << "  -s, --size WxH              Image size (1024x1024)" << std::endl
+        << "  -b, --bands N               Number of bands (32)" << std::endl
+        << "      --range MIN:MAX         Wavelengths of the first and last bands in nm (380:780)" << std::endl
+        << "      --wavelengths W1,W2,... Explicit band centers in nm, overrides --bands and --range" << std::endl
+        << "      --type TYPE             emissive, reflective or both (emissive)" << std::endl
+        << "      --polarised             Emissive Stokes vectors instead of plain spectra" << std::endl
+        << "      --seed N                Content variation (0)" << std::endl;
+}
+
+
+static std::string extension(const std::string &path)
+{
+    std::string ext = path.substr(path.find_last_of('.') + 1);
+    std::transform(ext.begin(), ext.end(), ext.begin(), ::tolower);
+
+    return ext;
+}
+
+
+static bool parseOptions(int argc, char *argv[], Options &options)
+{
+    for (int i = 1; i < argc; i++) {
+        const std::string arg = argv[i];
+
+        auto value = [&]() -> std::string {
+            if (i + 1 >= argc) {
+                throw std::runtime_error("Missing value for " + arg);
+            }
+
+            return argv[++i];
+        };
+
+        if (arg == "-h" || arg == "--help") {
+            return false;
+        } else if (arg == "-s" || arg == "--size") {
+            if (std::sscanf(value().c_str(), "%ux%u", &options.width, &options.height) != 2
+                || options.width == 0 || options.height == 0) {
+                throw std::runtime_error("Invalid size, expected WxH");
+            }
+        } else if (arg == "-b" || arg == "--bands") {
+            options.nBands = parseCount(arg, value(), 1);
+        } else if (arg == "--range") {
+            if (std::sscanf(value().c_str(), "%f:%f", &options.wavelengthMin, &options.wavelengthMax) != 2
+                || !(options.wavelengthMin < options.wavelengthMax)) {
+                throw std::runtime_error("Invalid range, expected MIN:MAX");
+            }
+        } else if (arg == "--wavelengths") {
+            std::stringstream list(value());
+            std::string       item;
+
+            options.wavelengths.clear();
+
+            while (std::getline(list, item, ',')) {
+                options.wavelengths.push_back(parseFloat(arg, item));
+            }
+
+            if (!std::is_sorted(options.wavelengths.begin(), options.wavelengths.end())) {
+                throw std::runtime_error("Wavelengths must be increasing");
+            }
+        } else if (arg == "--type") {
+            const std::string type = value();
+
+            options.emissive   = (type == "emissive" || type == "both");
+            options.reflective = (type == "reflective" || type == "both");
+
+            if (!options.emissive && !options.reflective) {
+                throw std::runtime_error("Unknown image type " + type);
+            }
+        } else if (arg == "--polarised") {
+            options.polarised = true;
+        } else if (arg == "--seed") {
+            options.seed = parseCount(arg, value(), 0);
+        } else if (!arg.empty() && arg[0] == '-') {
+            throw std::runtime_error("Unknown option " + arg);
+        } else {
+            options.outputs.push_back(arg);
+        }
+    }
+
+    if (options.polarised && !options.emissive) {
+        throw std::runtime_error("Polarised images must have an emissive layer");
+    }
+
+    return !options.outputs.empty();
+}
+
+
+// ----------------------------------------------------------------------------
+// Writers
+// ----------------------------------------------------------------------------
+
+static void writeArtRaw(const Options &options, const std::vector<float> &wavelengths, const std::string &path)
+{
+    if (options.reflective) {
+        throw std::runtime_error("ArtRaw only stores emissive images");
+    }
+
+    const SyntheticSpectra spectra(wavelengths, options.width, options.height, options.seed);
+
+    ArtRawWriter writer(path, options.width, options.height, SyntheticSpectra::bounds(wavelengths), options.polarised);
+
+    std::vector<float> row((options.polarised ? 4 : 1) * wavelengths.size() * options.width);
+
+    for (size_t y = 0; y < options.height; y++) {
+        if (options.polarised) {
+            spectra.polarisedRow(y, row.data());
+        } else {
+            spectra.row(y, row.data());
+        }
+
+        writer.writeRow(row.data());
+    }
+
+    writer.close();
+}
+
+
+static void writeEXR(const Options &options, const std::vector<float> &wavelengths, const std::string &path)
+{
+    int type = 0;
+
+    if (options.emissive) {
+        type |= options.polarised ? SEXR::EMISSIVE_POLARISED : SEXR::EMISSIVE;
+    }
+
+    if (options.reflective) {
+        type |= SEXR::REFLECTIVE;
+    }
+
+    SEXR::EXRSpectralImage image(options.width, options.height, wavelengths, (SEXR::SpectrumType)type);
+
+    const size_t nBands = wavelengths.size();
+
+    // The reflective layer differs from the emissive one
+    const SyntheticSpectra emissive(wavelengths, options.width, options.height, options.seed);
+    const SyntheticSpectra reflective(wavelengths, options.width, options.height, options.seed + 1, true);
+
+    const long height = (long)options.height;
+
+#pragma omp parallel for schedule(dynamic)
+    for (long y = 0; y < height; y++) {
+        std::vector<float> row(4 * nBands * options.width);
+
+        if (options.emissive) {
+            const size_t nStokes = options.polarised ? 4 : 1;
+
+            if (options.polarised) {
+                emissive.polarisedRow(y, row.data());
+            } else {
+                emissive.row(y, row.data());
+            }
+
+            for (size_t x = 0; x < options.width; x++) {
+                for (size_t s = 0; s < nStokes; s++) {
+                    for (size_t b = 0; b < nBands; b++) {
+                        image.emissive(x, y, b, s) = row[(nStokes * x + s) * nBands + b];
+                    }
+                }
+            }
+        }
+
+        if (options.reflective) {
+            reflective.row(y, row.data());
+
+            for (size_t x = 0; x < options.width; x++) {
+                for (size_t b = 0; b < nBands; b++) {
+                    image.reflective(x, y, b) = row[nBands * x + b];
+                }
+            }
+        }
+    }
+
+    image.save(path);
+}
+
+
+int main(int argc, char *argv[])
+{
+    Options options;
+
+    try {
+        if (!parseOptions(argc, argv, options)) {
+            usage(argv[0]);
+            return 1;
+        }
+    } catch (const std::exception &e) {
+        std::cerr << e.what() << std::endl;
+        usage(argv[0]);
+        return 1;
+    }
+
+    const std::vector<float> wavelengths = options.wavelengths.empty()
+                                               ? SyntheticSpectra::uniformWavelengths(options.wavelengthMin, options.wavelengthMax, options.nBands)
+                                               : options.wavelengths;
+
+    int status = 0;
+
+    for (const std::string &path : options.outputs) {
+        try {
+            const std::string ext = extension(path);
+
+            if (ext == "artraw") {
+                writeArtRaw(options, wavelengths, path);
+            } else if (ext == "exr") {
+                writeEXR(options, wavelengths, path);
+            } else {
+                throw std::runtime_error("Unsupported output format, expected .exr or .artraw");
+            }
+
+            std::cout << path << ": " << options.width << "x" << options.height << ", "
+                      << wavelengths.size() << " bands" << std::endl;
+        } catch (const std::exception &e) {
+            std::cerr << "[ERROR] " << path << ": " << e.what() << std::endl;
+            status = 1;
+        }
+    }
+
+    return status;
+}